@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+
+/* 二进制日志文件格式(本机字节序), 由 SetBinaryLog( true ) 启用, 用 leonlog-decode 还原为文本.
+   文件以 BinFileHead_t 开头(追加到已有的非二进制内容之后的, 从追加处开始), 其后是一串记录, 每条记录都以定长的 BinRecHead_t 开头, 后跟 size 字节负载:
+	'H' 会话开始: level 为时戳精度, 负载为库版本串. 每次打开文件都会写一条, 其后字典全部重建
+	'L' 级别名:   level 为级别值, 负载为级别名
+	'T' 线程名:   thread 为文件内线程编号, 负载为线程名
+	'F' 格式串:   负载为 uint32_t 格式编号 + 类型码串 + '\0' + 格式串
+	'S' 文本日志: 负载为日志内容
+	'A' 参数日志: 负载为 uint32_t 格式编号 + 打包的参数
+   字典记录总是先于引用它的日志记录出现, 后出现的同编号定义覆盖先前的. */
+
+namespace leon_log {
+
+constexpr char		BIN_LOG_MAGIC[8] = { 'L', 'E', 'O', 'N', 'L', 'O', 'G', 'B' };
+constexpr uint16_t	BIN_LOG_VERSION = 1;
+
+struct BinFileHead_t {
+	char		magic[8];
+	uint16_t	version;
+	uint16_t	reserved[3];
+};
+
+struct BinRecHead_t {
+	uint8_t		kind;	// 记录类别, 见上
+	uint8_t		level;	// 日志级别
+	uint16_t	thread;	// 线程编号
+	uint32_t	size;	// 负载字节数
+	int64_t		stamp;	// 自纪元起的纳秒数
+};
+
+static_assert( sizeof( BinFileHead_t ) == 16 && sizeof( BinRecHead_t ) == 16 );
+
+// 把二进制日志还原为与文本日志相同格式的行, 写至 out. in 须可定位(文件或字符串流).
+// 文件头之前的内容(如先前写的文本日志)跳过; 长度不对、引用未定义格式串等坏记录报告至 err 后跳过,
+// 截断处报告后结束. 找不到文件头或格式版本太新则返回 false
+bool DecodeBinLog( std::istream& in, std::ostream& out, std::ostream& err );
+
+};	// namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -1,10 +1,16 @@
 #pragma once
+#include <atomic>
+#include <charconv>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <leonutils/Chrono.hpp>
 #include <leonutils/UnionTypes.hpp>
+#include <memory>
+#include <ostream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
 using char_cp = const char*;
@@ -64,12 +70,48 @@ enum LogLevel_e : int {
 
 using LogStamp_t = std::chrono::system_clock::time_point;
 
-// 全系统日志级别
-extern LogLevel_e g_log_level;
+// 全系统日志级别的"门槛": 设定的级别与各线程覆盖级别(见 SetThreadLogLevel)中最低的.
+// 宏只与它比较(一次读一次比), 过了门槛才确切判断(LevelOn), 没有线程覆盖时二者一致
+extern std::atomic<LogLevel_e> g_log_level;
+// 全系统设定的日志级别(不计线程覆盖)
+extern std::atomic<LogLevel_e> g_base_level;
 /* static 会导致多重"影子"变量,下面这些都不行!
    static LogLevel_e g_log_level = LogLevel_e::Debug;
    static const LogLevel_e g_log_level = LogLevel_e::Debug; */
 
+// 本线程的日志级别覆盖, VALUES_COUNT 为不覆盖. 只能经由 SetThreadLogLevel 修改
+inline thread_local LogLevel_e tl_log_level = LogLevel_e::VALUES_COUNT;
+
+// 确切判断: 某级别的日志在本线程要不要输出(不低于 base_ 或本线程的覆盖级别)
+inline bool LevelOn( LogLevel_e level_, const std::atomic<LogLevel_e>& base_ = g_base_level ) {
+	return level_ >= base_.load( std::memory_order_relaxed ) || level_ >= tl_log_level;
+};
+
+/* LogCategory_t: 日志类别, 各有各的级别, 以便只打开某个子系统的调试日志.
+   通常定义为全局(或静态)对象, 同名的类别共享 SetCategoryLevel 设定的级别. 没有设定过的跟随全系统级别.
+   与 g_log_level 一样, 宏只比较门槛 gate, 关闭的类别只花一次读一次比 */
+class LogCategory_t {
+public:
+	explicit LogCategory_t( str_cr name_ );
+	~LogCategory_t();
+
+	LogCategory_t( const LogCategory_t& ) = delete;
+	LogCategory_t& operator=( const LogCategory_t& ) = delete;
+
+	str_cr name() const { return _name; };
+	bool on( LogLevel_e level_ ) const {
+		return level_ >= gate.load( std::memory_order_relaxed ) && LevelOn( level_, level );
+	};
+
+	// 门槛: 本类别级别与各线程覆盖级别中最低的
+	std::atomic<LogLevel_e>	gate { LogLevel_e::Debug };
+	// 本类别的级别
+	std::atomic<LogLevel_e>	level { LogLevel_e::Debug };
+
+private:
+	const str_t				_name;
+};
+
 // 常量定义: 单个日志队列的容量(整个系统中每个线程对应一个日志队列, 只要它添加过日志)
 // 队列再大也只是缓冲突发的日志，如果产生日志持续比消费日志快, 再大的队列也会爆...
 constexpr size_t DEFAULT_LOG_QUE_SIZE = 256;
@@ -82,7 +124,7 @@ void StartLog(
 	str_cr		log_file,							// 日志文件路径及名称
 	LogLevel_e	log_levl = LogLevel_e::Debug,		// 日志级别
 	size_t		stamp_precision = 6,				// 时戳精度
-	size_t		que_size = DEFAULT_LOG_QUE_SIZE,	// 日志队列容量
+	size_t		que_size = DEFAULT_LOG_QUE_SIZE,	// 每个线程的日志队列容量
 	str_cr		run_on_cpus = "",					// 只在哪些cpu上运行日志线程
 	bool		header = true,						// 启动时输出header
 	bool		stdout = true,						// 同时输出至stdout
@@ -97,6 +139,13 @@ void StopLog(
 );
 // 日志系统正在运行
 bool IsLogging();
+
+// 运行期间调整全系统日志级别(StartLog 时也会设定)
+void SetLogLevel( LogLevel_e );
+// 设定某日志类别的级别, 类别尚未创建也可以(创建时生效). VALUES_COUNT 为恢复跟随全系统级别
+void SetCategoryLevel( str_cr name, LogLevel_e );
+// 本线程的日志只要不低于此级别就输出, 不论全系统及类别的级别如何. VALUES_COUNT 为取消覆盖(线程退出时自动取消)
+void SetThreadLogLevel( LogLevel_e );
 // 显示错误信息,关闭日志并退出
 void ExitWithLog( str_cr );
 
@@ -109,6 +158,8 @@ void RegistThread( str_cr );
 // 添加日志的主函数
 template <typename T>
 bool AppendLog( LogLevel_e, T&& body );
+// 添加带结构化字段的日志: body 为正文 + kvs 个打包的字段 + 正文长度(uint32), 见 Log_t::kv
+bool AppendLogKv( LogLevel_e, str_t&& body, uint16_t kvs );
 
 // 设置写盘间隔(每隔多少秒确保保存一次,默认1s)
 void SetFlushIntrvl( leon_utl::SysDura_t interval );
@@ -119,129 +170,481 @@ void SetExitSeconds( unsigned int secs );
 // 设置一个存放时间戳的指针,之后输出日志时都会去那个地址找时戳
 void SetLogStampPtr( const LogStamp_t* );
 
-// 轮转日志文件
+// 轮转日志文件, 中缀为空则以文件开始写的时刻为中缀
 void RotateLogFile( str_cr infix /*中缀*/ );
 
+// 若 file_ 是以时刻为中缀从日志文件 live_ 轮转出来的("主名-YYYYMMDD-HHMMSS[-n].扩展名", 压缩后再加".gz"),
+// 返回可按字符串比较先后的排序键(旧的小), 否则返回空串. 另给了中缀的不算, 自动清理也不会删它们
+str_t RotatedKey( str_cr live_, str_cr file_ );
+
+// 增加一个输出(须在 StartLog 之前调用): 不低于 level 级别的日志也写至 target(文件路径, 或"stdout"、"stderr").
+// 每条日志只格式化一次, 再分发给日志文件及各个想要它的输出. async 的输出有自己的线程及缓冲区,
+// 写得再慢也不会拖住日志线程, 缓冲区满时丢弃, 丢弃的行数会定期写进日志
+void AddLogSink( str_cr target, LogLevel_e level, bool async = true );
+// 清除所有 AddLogSink 增加的输出(须在 StartLog 之前调用)
+void ClearLogSinks();
+
+// 合并重复日志(须在 StartLog 之前调用): 同一线程同级别、内容相同的日志, 在上次写出后 window 之内
+// 再出现的只计数不写出, 窗口过后补写一条"此日志又重复了N次(首次 ~ 末次):内容". 0(缺省)为不合并
+void SetDedupWindow( leon_utl::SysDura_t window );
+
+// 自动轮转的时间边界(按本地时间)
+enum Rotate_e : int {
+	// 不按时间轮转
+	NoRotate = 0,
+	// 每个整点
+	Hourly,
+	// 每天零点
+	Daily
+};
+
+// 设置自动轮转策略(须在 StartLog 之前调用): 日志文件写到 max_bytes 字节(0为不限), 或到达 every
+// 指定的时间边界时, 由日志线程自行轮转, 不必等待. 自动轮转(及不指定中缀的轮转)的文件名中缀为该文件
+// 开始写的时刻, 如 "app-20240102-000000.log", 重名时再加 "-1"、"-2"...
+// keep 为保留多少个以时刻为中缀轮转出的文件(含压缩后的), 多出的按中缀从旧到新删除, 0为全部保留
+void SetRotation( uint64_t max_bytes, Rotate_e every = NoRotate, size_t keep = 0 );
+
+// 日志改为 JSON lines 格式输出(须在 StartLog 之前调用), 每行一个对象:
+// {"ts":"时戳","level":"INFOR","thread":"线程名","msg":"正文", 各结构化字段...}
+// 时戳为 RFC 3339 格式的本地时间, 带UTC偏移, 如"2026-01-02T03:04:05.123456+08:00"
+// 日志文件、stdout 及各输出都是如此(二进制日志文件除外), 转义及数值格式化都在日志线程完成
+void SetJsonLog( bool );
+
+// 日志文件改用紧凑的二进制格式(须在 StartLog 之前调用), 可用 leonlog-decode 工具还原为文本
+void SetBinaryLog( bool );
+
+// 日志文件改为内存映射方式写入(须在 StartLog 之前调用). 日志线程写日志只是内存拷贝, 没有写文件的系统调用,
+// 进程即使被 SIGKILL/OOM 杀死, 已提交(日志线程每清空一轮队列提交一次)的日志也都留在内核里.
+// 注意: 被杀时还在各线程队列里、日志线程尚未取走的日志, 以及正写着、未提交的那一轮, 仍会丢失
+// (SIGKILL 无从拦截; 能拦截的崩溃信号见 SetCrashHandler). 运行期间文件尾部会有预分配的空白,
+// 正常关闭时裁掉; 没能正常关闭的, 下次启动时(按旁边 .mmhd 文件里记录的已提交位置)修复
+void SetMmapLog( bool );
+
+// 日志文件改为 O_DIRECT 方式写入(须在 StartLog 之前调用), 日志不再占用页缓存, 不与别的程序争抢.
+// 写入以4K整块进行, 文件按64M大段预分配(不改变文件长度), 正常关闭(或轮转)时释放; 没能正常关闭的,
+// 末块补的0下次启动时裁掉.
+// 文件系统不支持 O_DIRECT 的, 以及二进制日志, 仍按普通方式写入; 与 SetMmapLog 同时开启时以内存映射为准
+void SetDirectLog( bool );
+
+// 由 StartLog 安装致命信号(SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT)处理函数(须在 StartLog 之前调用).
+// 进程崩溃时, 叫停日志线程, 以异步信号安全的方式把各队列中的日志写进日志文件(二进制日志另存为".crash"文本),
+// 再添一条崩溃标记, 最后交还原先的处理方式重发信号. 日志线程迟迟不停手的, 不动队列, 崩溃标记另存为".crash".
+// 只写日志文件: 其它输出(AddLogSink)、stdout 及时间索引中尚未写出的内容就丢了. StopLog 时卸载
+void SetCrashHandler( bool );
+
+// 开启后台压缩(须在 StartLog 之前调用): 轮转出来的日志文件由一个低优先级的压缩线程压缩为 BGZF 格式
+// (分块的 gzip, zcat 可直接读, 也能按块随机访问)的".gz"文件, 成功后删除原文件. 启动时顺带压缩以前遗留的.
+// 压缩线程以 SCHED_IDLE 调度、空闲级IO运行, 不与日志线程争抢; run_on_cpus 格式同 StartLog 的
+// 参数, 空串表示不限定; level 为 zlib 压缩级别(1~9)
+void SetCompressor( bool on, str_cr run_on_cpus = "", int level = 6 );
+
+// 给日志文件建时间索引(须在 StartLog 之前调用): 日志线程在文本日志文件旁维护一个".idx"文件,
+// 每 every_lines 行或每 every_time 记一段的位置及时戳范围(格式见 leonlog/LogIndex.hpp), 随文件轮转改名.
+// leonlog-query 工具据此直接跳到要查的时间范围, 不必逐行查找. every_lines 为0(缺省)即不建索引;
+// 二进制日志, 以及 fork 出的子进程与父进程共用的日志文件, 不建索引
+void SetTimeIndex( size_t every_lines, leon_utl::SysDura_t every_time = std::chrono::seconds( 1 ) );
+
+// fork 之后, 子进程里的日志怎么办
+enum ForkLog_e : int {
+	// 子进程不记日志: 日志系统在子进程里处于未启动状态(日志同启动前一样输出至 stderr)
+	ForkNoLog = 0,
+	// 子进程另起日志线程, 与父进程追加写同一个日志文件. 轮转归父进程, 父进程轮转后子进程随之改写新文件
+	ForkSameFile,
+	// 子进程另起日志线程, 写自己的日志文件: 扩展名前加上 pid, 如 "app.1234.log"
+	ForkPerPid
+};
+
+// 设置 fork 出的子进程的日志方式(须在 StartLog 之前调用), 缺省 ForkSameFile.
+// StartLog 时注册 fork 处理函数: fork 前叫日志线程停在两轮之间, fork 后父进程照常继续, 不必为了 fork
+// 停止再重启日志系统; 子进程里扔掉从父进程继承的队列(其中的日志归父进程写), 按本设置另起日志线程.
+// 二进制、内存映射或 O_DIRECT 方式的日志文件不能两个进程同写; 设了自动轮转或后台压缩的, 子进程写着的文件
+// 可能被父进程压缩、清理掉. 这些情况下 ForkSameFile 都按 ForkPerPid 处理
+void SetForkLog( ForkLog_e );
+
+// 日志队列满时(日志产生得比写得快)的处理策略
+enum Overflow_e : int {
+	// 阻塞等待, 直到入队成功; 超时仍未入队则丢弃这条日志
+	Block = 0,
+	// 直接丢弃这条新日志
+	DropNewest,
+	// 让日志线程在下一轮开始时就丢弃本线程队头级别更低的日志以腾出空间(每等着一条挤掉一条),
+	// 不必等它按时戳归并写到这里; 同时等待(超时同 Block)
+	EvictLower,
+	// 写入溢出文件(日志文件名加".spill"), 由日志线程稍后补写. 溢出文件不可用时同 Block
+	Spill
+};
+
+// 设置某一级别的日志在队列满时的处理策略(须在 StartLog 之前调用), timeout 是最多等待多久
+// 缺省: Debug、Infor 丢弃; Notif、Warnn 挤掉更低级别的; Error 阻塞; Fatal 溢出至文件, 绝不丢弃
+void SetOverflowPolicy( LogLevel_e, Overflow_e, leon_utl::SysDura_t timeout = std::chrono::seconds( 1 ) );
+
+// 落盘策略(须在 StartLog 之前调用). 平时日志每轮写出、定期写出, 只是进了内核, 掉电仍可能丢;
+// 某一轮写出的日志中有 sync_level 及以上级别的, 写出后随即 fdatasync 日志文件, 同一轮里再多也只一次(组提交).
+// wait_fatal 为 true 时, 写 Fatal 的线程等到它已落盘(最多等 timeout)才返回, Fatal 也必定触发落盘
+// (共享内存日志的生产者不等). 缺省 sync_level 为 VALUES_COUNT, 即从不 fdatasync
+void SetDurability( LogLevel_e sync_level, bool wait_fatal = false,
+					leon_utl::SysDura_t timeout = std::chrono::seconds( 1 ) );
+
+// 本次启动以来, 某一级别因队列满而丢弃的日志条数(日志线程也会定期把丢弃数写进日志)
+uint64_t DroppedLogs( LogLevel_e );
+
 #ifdef DEBUG
 
-#define LOG_DEBUG( log_body ) ( g_log_level <= LogLevel_e::Debug && AppendLog( LogLevel_e::Debug, str_t( __func__ ) + "()," + ( log_body ) ) )
-#define LOG_INFOR( log_body ) ( g_log_level <= LogLevel_e::Infor && AppendLog( LogLevel_e::Infor, str_t( __func__ ) + "()," + ( log_body ) ) )
-#define LOG_NOTIF( log_body ) ( g_log_level <= LogLevel_e::Notif && AppendLog( LogLevel_e::Notif, str_t( __func__ ) + "()," + ( log_body ) ) )
-#define LOG_WARNN( log_body ) ( g_log_level <= LogLevel_e::Warnn && AppendLog( LogLevel_e::Warnn, str_t( __func__ ) + "()," + ( log_body ) ) )
-#define LOG_ERROR( log_body ) ( g_log_level <= LogLevel_e::Error && AppendLog( LogLevel_e::Error, str_t( __func__ ) + "()," + ( log_body ) ) )
-#define LOG_FATAL( log_body ) ( g_log_level <= LogLevel_e::Fatal && AppendLog( LogLevel_e::Fatal, str_t( __func__ ) + "()," + ( log_body ) ) )
+#define LOG_DEBUG( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Debug && LevelOn( LogLevel_e::Debug ) && AppendLog( LogLevel_e::Debug, str_t( __func__ ) + "()," + ( log_body ) ) )
+#define LOG_INFOR( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Infor && LevelOn( LogLevel_e::Infor ) && AppendLog( LogLevel_e::Infor, str_t( __func__ ) + "()," + ( log_body ) ) )
+#define LOG_NOTIF( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Notif && LevelOn( LogLevel_e::Notif ) && AppendLog( LogLevel_e::Notif, str_t( __func__ ) + "()," + ( log_body ) ) )
+#define LOG_WARNN( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Warnn && LevelOn( LogLevel_e::Warnn ) && AppendLog( LogLevel_e::Warnn, str_t( __func__ ) + "()," + ( log_body ) ) )
+#define LOG_ERROR( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Error && LevelOn( LogLevel_e::Error ) && AppendLog( LogLevel_e::Error, str_t( __func__ ) + "()," + ( log_body ) ) )
+#define LOG_FATAL( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Fatal && LevelOn( LogLevel_e::Fatal ) && AppendLog( LogLevel_e::Fatal, str_t( __func__ ) + "()," + ( log_body ) ) )
 
 #else
 
-#define LOG_DEBUG( log_body ) ( g_log_level <= LogLevel_e::Debug && AppendLog( LogLevel_e::Debug, ( log_body ) ) )
-#define LOG_INFOR( log_body ) ( g_log_level <= LogLevel_e::Infor && AppendLog( LogLevel_e::Infor, ( log_body ) ) )
-#define LOG_NOTIF( log_body ) ( g_log_level <= LogLevel_e::Notif && AppendLog( LogLevel_e::Notif, ( log_body ) ) )
-#define LOG_WARNN( log_body ) ( g_log_level <= LogLevel_e::Warnn && AppendLog( LogLevel_e::Warnn, ( log_body ) ) )
-#define LOG_ERROR( log_body ) ( g_log_level <= LogLevel_e::Error && AppendLog( LogLevel_e::Error, ( log_body ) ) )
-#define LOG_FATAL( log_body ) ( g_log_level <= LogLevel_e::Fatal && AppendLog( LogLevel_e::Fatal, ( log_body ) ) )
+#define LOG_DEBUG( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Debug && LevelOn( LogLevel_e::Debug ) && AppendLog( LogLevel_e::Debug, ( log_body ) ) )
+#define LOG_INFOR( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Infor && LevelOn( LogLevel_e::Infor ) && AppendLog( LogLevel_e::Infor, ( log_body ) ) )
+#define LOG_NOTIF( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Notif && LevelOn( LogLevel_e::Notif ) && AppendLog( LogLevel_e::Notif, ( log_body ) ) )
+#define LOG_WARNN( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Warnn && LevelOn( LogLevel_e::Warnn ) && AppendLog( LogLevel_e::Warnn, ( log_body ) ) )
+#define LOG_ERROR( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Error && LevelOn( LogLevel_e::Error ) && AppendLog( LogLevel_e::Error, ( log_body ) ) )
+#define LOG_FATAL( log_body ) ( g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Fatal && LevelOn( LogLevel_e::Fatal ) && AppendLog( LogLevel_e::Fatal, ( log_body ) ) )
 
 #endif
 
-class Log_t: public oss_t {
+/*-------------------------------------
+	LogBuf_t: 流式日志的格式化缓冲区. 每个线程一个, 反复使用, 免得每条日志都构造一个 ostringstream
+	(连带其 locale). 算术类型、字符串直接写入缓冲区, 其它类型(用户自定义类型、流操纵符)才借道 ostream. */
+class LogBuf_t : public std::streambuf {
 public:
-	explicit Log_t( LogLevel_e l ) : _level( l ) {};
+	str_t _str;
+
+protected:
+	int_type overflow( int_type c_ ) override {
+		if( !traits_type::eq_int_type( c_, traits_type::eof() ) )
+			_str.push_back( traits_type::to_char_type( c_ ) );
+		return traits_type::not_eof( c_ );
+	};
+
+	std::streamsize xsputn( const char* s_, std::streamsize n_ ) override {
+		_str.append( s_, n_ );
+		return n_;
+	};
+};
 
-	// 释放本对象时一并输出,且本类可派生
-	~Log_t() override { AppendLog( _level, str() ); };
+struct LogStream_t {
+	LogBuf_t	buf;
+	ost_t		os { &buf };
+	bool		busy = false;	// 正被某个 Log_t 占用(日志内容的输出过程中又嵌套了日志)
+	str_t		kvs;			// 打包的结构化字段(见 Log_t::kv)
+	uint16_t	kv_count = 0;
+};
 
-	operator bool() { return _level >= g_log_level; };
+inline LogStream_t& ThreadLogStream() {
+	thread_local LogStream_t tl_stream;
+	return tl_stream;
+};
+
+class Log_t {
+public:
+	explicit Log_t( LogLevel_e l ) : Log_t( l, LevelOn( l ) ) {};
+	Log_t( const LogCategory_t& c, LogLevel_e l ) : Log_t( l, c.on( l ) ) {};
+
+	Log_t( LogLevel_e l, bool on ) : _level( l ), _on( on ) {
+		LogStream_t& tl = ThreadLogStream();
+		if( tl.busy ) [[unlikely]] {
+			_own = std::make_unique<LogStream_t>();
+			_ls = _own.get();
+		} else {
+			tl.busy = true;
+			_ls = &tl;
+		}
+	};
+
+	Log_t( const Log_t& ) = delete;
+	Log_t& operator=( const Log_t& ) = delete;
+
+	// 释放本对象时一并输出,且本类可派生. 缓冲区内容是"移交"给日志队列的, 而非拷贝
+	virtual ~Log_t() {
+		if( _on && _ls->kv_count == 0 )
+			AppendLog( _level, std::move( _ls->buf._str ) );
+		else if( _on ) {
+			// 字段附在正文之后, 最后是正文的长度
+			str_t& body = _ls->buf._str;
+			uint32_t text_len = static_cast<uint32_t>( body.size() );
+			body.append( _ls->kvs ).append( reinterpret_cast<const char*>( &text_len ), sizeof( text_len ) );
+			AppendLogKv( _level, std::move( body ), _ls->kv_count );
+		}
+		_ls->buf._str.clear();
+		if( _ls->kv_count > 0 ) {
+			_ls->kvs.clear();
+			_ls->kv_count = 0;
+		}
+		if( _dirty ) {
+			_ls->os.flags( std::ios_base::skipws | std::ios_base::dec );
+			_ls->os.width( 0 );
+			_ls->os.precision( 6 );
+			_ls->os.fill( ' ' );
+			_ls->os.clear();
+		}
+		_ls->busy = false;
+	};
+
+	// 须为 explicit, 否则没有匹配的 operator<< 时, 会悄悄变成 bool 的移位运算
+	explicit operator bool() { return _on; };
+
+	// 已格式化的日志内容
+	str_t& str() { return _ls->buf._str; };
+
+	/* 结构化字段, 如: lg_info.kv( "order_id", id ).kv( "px", px ) << "成交";
+	   字段按类型打包(类型码, 键长, 键, 值)附在正文之后, 由日志线程输出为" 键=值"或 JSON 字段(见 SetJsonLog).
+	   整数、浮点数、布尔值保留原类型, 字符串原样保存, 其它类型借道 ostream 转为字符串. 键最长255字节 */
+	template <typename V>
+	Log_t& kv( std::string_view key_, const V& val_ ) {
+		if( !_on || _ls->kv_count == UINT16_MAX )
+			return *this;
+
+		if constexpr( std::is_enum_v<V> )
+			return kv( key_, static_cast<std::underlying_type_t<V>>( val_ ) );
+		else if constexpr( std::is_same_v<V, bool> ) {
+			kv_head( 'b', key_ );
+			_ls->kvs.push_back( val_ ? 1 : 0 );
+		} else if constexpr( std::is_same_v<V, char> )
+			kv_str( key_, std::string_view( &val_, 1 ) );
+		else if constexpr( std::is_integral_v<V> && std::is_signed_v<V> ) {
+			kv_head( 'l', key_ );
+			kv_raw( static_cast<int64_t>( val_ ) );
+		} else if constexpr( std::is_integral_v<V> ) {
+			kv_head( 'L', key_ );
+			kv_raw( static_cast<uint64_t>( val_ ) );
+		} else if constexpr( std::is_floating_point_v<V> ) {
+			kv_head( 'd', key_ );
+			kv_raw( static_cast<double>( val_ ) );
+		} else if constexpr( std::is_convertible_v<const V&, std::string_view> ) {
+			if constexpr( std::is_pointer_v<V> )
+				if( val_ == nullptr )
+					return kv( key_, "{null-char*}" );
+			kv_str( key_, val_ );
+		} else {
+			// 借正文缓冲区的尾部格式化, 再挪过来
+			size_t at = str().size();
+			os() << val_;
+			kv_str( key_, std::string_view( str() ).substr( at ) );
+			str().resize( at );
+		}
+		return *this;
+	};
+
+	// 调试版的 lg_* 宏用: 正文以"函数名(),"开头
+	Log_t& at( char_cp func_ ) {
+		if( _on )
+			str().append( func_ ).append( "()," );
+		return *this;
+	};
+
+	// 借道 ostream 输出
+	ost_t& os() {
+		_dirty = true;
+		return _ls->os;
+	};
+
+	// 流状态仍是缺省值(没被操纵符改过)才能走快速通道, 否则要尊重诸如 std::hex、std::setw 的效果
+	bool plain() const {
+		return !_dirty || ( _ls->os.flags() == ( std::ios_base::skipws | std::ios_base::dec )
+							&& _ls->os.width() == 0 && _ls->os.precision() == 6 );
+	};
 
 	// 把属性公开之后,就不需要后面那一堆友元函数了.关键是,用户自定义类型也可流式输出了!
 	LogLevel_e _level;
+	// 这条日志要输出(构造时按全系统或类别级别, 及本线程的覆盖确切判断过)
+	const bool _on;
+
+private:
+	void kv_head( char code_, std::string_view key_ ) {
+		uint8_t klen = static_cast<uint8_t>( key_.size() < UINT8_MAX ? key_.size() : UINT8_MAX );
+		_ls->kvs.push_back( code_ );
+		_ls->kvs.push_back( static_cast<char>( klen ) );
+		_ls->kvs.append( key_.data(), klen );
+		++_ls->kv_count;
+	};
+	template <typename T>
+	void kv_raw( T v_ ) {
+		_ls->kvs.append( reinterpret_cast<const char*>( &v_ ), sizeof( T ) );
+	};
+	void kv_str( std::string_view key_, std::string_view v_ ) {
+		kv_head( 'z', key_ );
+		kv_raw( static_cast<uint32_t>( v_.size() ) );
+		_ls->kvs.append( v_ );
+	};
+
+	LogStream_t*					_ls;
+	std::unique_ptr<LogStream_t>	_own;
+	bool							_dirty = false;
 };
 
 /*-------------------------------------
 	为了特殊处理指针, 当遭遇空指针时, 能够输出诸如 "{null-char*}", "{null-void*}"...
 	这样的玩意, 而非直接崩溃, 所以试试针对特定类型做 overload. */
 inline Log_t& operator<<( Log_t& log_, char_cp ptr_ ) {
-	if( log_._level < leon_log::g_log_level )
+	if( !log_._on )
 		return log_;
 
 	if( ptr_ == nullptr )
-		static_cast<oss_t&>( log_ ) << "{null-char*}";
+		log_.str().append( "{null-char*}" );
+	else if( log_.plain() )
+		log_.str().append( ptr_ );
 	else
-		static_cast<oss_t&>( log_ ) << ptr_;
+		log_.os() << ptr_;
 	return log_;
 };
 
 inline Log_t& operator<<( Log_t& log_, const void* ptr_ ) {
-	if( log_._level < g_log_level )
+	if( !log_._on )
 		return log_;
 
 	if( ptr_ == nullptr )
-		static_cast<oss_t&>( log_ ) << "{null-void*}";
+		log_.str().append( "{null-void*}" );
 	else
-		static_cast<oss_t&>( log_ ) << std::hex << ptr_;
+		log_.os() << std::hex << ptr_;
 	return log_;
 };
 
-// inline ost_t& operator<<( ost_t& os_, leon_utl::U64_u u_ ) { return os_ << u_.view(); };
+inline Log_t& operator<<( Log_t& log_, char ch_ ) {
+	if( !log_._on )
+		return log_;
 
-template <typename C, typename D>
-inline ost_t& operator<<( ost_t& os_, time_point<C, D> tp_ ) {
-	return os_ << leon_utl::fmt( tp_, 6, leon_utl::NEAT_FORMAT );
+	if( log_.plain() )
+		log_.str().push_back( ch_ );
+	else
+		log_.os() << ch_;
+	return log_;
 };
 
-//-------------------------------------
-
-};	// namespace leon_log ======================================================
+inline Log_t& operator<<( Log_t& log_, std::nullptr_t ) {
+	if( log_._on )
+		log_.str().append( "nullptr" );
+	return log_;
+};
 
-/* operator<<函数的overload, 在不同的命名空间内似乎不一定能被用上, 试试在地板上也放一个
-inline leon_log::Log_t& operator<<( leon_log::Log_t& log_, char_cp ptr_ ) {
-	return leon_log::operator<<( log_, ptr_ );
+// 流操纵符(std::endl, std::hex...)
+inline Log_t& operator<<( Log_t& log_, ost_t& ( *manip_ )( ost_t& ) ) {
+	if( log_._on )
+		log_.os() << manip_;
+	return log_;
 };
-inline leon_log::Log_t& operator<<( leon_log::Log_t& log_, const void* ptr_ ) {
-	return leon_log::operator<<( log_, ptr_ );
+
+inline Log_t& operator<<( Log_t& log_, std::ios_base& ( *manip_ )( std::ios_base& ) ) {
+	if( log_._on )
+		log_.os() << manip_;
+	return log_;
 };
-*/
 
-// template<typename T> T& unmove( T&& r_ ) { return static_cast<T&>( r_ ); }
+// inline ost_t& operator<<( ost_t& os_, leon_utl::U64_u u_ ) { return os_ << u_.view(); };
 
+template <typename C, typename D>
+inline ost_t& operator<<( ost_t& os_, time_point<C, D> tp_ ) {
+	return os_ << leon_utl::fmt( tp_, 6, leon_utl::NEAT_FORMAT );
+};
+
+/* 通用版本. 以前放在全局命名空间(地板上), 但 Log_t 不再是 ostream 之后, 只有放在 Log_t 所在的
+   命名空间内, 才能保证总被 ADL 找到. 算术类型用 to_chars 直接写入缓冲区, 输出效果与 ostream 的缺省
+   格式完全相同(浮点数即 "%g"), 其它类型借道 ostream, 因此用户为 ostream 定义的 operator<< 照样可用 */
 template <NonPtr T>
-inline leon_log::Log_t& operator<<( leon_log::Log_t& log_, const T& body_ ) {
+inline Log_t& operator<<( Log_t& log_, const T& body_ ) {
+	if( !log_._on )
+		return log_;
 
-	if( log_._level >= leon_log::g_log_level )
-		static_cast<oss_t&>( log_ ) << body_;
+	constexpr bool is_char = std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>;
+	constexpr bool is_int = std::is_integral_v<T> && !is_char && !std::is_same_v<T, bool>
+							&& !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char8_t>
+							&& !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+	if constexpr( std::is_same_v<T, str_t> || std::is_same_v<T, std::string_view> )
+		log_.plain() ? ( void )log_.str().append( body_ ) : ( void )( log_.os() << body_ );
+	else if constexpr( is_char )
+		log_.plain() ? log_.str().push_back( static_cast<char>( body_ ) )
+					 : ( void )( log_.os() << body_ );
+	else if constexpr( std::is_same_v<T, bool> )
+		log_.plain() ? log_.str().push_back( body_ ? '1' : '0' ) : ( void )( log_.os() << body_ );
+	else if constexpr( is_int || std::is_floating_point_v<T> ) {
+		if( !log_.plain() ) {
+			log_.os() << body_;
+			return log_;
+		}
+		char buf[64];
+		std::to_chars_result r;
+		if constexpr( is_int )
+			r = std::to_chars( buf, buf + sizeof( buf ), body_ );
+		else
+			r = std::to_chars( buf, buf + sizeof( buf ), body_, std::chars_format::general, 6 );
+		log_.str().append( buf, r.ptr );
+	} else
+		log_.os() << body_;
 
 	return log_;
 };
 
 template <AnyPtr T>
-inline leon_log::Log_t& operator<<( leon_log::Log_t& log_, T body_ ) {
+inline Log_t& operator<<( Log_t& log_, T body_ ) {
 
-	if( log_._level < leon_log::g_log_level )
+	if( !log_._on )
 		return log_;
 
 	if( body_ == nullptr )
-		static_cast<oss_t&>( log_ ) << "{nullptr}";
+		log_.str().append( "{nullptr}" );
 	else
-		static_cast<oss_t&>( log_ ) << *body_;
+		log_ << *body_;
 
 	return log_;
 };
 
+// 临时对象(如 "Log_t(LogLevel_e::Debug) << ...")转交给上面的左值版本
+template <typename T>
+inline Log_t& operator<<( Log_t&& log_, T&& body_ ) {
+	return log_ << std::forward<T>( body_ );
+};
+
+inline Log_t& operator<<( Log_t&& log_, ost_t& ( *manip_ )( ost_t& ) ) {
+	return log_ << manip_;
+};
+
+inline Log_t& operator<<( Log_t&& log_, std::ios_base& ( *manip_ )( std::ios_base& ) ) {
+	return log_ << manip_;
+};
+
+//-------------------------------------
+
+};	// namespace leon_log ======================================================
+
 #ifdef DEBUG
 
-#define lg_debg g_log_level <= LogLevel_e::Debug && Log_t(LogLevel_e::Debug) << __func__ << "(),"
-#define lg_info g_log_level <= LogLevel_e::Infor && Log_t(LogLevel_e::Infor) << __func__ << "(),"
-#define lg_note g_log_level <= LogLevel_e::Notif && Log_t(LogLevel_e::Notif) << __func__ << "(),"
-#define lg_warn g_log_level <= LogLevel_e::Warnn && Log_t(LogLevel_e::Warnn) << __func__ << "(),"
-#define lg_erro g_log_level <= LogLevel_e::Error && Log_t(LogLevel_e::Error) << __func__ << "(),"
-#define lg_fatl g_log_level <= LogLevel_e::Fatal && Log_t(LogLevel_e::Fatal) << __func__ << "(),"
+#define lg_debg g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Debug && Log_t(LogLevel_e::Debug).at( __func__ )
+#define lg_info g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Infor && Log_t(LogLevel_e::Infor).at( __func__ )
+#define lg_note g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Notif && Log_t(LogLevel_e::Notif).at( __func__ )
+#define lg_warn g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Warnn && Log_t(LogLevel_e::Warnn).at( __func__ )
+#define lg_erro g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Error && Log_t(LogLevel_e::Error).at( __func__ )
+#define lg_fatl g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Fatal && Log_t(LogLevel_e::Fatal).at( __func__ )
+
+// 按类别的流式日志, 如: lgc_debg( s_net_cat ) << "收到:" << n;
+#define lgc_debg( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Debug && Log_t( ( cat ), LogLevel_e::Debug ).at( __func__ )
+#define lgc_info( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Infor && Log_t( ( cat ), LogLevel_e::Infor ).at( __func__ )
+#define lgc_note( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Notif && Log_t( ( cat ), LogLevel_e::Notif ).at( __func__ )
+#define lgc_warn( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Warnn && Log_t( ( cat ), LogLevel_e::Warnn ).at( __func__ )
+#define lgc_erro( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Error && Log_t( ( cat ), LogLevel_e::Error ).at( __func__ )
+#define lgc_fatl( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Fatal && Log_t( ( cat ), LogLevel_e::Fatal ).at( __func__ )
 
 #else
 
-#define lg_debg g_log_level <= LogLevel_e::Debug && Log_t(LogLevel_e::Debug)
-#define lg_info g_log_level <= LogLevel_e::Infor && Log_t(LogLevel_e::Infor)
-#define lg_note g_log_level <= LogLevel_e::Notif && Log_t(LogLevel_e::Notif)
-#define lg_warn g_log_level <= LogLevel_e::Warnn && Log_t(LogLevel_e::Warnn)
-#define lg_erro g_log_level <= LogLevel_e::Error && Log_t(LogLevel_e::Error)
-#define lg_fatl g_log_level <= LogLevel_e::Fatal && Log_t(LogLevel_e::Fatal)
+#define lg_debg g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Debug && Log_t(LogLevel_e::Debug)
+#define lg_info g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Infor && Log_t(LogLevel_e::Infor)
+#define lg_note g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Notif && Log_t(LogLevel_e::Notif)
+#define lg_warn g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Warnn && Log_t(LogLevel_e::Warnn)
+#define lg_erro g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Error && Log_t(LogLevel_e::Error)
+#define lg_fatl g_log_level.load( std::memory_order_relaxed ) <= LogLevel_e::Fatal && Log_t(LogLevel_e::Fatal)
+
+// 按类别的流式日志, 如: lgc_debg( s_net_cat ) << "收到:" << n;
+#define lgc_debg( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Debug && Log_t( ( cat ), LogLevel_e::Debug )
+#define lgc_info( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Infor && Log_t( ( cat ), LogLevel_e::Infor )
+#define lgc_note( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Notif && Log_t( ( cat ), LogLevel_e::Notif )
+#define lgc_warn( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Warnn && Log_t( ( cat ), LogLevel_e::Warnn )
+#define lgc_erro( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Error && Log_t( ( cat ), LogLevel_e::Error )
+#define lgc_fatl( cat ) ( cat ).gate.load( std::memory_order_relaxed ) <= LogLevel_e::Fatal && Log_t( ( cat ), LogLevel_e::Fatal )
 
 #endif
 
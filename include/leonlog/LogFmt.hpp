@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <leonlog/LeonLog.hpp>
+#include <type_traits>
+
+/* 延迟格式化的日志接口:
+	LOGF( LogLevel_e::Notif, "px={} qty={}", px, qty );
+   生产线程只把参数的原始字节及一个指向静态格式描述符的指针放入日志队列,
+   真正的格式化由日志线程在写盘时完成. 占位符语法是 std::format 的一个小子集:
+	{}		按类型的默认方式输出
+	{:x}	整数以16进制输出
+	{:.N}	浮点数保留N位小数
+	{{ }}	输出花括号本身
+   参数只能是算术类型、枚举或非字符指针(指针只输出地址), 字符串请用 lg_* 流式接口. */
+
+namespace leon_log {
+
+// 单条日志打包参数的最大字节数
+constexpr size_t LOG_ARGS_SIZE = 64;
+
+// 静态格式描述符, 每个 LOGF 调用点一个, 生存期贯穿整个进程
+struct LogFmt_t {
+	char_cp	fmt;	// 格式串
+	char_cp	types;	// 参数类型码, 每个参数一个字符(见 TypeCodeOf)
+	char_cp	file;	// 调用点所在源文件
+	int		line;	// 调用点所在行
+};
+
+// 参数类型码
+template <typename A>
+constexpr char TypeCodeOf() {
+	using T = std::remove_cv_t<A>;
+	if constexpr( std::is_enum_v<T> )
+		return TypeCodeOf<std::underlying_type_t<T>>();
+	else if constexpr( std::is_same_v<T, bool> )
+		return 'b';
+	else if constexpr( std::is_same_v<T, char> )
+		return 'c';
+	else if constexpr( std::is_integral_v<T> ) {
+		constexpr bool s = std::is_signed_v<T>;
+		if constexpr( sizeof( T ) == 1 ) return s ? 'a' : 'A';
+		else if constexpr( sizeof( T ) == 2 ) return s ? 's' : 'S';
+		else if constexpr( sizeof( T ) == 4 ) return s ? 'i' : 'I';
+		else {
+			static_assert( sizeof( T ) == 8, "LOGF 不支持此种整数" );
+			return s ? 'l' : 'L';
+		}
+	} else if constexpr( std::is_same_v<T, float> )
+		return 'f';
+	else if constexpr( std::is_same_v<T, double> )
+		return 'd';
+	else if constexpr( std::is_pointer_v<T> ) {
+		static_assert( !std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char>,
+					   "LOGF 不能捕获字符串指针(写盘时可能已悬空), 请用 lg_* 流式接口" );
+		return 'p';
+	} else {
+		// long double 等没有类型码, 打包了也无法还原
+		static_assert( sizeof( T ) == 0, "LOGF 只支持 bool、char、整数、float、double、枚举及指针参数" );
+		return '?';
+	}
+};
+
+// 类型码的字节数
+constexpr size_t SizeOfTypeCode( char code_ ) {
+	switch( code_ ) {
+	case 'b': case 'c': case 'a': case 'A': return 1;
+	case 's': case 'S': return 2;
+	case 'i': case 'I': case 'f': return 4;
+	case 'l': case 'L': case 'd': return 8;
+	case 'p': return sizeof( void* );
+	default: return 0;
+	}
+};
+
+template <typename... A>
+struct ArgTypes_t {
+	static constexpr char codes[] = { TypeCodeOf<A>()..., '\0' };
+};
+
+// 只有声明, 仅供 decltype 推导参数类型之用
+template <typename... A>
+ArgTypes_t<std::decay_t<A>...> ArgTypesOf( const A& ... );
+
+// 添加一条延迟格式化日志(参数已打包), 实现在库内
+bool AppendLogArgs( LogLevel_e, const LogFmt_t*, const void* args, size_t size );
+
+// 打包参数后入队
+template <typename... A>
+inline bool AppendLogF( LogLevel_e level_, const LogFmt_t* fmt_, const A& ... args_ ) {
+	constexpr size_t size = ( size_t( 0 ) + ... + sizeof( A ) );
+	static_assert( size <= LOG_ARGS_SIZE, "LOGF 参数总长超限" );
+	static_assert( ( std::is_trivially_copyable_v<A> && ... ) );
+
+	std::byte packed[size > 0 ? size : 1];
+	[[maybe_unused]] std::byte* p = packed;
+	( ( std::memcpy( p, &args_, sizeof( A ) ), p += sizeof( A ) ), ... );
+	return AppendLogArgs( level_, fmt_, packed, size );
+};
+
+// 按格式串及类型码把打包的参数格式化至 out, 最多写 cap 字节, 返回实际写入字节数.
+// 只用栈上内存, 不分配堆, 日志线程及离线工具共用
+size_t FormatLogArgs( char* out, size_t cap,
+					  char_cp fmt, char_cp types, const std::byte* args );
+
+// 把字符串按 JSON 字符串的规则转义(不含两边的引号)写至 out, 最多写 cap 字节(不会截断半个转义序列),
+// 返回实际写入字节数. 纯计算, 可在信号处理函数内使用
+size_t EscapeJson( char* out, size_t cap, std::string_view );
+// 同上, 追加至 out
+void AppendJson( str_t& out, std::string_view );
+
+// 把打包的结构化字段(见 Log_t::kv)逐个追加至 out: 文本格式为" 键=值"(含空白、引号等的键及字符串值加引号转义),
+// JSON 格式为 ,"键":值(非有限的浮点数为 null)
+void FormatLogKvs( str_t& out, std::string_view fields, bool json );
+
+// 把纳秒时戳格式化为日志文件所用的 "yy/mm/dd HH:MM:SS[.fff...]"(本地时间, prec 位小数).
+// out 至少要有 LOG_STAMP_MAX 字节, 返回实际写入字节数
+constexpr size_t LOG_STAMP_MAX = 40;
+size_t FormatLogStamp( char* out, int64_t ns, size_t prec );
+// 同上, 但不查时区: 由调用者给出本地时间与UTC之差(秒). 纯计算, 不加锁不分配, 可在信号处理函数内使用
+size_t FormatLogStampAt( char* out, int64_t ns, size_t prec, int64_t utc_off );
+// JSON 日志所用的 RFC 3339 时戳 "yyyy-mm-ddTHH:MM:SS[.fff...]+hh:mm"(本地时间, 带UTC偏移), 其余同上
+size_t FormatRfc3339Stamp( char* out, int64_t ns, size_t prec );
+size_t FormatRfc3339StampAt( char* out, int64_t ns, size_t prec, int64_t utc_off );
+
+};	// namespace leon_log ======================================================
+
+#define LOGF( log_level, log_fmt, ... ) \
+	( leon_log::g_log_level.load( std::memory_order_relaxed ) <= ( log_level ) && leon_log::LevelOn( ( log_level ) ) && [&]() { \
+		static constexpr leon_log::LogFmt_t lgf_desc { log_fmt, \
+			decltype( leon_log::ArgTypesOf( __VA_ARGS__ ) )::codes, __FILE__, __LINE__ }; \
+		return leon_log::AppendLogF( ( log_level ), &lgf_desc __VA_OPT__(,) __VA_ARGS__ ); \
+	}() )
+
+// 按类别的延迟格式化日志
+#define LOGCF( log_cat, log_level, log_fmt, ... ) \
+	( ( log_cat ).on( log_level ) && [&]() { \
+		static constexpr leon_log::LogFmt_t lgf_desc { log_fmt, \
+			decltype( leon_log::ArgTypesOf( __VA_ARGS__ ) )::codes, __FILE__, __LINE__ }; \
+		return leon_log::AppendLogF( ( log_level ), &lgf_desc __VA_OPT__(,) __VA_ARGS__ ); \
+	}() )
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
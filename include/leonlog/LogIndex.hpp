@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+
+/* 日志文件的时间索引(本机字节序), 由 SetTimeIndex 启用, 供 leonlog-query 按时间范围查日志.
+   日志线程在每个文本日志文件旁维护一个同名加".idx"的文件, 以 LogIdxHead_t 开头, 其后是一串 LogIdxRec_t,
+   每条描述日志文件里的一段(若干整行): 起止位置, 及其中各行时戳的最小、最大值. 各轮写出之间时戳仍可能
+   略有交错, 所以记最小、最大值而不是某一行的: 查一个时间范围, 只需读与之相交的段(及没被任何段覆盖的部分).
+   时戳是"本地时间"的纳秒数, 即把日志里的本地时戳当作UTC换算, 与查询者所在的时区无关.
+   索引随日志文件轮转改名; 压缩成".gz"(BGZF, 分块可随机访问)后保留原名, 其中的位置仍指原文 */
+
+namespace leon_log {
+
+constexpr char		LOG_IDX_MAGIC[8] = { 'L', 'E', 'O', 'N', 'L', 'I', 'D', 'X' };
+constexpr uint32_t	LOG_IDX_VERSION = 1;
+
+struct LogIdxHead_t {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	rec_size;	// sizeof( LogIdxRec_t )
+};
+
+struct LogIdxRec_t {
+	uint64_t	begin;		// 本段在日志文件中的起止位置 [begin, end)
+	uint64_t	end;
+	int64_t		min_ns;		// 本段各行时戳(本地时间)的最小、最大值
+	int64_t		max_ns;
+};
+
+static_assert( sizeof( LogIdxHead_t ) == 16 && sizeof( LogIdxRec_t ) == 32 );
+
+};	// namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ctime>		// clock_gettime
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <string>
+
+/* 调用点限流的日志接口, 免得某处日志在异常时刷屏, 挤占日志队列:
+	LOG_EVERY_N( LogLevel_e::Warnn, 1000 ) << "行情异常:" << code;	// 每1000次输出一次
+	LOG_N_PER_SEC( LogLevel_e::Warnn, 10 ) << "重连失败";			// 每秒最多10条
+	LOG_FIRST_N( LogLevel_e::Notif, 3 ) << "收到未知消息";			// 只输出前3条
+	LOGF_EVERY_N( LogLevel_e::Warnn, 1000, "坏价格={}", px );			// 以及相应的延迟格式化版本
+   每个调用点有一个静态的计数器(多线程共用, 原子操作). 被略过的调用只花一次计数(按秒限流的还要读一次粗粒度时钟,
+   及读一次令牌桶),
+   不构造日志内容, 更不会进入 AppendLog. 放行的那条日志末尾会注明此前略过了多少条 */
+
+namespace leon_log {
+
+// 本线程刚刚放行的限流日志, 在该调用点此前被略过的条数
+inline thread_local uint64_t tl_log_skipped = 0;
+
+// 每 N 次放行一次(第1、N+1、2N+1...次)
+class EveryN_t {
+public:
+	bool pass( uint64_t n_ ) {
+		uint64_t seq = _count.fetch_add( 1, std::memory_order_relaxed );
+		if( n_ > 1 && seq % n_ != 0 )
+			return false;
+		tl_log_skipped = ( seq == 0 || n_ <= 1 ) ? 0 : n_ - 1;
+		return true;
+	};
+
+private:
+	std::atomic<uint64_t>	_count { 0 };
+};
+
+// 每秒最多放行 N 次: 令牌桶, 容量 N, 每 1/N 秒补一个. 以"理论到达时刻"(GCRA)表示, 一个原子量即可:
+// 桶满时它不晚于当前时刻, 每放行一次推后 1/N 秒, 推后超过(1秒 - 1/N)即是桶已空.
+// 它只会往后推, 拿着旧时刻的线程也不会把它拨回去. 被略过的另行计数, 由下一条放行的取走
+class PerSecond_t {
+public:
+	bool pass( uint64_t n_ ) {
+		if( n_ == 0 )
+			return false;
+		timespec ts;
+		clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+		int64_t now = static_cast<int64_t>( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+		int64_t gap = 1000000000 / static_cast<int64_t>( n_ );
+
+		int64_t tat = _tat.load( std::memory_order_relaxed );
+		while( true ) {
+			int64_t from = tat > now ? tat : now;
+			if( from - now > 1000000000 - gap ) {
+				_skipped.fetch_add( 1, std::memory_order_relaxed );
+				return false;
+			}
+			if( _tat.compare_exchange_weak( tat, from + gap, std::memory_order_relaxed ) )
+				break;
+		}
+		tl_log_skipped = _skipped.load( std::memory_order_relaxed ) == 0
+						 ? 0 : _skipped.exchange( 0, std::memory_order_relaxed );
+		return true;
+	};
+
+private:
+	std::atomic<int64_t>	_tat { 0 };		// 下一次放行的理论时刻(纳秒, 单调时钟)
+	std::atomic<uint64_t>	_skipped { 0 };	// 上次放行以来略过的次数
+};
+
+// 只放行前 N 次, 此后只读不写, 连计数都省了
+class FirstN_t {
+public:
+	bool pass( uint64_t n_ ) {
+		if( _count.load( std::memory_order_relaxed ) >= n_ )
+			return false;
+		if( _count.fetch_add( 1, std::memory_order_relaxed ) >= n_ )
+			return false;
+		tl_log_skipped = 0;
+		return true;
+	};
+
+private:
+	std::atomic<uint64_t>	_count { 0 };
+};
+
+// 限流放行的流式日志, 输出时注明此前略过的条数. 级别已由宏判断过
+class LimitedLog_t : public Log_t {
+public:
+	explicit LimitedLog_t( LogLevel_e l ) : Log_t( l, true ), _skipped( tl_log_skipped ) {};
+
+	~LimitedLog_t() override {
+		if( _skipped > 0 )
+			str().append( " (此前略过" ).append( std::to_string( _skipped ) ).append( "条)" );
+	};
+
+private:
+	const uint64_t	_skipped;
+};
+
+};	// namespace leon_log ======================================================
+
+// 调用点专属的静态限流器
+#define LOG_LIMIT_SITE( limit_type ) \
+	[]() -> limit_type& { static limit_type lgl_site; return lgl_site; }()
+
+// 调试版同 lg_* 宏, 正文以"函数名(),"开头
+#ifdef DEBUG
+#define LOG_LIMITED( limit_type, log_level, n ) \
+	leon_log::g_log_level.load( std::memory_order_relaxed ) <= ( log_level ) && leon_log::LevelOn( ( log_level ) ) \
+	&& LOG_LIMIT_SITE( limit_type ).pass( n ) && leon_log::LimitedLog_t( log_level ).at( __func__ )
+#else
+#define LOG_LIMITED( limit_type, log_level, n ) \
+	leon_log::g_log_level.load( std::memory_order_relaxed ) <= ( log_level ) && leon_log::LevelOn( ( log_level ) ) \
+	&& LOG_LIMIT_SITE( limit_type ).pass( n ) && leon_log::LimitedLog_t( log_level )
+#endif
+
+#define LOG_EVERY_N( log_level, n )		LOG_LIMITED( leon_log::EveryN_t, log_level, n )
+#define LOG_N_PER_SEC( log_level, n )	LOG_LIMITED( leon_log::PerSecond_t, log_level, n )
+#define LOG_FIRST_N( log_level, n )		LOG_LIMITED( leon_log::FirstN_t, log_level, n )
+
+// 延迟格式化版本: 有略过的, 就换用末尾多一个参数(略过条数)的格式描述符
+#define LOGF_LIMITED( limit_type, log_level, n, log_fmt, ... ) \
+	( leon_log::g_log_level.load( std::memory_order_relaxed ) <= ( log_level ) && leon_log::LevelOn( ( log_level ) ) \
+	  && LOG_LIMIT_SITE( limit_type ).pass( n ) && [&]() { \
+		static constexpr leon_log::LogFmt_t lgf_desc { log_fmt, \
+			decltype( leon_log::ArgTypesOf( __VA_ARGS__ ) )::codes, __FILE__, __LINE__ }; \
+		static constexpr leon_log::LogFmt_t lgf_skip { log_fmt " (此前略过{}条)", \
+			decltype( leon_log::ArgTypesOf( __VA_ARGS__ __VA_OPT__(,) uint64_t() ) )::codes, __FILE__, __LINE__ }; \
+		uint64_t lgl_skipped = leon_log::tl_log_skipped; \
+		return lgl_skipped == 0 \
+			? leon_log::AppendLogF( ( log_level ), &lgf_desc __VA_OPT__(,) __VA_ARGS__ ) \
+			: leon_log::AppendLogF( ( log_level ), &lgf_skip, __VA_ARGS__ __VA_OPT__(,) lgl_skipped ); \
+	}() )
+
+#define LOGF_EVERY_N( log_level, n, log_fmt, ... ) \
+	LOGF_LIMITED( leon_log::EveryN_t, log_level, n, log_fmt __VA_OPT__(,) __VA_ARGS__ )
+#define LOGF_N_PER_SEC( log_level, n, log_fmt, ... ) \
+	LOGF_LIMITED( leon_log::PerSecond_t, log_level, n, log_fmt __VA_OPT__(,) __VA_ARGS__ )
+#define LOGF_FIRST_N( log_level, n, log_fmt, ... ) \
+	LOGF_LIMITED( leon_log::FirstN_t, log_level, n, log_fmt __VA_OPT__(,) __VA_ARGS__ )
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <leonlog/LeonLog.hpp>
+
+/* 日志系统的自我度量: 离丢日志还有多远, 日志线程跟不跟得上.
+   生产者一侧的计数都记在各线程自己的队列旁, 只由本线程写, 不加锁也不做原子加, 没有争抢;
+   日志线程一侧的, 按写盘间隔(见 SetFlushIntrvl)统计, 每个间隔结束时发布一次.
+   除标明"最近一个写盘间隔"的以外, 都是本次 StartLog 以来的累计. 用法:
+	LogStats_t st = SnapLogStats();
+	if( st.que_high * 10 > st.que_capa * 8 ) ...
+   或者交给状态文件定期输出:
+	SetStatus( "/tmp/app.status", WriteLogStats, 5 ); */
+
+namespace leon_log {
+
+struct LogStats_t {
+	// 入队耗时直方图的格数: 第 i 格为 [2^i, 2^(i+1)) 纳秒, 末格含更长的
+	static constexpr size_t LATENCY_BUCKETS = 32;
+	// 每个线程每入队这么多条, 量一次入队耗时
+	static constexpr uint32_t LATENCY_SAMPLE = 64;
+
+	LogStamp_t	when;								// 取快照的时刻
+
+	//-------- 生产者一侧(各线程之和, 含已退出的线程) --------
+	uint64_t	enqueued[LogLevel_e::VALUES_COUNT];	// 入队(含溢出至文件)的条数
+	uint64_t	retries[LogLevel_e::VALUES_COUNT];	// 队满后重试入队的次数
+	uint64_t	spilled[LogLevel_e::VALUES_COUNT];	// 溢出至文件的条数
+	uint64_t	dropped[LogLevel_e::VALUES_COUNT];	// 丢弃的条数(同 DroppedLogs)
+	uint64_t	enque_ns[LATENCY_BUCKETS];			// 入队耗时(抽样)直方图, 含队满时的等待
+
+	//-------- 日志队列 --------
+	size_t		queued;			// 此刻各队列内的日志总数
+	size_t		que_capa;		// 单个队列的容量
+	size_t		que_high;		// 最近一个写盘间隔内, 单个队列的最高水位
+
+	//-------- 日志线程一侧 --------
+	int64_t		lag_max_ns;		// 最近一个写盘间隔内, 写出时刻比日志时戳晚了多少: 最大值
+	int64_t		lag_avg_ns;		// 同上, 平均值
+	double		lines_per_sec;	// 最近一个写盘间隔内, 每秒写出的条数
+	double		bytes_per_sec;	// 同上, 每秒写出的字节数(写进日志文件的)
+	uint64_t	lines_total;	// 累计写出的条数
+	uint64_t	bytes_total;	// 累计写出的字节数
+	uint64_t	syncs_total;	// 累计 fdatasync 日志文件的次数(见 SetDurability)
+
+	// 入队耗时的 p 分位数(0~1), 按直方图格子的上界估计, 单位纳秒. 没有样本时为0
+	uint64_t enque_percentile( double p ) const;
+};
+
+// 取一份当前的度量快照(任何线程都可调用, 不打扰生产者及日志线程)
+LogStats_t SnapLogStats();
+
+// 把一份快照写成"键=值"的文本, 每项一行
+void PrintLogStats( std::ostream&, const LogStats_t& );
+// 取快照并输出, 可直接作为 SetStatus 的回调
+void WriteLogStats( std::ostream& );
+
+};	// namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
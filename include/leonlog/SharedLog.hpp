@@ -0,0 +1,37 @@
+#pragma once
+#include <leonlog/LeonLog.hpp>
+
+/* 多进程共享内存日志: 同一台机器上协作的多个进程, 各自不起日志线程、不开日志文件, 日志都写进一个命名的
+   共享内存环(/dev/shm/leonlog-环名), 由唯一的收集者按各条认领槽位的先后, 写进同一个文件.
+   收集者可以是某个进程里的日志线程(SetLogCollector 之后 StartLog, 本进程的日志也写进同一个文件),
+   也可以是 leonlog-collectd 工具. 生产者进程死在写日志的半路, 也不会破坏环或卡住别人:
+   收集者等一会儿就跳过它认领了却没写完的槽位. 用法:
+		// 各生产者进程
+		StartSharedLog( "trade", LogLevel_e::Infor, "gateway" );
+		lg_info << "...";
+		StopLog();
+		// 收集者进程
+		SetLogCollector( "trade" );
+		StartLog( "/var/log/trade.log", LogLevel_e::Infor );
+   每条日志占环里一个定长槽位, 内容超过 RING_BODY_MAX 字节的截断; 延迟格式化的日志(LOGF)在生产者里格式化.
+   环在所有进程都退出后仍然留着(下次接着用), 不要了就删掉 /dev/shm 下的那个文件 */
+
+namespace leon_log {
+
+// 新建的环缺省有多少个槽位
+constexpr size_t DEFAULT_RING_SLOTS = 8192;
+// 一条日志在环里最多占多少字节(含结构化字段)
+constexpr size_t RING_BODY_MAX = 960;
+
+// 生产者: 代替 StartLog, 此后本进程的日志都写进名为 ring 的共享内存环(没有就按 slots 个槽位创建).
+// label 标明本进程, 收集者输出的线程名为"label/线程名", 空串取程序名. 用 StopLog 停止.
+// 环满(收集者跟不上或不在)时, 按各级别的 SetOverflowPolicy 等待或丢弃(Spill 视同 Block)
+void StartSharedLog( str_cr ring, LogLevel_e levl, str_cr label = "", size_t slots = DEFAULT_RING_SLOTS );
+
+// 收集者(须在 StartLog 之前调用): 日志线程除了写本进程的日志, 也收集 ring 里各生产者的日志写进同一个文件.
+// 一个环只能有一个活着的收集者, 否则 StartLog 抛 bad_usage. 空串为不收集
+void SetLogCollector( str_cr ring, size_t slots = DEFAULT_RING_SLOTS );
+
+};	// namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,258 @@
+#include <algorithm>	// min
+#include <cstring>		// strlen
+#include <fstream>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "LogEntry.hpp"
+#include "LogOutput.hpp"
+#include "leonlog/BinLog.hpp"
+#include "leonlog/LeonLogVer.hpp"
+#include "leonlog/LogFmt.hpp"
+
+using namespace std::chrono;
+
+namespace leon_log {
+
+//###### 各种变量 ###############################################################
+
+// 当前文件内的字典: 已写过名字的线程编号, 格式描述符 -> (编号, 参数字节数)
+struct BinFmtInfo_t {
+	uint32_t	id;
+	uint32_t	args_size;
+};
+std::vector<bool>									s_bin_threads;
+std::unordered_map<const LogFmt_t*, BinFmtInfo_t>	s_bin_fmts;
+
+//###### 各种函数实现 ############################################################
+
+static void WriteRec( LogOutput_t& out_, uint8_t kind_, uint8_t level_, uint16_t thread_,
+					  int64_t stamp_, const void* data_, size_t size_ ) {
+	BinRecHead_t head { kind_, level_, thread_, static_cast<uint32_t>( size_ ), stamp_ };
+	out_.append( &head, sizeof( head ) );
+	out_.append( data_, size_ );
+};
+
+// 文件是空的, 或原有内容不是二进制日志(比如先前写的是文本), 都要先写文件头, 解码时由此找到起点
+static bool NeedFileHead( const LogOutput_t& out_, str_cr file_ ) {
+	if( out_.opened_size() == 0 )
+		return true;
+	char magic[sizeof( BIN_LOG_MAGIC )] {};
+	std::ifstream( file_, std::ios_base::binary ).read( magic, sizeof( magic ) );
+	return std::memcmp( magic, BIN_LOG_MAGIC, sizeof( magic ) ) != 0;
+};
+
+void StartBinLog( LogOutput_t& out_, str_cr file_, size_t stamp_prec_ ) {
+	s_bin_threads.assign( MAX_THREAD_NAMES, false );
+	s_bin_fmts.clear();
+
+	if( NeedFileHead( out_, file_ ) ) {
+		BinFileHead_t head {};
+		std::memcpy( head.magic, BIN_LOG_MAGIC, sizeof( head.magic ) );
+		head.version = BIN_LOG_VERSION;
+		out_.append( &head, sizeof( head ) );
+	}
+
+	WriteRec( out_, 'H', static_cast<uint8_t>( stamp_prec_ ), 0, 0,
+			  PROJECT_VERSION, strlen( PROJECT_VERSION ) );
+	for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l ) {
+		char_cp name = NameOf( static_cast<LogLevel_e>( l ) );
+		WriteRec( out_, 'L', static_cast<uint8_t>( l ), 0, 0, name, strlen( name ) );
+	}
+};
+
+void Write1Bin( LogOutput_t& out_, const LogEntry_t& log_ ) {
+	// 线程名首次出现时先写字典
+	if( !s_bin_threads[log_.tid] ) {
+		s_bin_threads[log_.tid] = true;
+		str_cr name = ThreadNameOf( log_.tid );
+		WriteRec( out_, 'T', 0, log_.tid, 0, name.data(), name.size() );
+	}
+
+	int64_t stamp = duration_cast<nanoseconds>( log_.stamp.time_since_epoch() ).count();
+	if( log_.lfmt == nullptr && log_.kvs > 0 ) {
+		// 带结构化字段的, 按文本格式(" 键=值")写成普通的字符串日志
+		str_t text( log_.text() );
+		FormatLogKvs( text, log_.fields(), false );
+		WriteRec( out_, 'S', log_.level, log_.tid, stamp, text.data(), text.size() );
+		return;
+	}
+	if( log_.lfmt == nullptr ) {
+		WriteRec( out_, 'S', log_.level, log_.tid, stamp,
+				  log_.body.data(), log_.body.size() );
+		return;
+	}
+
+	// 格式串首次出现时先写字典
+	auto [f_it, f_new] = s_bin_fmts.try_emplace( log_.lfmt,
+						 BinFmtInfo_t { static_cast<uint32_t>( s_bin_fmts.size() ), 0 } );
+	BinFmtInfo_t& info = f_it->second;
+	if( f_new ) {
+		for( char_cp t = log_.lfmt->types; *t != '\0'; ++t )
+			info.args_size += SizeOfTypeCode( *t );
+
+		str_t payload( reinterpret_cast<const char*>( &info.id ), sizeof( info.id ) );
+		payload.append( log_.lfmt->types ).push_back( '\0' );
+		payload.append( log_.lfmt->fmt );
+		WriteRec( out_, 'F', 0, 0, 0, payload.data(), payload.size() );
+	}
+
+	char payload[sizeof( uint32_t ) + LOG_ARGS_SIZE];
+	std::memcpy( payload, &info.id, sizeof( info.id ) );
+	std::memcpy( payload + sizeof( info.id ), log_.body.data(), info.args_size );
+	WriteRec( out_, 'A', log_.level, log_.tid, stamp,
+			  payload, sizeof( info.id ) + info.args_size );
+};
+
+//###### 解码 ####################################################################
+
+namespace {
+
+// 解码时的格式串字典项
+struct BinFmtDef_t {
+	str_t		types;
+	str_t		fmt;
+	size_t		args_size;
+};
+
+// 从 in_ 的当前位置往后找文件头, 找到则停在文件头处并返回跳过的字节数, 找不到返回 -1
+int64_t SeekFileHead( std::istream& in_ ) {
+	constexpr size_t MAGIC_LEN = sizeof( BIN_LOG_MAGIC );
+	const std::string_view magic( BIN_LOG_MAGIC, MAGIC_LEN );
+	const std::streamoff start = in_.tellg();
+
+	str_t buf;
+	int64_t base = 0;	// buf[0] 距 start 的字节数
+	char chunk[4096];
+	while( in_.read( chunk, sizeof( chunk ) ) || in_.gcount() > 0 ) {
+		buf.append( chunk, in_.gcount() );
+		if( auto pos = buf.find( magic ); pos != str_t::npos ) {
+			in_.clear();
+			in_.seekg( start + base + static_cast<std::streamoff>( pos ) );
+			return base + pos;
+		}
+		// 魔数可能跨块, 留下末尾不足一个魔数长的部分
+		size_t keep = std::min( buf.size(), MAGIC_LEN - 1 );
+		base += buf.size() - keep;
+		buf.erase( 0, buf.size() - keep );
+	}
+	return -1;
+};
+
+}; // namespace
+
+bool DecodeBinLog( std::istream& in_, std::ostream& out_, std::ostream& err_ ) {
+	in_.seekg( 0, std::ios_base::end );
+	const std::streamoff file_end = in_.tellg();
+	in_.seekg( 0 );
+
+	int64_t skipped = SeekFileHead( in_ );
+	if( skipped < 0 ) {
+		err_ << "不是 leonlog 二进制日志(找不到文件头)!\n";
+		return false;
+	}
+	if( skipped > 0 )
+		err_ << "跳过了开头 " << skipped << " 字节的非二进制内容\n";
+
+	// 字典, 随每个会话重建
+	std::map<uint8_t, str_t>		levels;
+	std::map<uint16_t, str_t>		threads;
+	std::map<uint32_t, BinFmtDef_t>	fmts;
+	size_t							stamp_prec = 6;
+
+	BinRecHead_t	head;
+	str_t			payload;
+	str_t			body( 65536, '\0' );
+	char			stamp[LOG_STAMP_MAX];
+	uint64_t		count = 0;
+	while( in_.read( reinterpret_cast<char*>( &head ), sizeof( head ) ) ) {
+		// 文件头: 开头的那个, 或追加到非二进制内容之后写的
+		if( std::memcmp( &head, BIN_LOG_MAGIC, sizeof( BIN_LOG_MAGIC ) ) == 0 ) {
+			BinFileHead_t fhead;
+			std::memcpy( &fhead, &head, sizeof( fhead ) );
+			if( fhead.version > BIN_LOG_VERSION ) {
+				err_ << "格式版本(" << fhead.version << ")太新, 无法解读!\n";
+				return false;
+			}
+			continue;
+		}
+
+		if( head.size > file_end - in_.tellg() ) {
+			err_ << "第" << count << "条日志之后文件被截断或已损坏\n";
+			break;
+		}
+		payload.resize( head.size );
+		in_.read( payload.data(), head.size );
+
+		// 非空则本条记录有误, 跳过
+		std::string_view bad;
+		uint32_t id = 0;
+		if( ( head.kind == 'F' || head.kind == 'A' ) && payload.size() >= sizeof( id ) )
+			std::memcpy( &id, payload.data(), sizeof( id ) );
+		switch( head.kind ) {
+		case 'H':
+			stamp_prec = head.level;
+			levels.clear();
+			threads.clear();
+			fmts.clear();
+			break;
+		case 'L':
+			levels[head.level] = payload;
+			break;
+		case 'T':
+			threads[head.thread] = payload;
+			break;
+		case 'F': {
+			size_t nul = payload.size() < sizeof( id ) ? str_t::npos : payload.find( '\0', sizeof( id ) );
+			if( nul == str_t::npos ) {
+				bad = "不完整的格式串记录";
+				break;
+			}
+			BinFmtDef_t def { payload.substr( sizeof( id ), nul - sizeof( id ) ), payload.substr( nul + 1 ), 0 };
+			for( char t : def.types ) {
+				if( SizeOfTypeCode( t ) == 0 )
+					bad = "含未知类型码的格式串记录";
+				def.args_size += SizeOfTypeCode( t );
+			}
+			if( bad.empty() )
+				fmts[id] = std::move( def );
+			break;
+		}
+		case 'S':
+		case 'A': {
+			std::string_view text( payload );
+			if( head.kind == 'A' ) {
+				auto it = fmts.find( id );
+				if( payload.size() < sizeof( id ) )
+					bad = "不完整的参数日志记录";
+				else if( it == fmts.end() )
+					bad = "引用未定义格式串的参数日志记录";
+				else if( payload.size() - sizeof( id ) < it->second.args_size )
+					bad = "参数不足的参数日志记录";
+				else
+					text = std::string_view( body.data(), FormatLogArgs( body.data(), body.size(),
+							it->second.fmt.c_str(), it->second.types.c_str(),
+							reinterpret_cast<const std::byte*>( payload.data() + sizeof( id ) ) ) );
+			}
+			if( !bad.empty() )
+				break;
+			out_.write( stamp, FormatLogStamp( stamp, head.stamp, stamp_prec ) );
+			out_ << ',' << levels[head.level] << ',' << threads[head.thread] << ',' << text << '\n';
+			++count;
+			break;
+		}
+		default:
+			bad = "未知类型的记录";
+		}
+		if( !bad.empty() )
+			err_ << "第" << count << "条日志之后遇到" << bad << "(类型码 " << int( head.kind ) << "), 已跳过\n";
+	}
+	return true;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
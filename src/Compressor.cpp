@@ -0,0 +1,245 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstring>		// memcpy
+#include <deque>
+#include <fstream>
+#include <leonutils/CpuAffinity.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <mutex>
+#include <new>			// placement new
+#include <pthread.h>
+#include <sys/syscall.h>	// SYS_ioprio_set
+#include <thread>
+#include <unistd.h>		// syscall
+#include <vector>
+#include <zlib.h>
+
+#include "Compressor.hpp"
+
+using namespace std::filesystem;
+
+namespace leon_log {
+
+//###### 各种常量 ###############################################################
+
+// BGZF: 每块最多压缩这么多字节的原文, 保证压缩后整块(含头尾)不超过 64KiB
+constexpr size_t BGZF_BLOCK_IN = 0xff00;
+constexpr size_t BGZF_HEAD_LEN = 18;
+constexpr size_t BGZF_TAIL_LEN = 8;
+// 固定的 gzip 头, 含 "BC" 扩展字段(后两字节为整块长度减1, 逐块填写)
+constexpr uint8_t BGZF_HEAD[BGZF_HEAD_LEN] = {
+	0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0
+};
+// 文件末尾的空块, 表示文件完整
+constexpr uint8_t BGZF_EOF[28] = {
+	0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0x1b, 0,
+	3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+// 压缩线程的IO优先级: 空闲级(ioprio_set, 见 linux/ioprio.h)
+constexpr int IOPRIO_CLASS_IDLE = 3;
+constexpr int IOPRIO_CLASS_SHIFT = 13;
+constexpr int IOPRIO_WHO_PROCESS = 1;
+
+//###### 各种变量 ###############################################################
+
+// 是否启用, 只在哪些cpu上运行, 压缩级别
+bool						s_zip_on { false };
+str_t						s_zip_cpus;
+int							s_zip_level = Z_DEFAULT_COMPRESSION;
+
+std::thread					s_zipper;
+std::deque<path>			s_zip_que;
+std::mutex					s_mtx4zip;
+std::condition_variable		s_cv4zip;
+std::atomic_bool			s_zip_stop { false };
+
+//###### 各种函数实现 ############################################################
+
+void SetCompressor( bool on_, str_cr run_on_cpus_, int level_ ) {
+	if( IsLogging() )
+		throw leon_utl::bad_usage( "日志系统已启动, 不能再更改压缩设置!" );
+	s_zip_on = on_;
+	s_zip_cpus = run_on_cpus_;
+	s_zip_level = level_;
+};
+
+bool CompressorOn() {
+	return s_zip_on;
+};
+
+// 压缩一块, 追加至 out_
+static bool DeflateBlock( z_stream& zs_, const char* in_, size_t size_, std::vector<uint8_t>& out_ ) {
+	size_t start = out_.size();
+	out_.resize( start + BGZF_HEAD_LEN + deflateBound( &zs_, size_ ) + BGZF_TAIL_LEN );
+	uint8_t* blk = out_.data() + start;
+	std::memcpy( blk, BGZF_HEAD, BGZF_HEAD_LEN );
+
+	deflateReset( &zs_ );
+	zs_.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( in_ ) );
+	zs_.avail_in = static_cast<uInt>( size_ );
+	zs_.next_out = blk + BGZF_HEAD_LEN;
+	zs_.avail_out = static_cast<uInt>( out_.size() - start - BGZF_HEAD_LEN - BGZF_TAIL_LEN );
+	if( deflate( &zs_, Z_FINISH ) != Z_STREAM_END )
+		return false;
+
+	size_t block_len = BGZF_HEAD_LEN + zs_.total_out + BGZF_TAIL_LEN;
+	uint32_t crc = crc32( 0, reinterpret_cast<const Bytef*>( in_ ), static_cast<uInt>( size_ ) );
+	uint32_t isize = static_cast<uint32_t>( size_ );
+	blk[16] = static_cast<uint8_t>( ( block_len - 1 ) & 0xff );
+	blk[17] = static_cast<uint8_t>( ( block_len - 1 ) >> 8 );
+	uint8_t* tail = blk + BGZF_HEAD_LEN + zs_.total_out;
+	for( int i = 0; i < 4; ++i ) {
+		tail[i] = static_cast<uint8_t>( crc >> ( i * 8 ) );
+		tail[4 + i] = static_cast<uint8_t>( isize >> ( i * 8 ) );
+	}
+	out_.resize( start + block_len );
+	return true;
+};
+
+bool CompressFile( const path& in_, const path& out_, int level_, const std::atomic_bool* abort_ ) {
+	std::ifstream in( in_, std::ios_base::in | std::ios_base::binary );
+	std::ofstream out( out_, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary );
+	if( !in || !out )
+		return false;
+
+	z_stream zs {};
+	if( deflateInit2( &zs, level_, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+		return false;
+
+	// 一次读入若干块, 压缩好了一起写出
+	constexpr size_t BLOCKS_PER_READ = 16;
+	std::vector<char>		in_buf( BGZF_BLOCK_IN * BLOCKS_PER_READ );
+	std::vector<uint8_t>	out_buf;
+	bool ok = true;
+	while( ok && in ) {
+		in.read( in_buf.data(), in_buf.size() );
+		size_t got = in.gcount();
+		if( in.bad() )
+			ok = false;
+
+		out_buf.clear();
+		for( size_t off = 0; ok && off < got; off += BGZF_BLOCK_IN )
+			ok = DeflateBlock( zs, in_buf.data() + off, std::min( BGZF_BLOCK_IN, got - off ), out_buf );
+		out.write( reinterpret_cast<const char*>( out_buf.data() ), out_buf.size() );
+		ok = ok && out.good() && !( abort_ != nullptr && abort_->load( std::memory_order_relaxed ) );
+	}
+	deflateEnd( &zs );
+
+	out.write( reinterpret_cast<const char*>( BGZF_EOF ), sizeof( BGZF_EOF ) );
+	out.close();
+	if( !ok || out.fail() ) {
+		std::error_code ec;
+		remove( out_, ec );
+		return false;
+	}
+	return true;
+};
+
+void CompressLater( const path& file_ ) {
+	if( !s_zip_on )
+		return;
+	{
+		std::lock_guard<std::mutex> lk( s_mtx4zip );
+		s_zip_que.push_back( file_ );
+	}
+	s_cv4zip.notify_one();
+};
+
+// 压缩线程体
+static void ZipperBody() {
+	RegistThread( "Compressor" );
+
+	// 比日志线程(nice 19)还要低: SCHED_IDLE 只在CPU无事可做时才运行, IO也降为空闲级
+	sched_param sp {};
+	pthread_setschedparam( pthread_self(), SCHED_IDLE, &sp );
+	syscall( SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT );
+	if( ! s_zip_cpus.empty() )
+		leon_utl::PthreadOnlyCPU( s_zip_cpus );
+
+	while( true ) {
+		path file;
+		{
+			std::unique_lock<std::mutex> lk( s_mtx4zip );
+			s_cv4zip.wait( lk, [] { return s_zip_stop.load() || !s_zip_que.empty(); } );
+			if( s_zip_stop.load() )
+				return;
+			file = s_zip_que.front();
+			s_zip_que.pop_front();
+		}
+
+		// 先压成临时文件, 成功了再改名、删原文件, 任何时候中断都不会丢日志
+		path part = file;
+		part += ".gz.part";
+		path gz = file;
+		gz += ".gz";
+		if( CompressFile( file, part, s_zip_level, &s_zip_stop ) ) {
+			// 沿用原文件的修改时间, 按时间清理旧日志时次序不乱
+			std::error_code ec;
+			last_write_time( part, last_write_time( file, ec ), ec );
+			rename( part, gz, ec );
+			if( !ec )
+				remove( file, ec );
+			if( ec )
+				lg_warn << "压缩日志文件(" << file.string() << ")后改名/删除失败:" << ec.message();
+		} else if( ! s_zip_stop.load() )
+			lg_warn << "压缩日志文件(" << file.string() << ")失败, 保留原文件";
+	}
+};
+
+void StartCompressor( str_cr log_file_ ) {
+	if( !s_zip_on )
+		return;
+
+	// 以前轮转出来而没来得及压缩的(形如"主名-中缀.扩展名"), 也一并压缩; 没压完的残片删掉
+	path	live( log_file_ );
+	str_t	prefix = live.stem().string() + '-';
+	str_t	ext = live.extension().string();
+	std::error_code ec;
+	path	dir = live.parent_path().empty() ? path( "." ) : live.parent_path();
+	for( const auto& ent : directory_iterator( dir, ec ) ) {
+		str_t name = ent.path().filename().string();
+		if( !ent.is_regular_file( ec ) || name.compare( 0, prefix.size(), prefix ) != 0 )
+			continue;
+		if( name.ends_with( ".gz.part" ) )
+			remove( ent.path(), ec );
+		else if( !name.ends_with( ".gz" ) && name.ends_with( ext ) && ent.path() != live )
+			s_zip_que.push_back( ent.path() );
+	}
+
+	s_zip_stop.store( false );
+	s_zipper = std::thread( ZipperBody );
+};
+
+void StopCompressor() {
+	if( !s_zipper.joinable() )
+		return;
+	{
+		std::lock_guard<std::mutex> lk( s_mtx4zip );
+		s_zip_stop.store( true );
+	}
+	s_cv4zip.notify_one();
+	s_zipper.join();
+	s_zip_que.clear();
+};
+
+void LockCompressor() {
+	s_mtx4zip.lock();
+};
+
+void UnlockCompressor() {
+	s_mtx4zip.unlock();
+};
+
+void ForgetCompressor() {
+	s_mtx4zip.unlock();
+	// 线程及条件变量的状态属于父进程, 就地重建, 不能析构(会等一个不存在的线程)
+	new( &s_zipper ) std::thread;
+	new( &s_cv4zip ) std::condition_variable;
+	s_zip_que.clear();
+	s_zip_stop.store( false );
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
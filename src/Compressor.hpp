@@ -0,0 +1,29 @@
+#pragma once
+#include <filesystem>
+
+#include "leonlog/LeonLog.hpp"
+
+namespace leon_log {
+
+// 启动压缩线程, 并把日志目录里以前轮转出来而尚未压缩的文件排进队列(SetCompressor 开启时才启动)
+void StartCompressor( str_cr log_file_ );
+// 停止压缩线程. 正在压缩的文件放弃(保留原文件), 尚未压缩的留待下次启动
+void StopCompressor();
+// fork 前拿住压缩队列的锁, fork 后在父进程里放开
+void LockCompressor();
+void UnlockCompressor();
+// fork 出的子进程: 放开压缩队列的锁, 忘掉父进程的压缩线程及队列(线程没跟过来)
+void ForgetCompressor();
+// 是否开启了后台压缩
+bool CompressorOn();
+// 把一个已轮转的日志文件交给压缩线程
+void CompressLater( const std::filesystem::path& );
+
+// 把 in_ 压缩为 BGZF 格式(分块的 gzip, 每块独立, 可随机访问), 写至 out_.
+// 成功返回 true; 失败(或 abort_ 被置位)时删除 out_, 返回 false
+bool CompressFile( const std::filesystem::path& in_, const std::filesystem::path& out_,
+				   int level_, const std::atomic_bool* abort_ = nullptr );
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
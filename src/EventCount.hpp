@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ctime>		// timespec
+#include <linux/futex.h>
+#include <sys/syscall.h>	// SYS_futex
+#include <unistd.h>		// syscall
+
+namespace leon_log {
+
+/* EventCount_t: 基于 futex 的"事件计数", 代替信号量通知日志线程
+   信号量要求生产者每入队一条就 sem_post 一次(至少是一次共享缓存行上的原子读改写),
+   本类让生产者只在等待者事先"宣告要睡"时才真正唤醒, 平时只有一个内存屏障和一次读.
+   等待者的用法:
+		uint32_t key = ec.prepare_wait();
+		if( 条件已满足 ) ec.cancel_wait(); else ec.wait( key, 截止时间 );
+   生产者: 先发布数据(如入队), 再 notify()
+   放在进程间共享的内存里(以 shared_ 构造)时, 也可跨进程等待、唤醒 */
+class EventCount_t {
+public:
+	EventCount_t() = default;
+	explicit EventCount_t( bool shared_ ) : _private( shared_ ? 0 : FUTEX_PRIVATE_FLAG ) {};
+
+	// 生产者: 有人在等才唤醒
+	void notify() {
+		// 与 prepare_wait 里的读改写配对: 要么等待者复查时看到了数据, 要么我们看到了等待者
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		if( _waiters.load( std::memory_order_relaxed ) > 0 ) [[unlikely]]
+			wake();
+	};
+
+	// 无条件唤醒所有等待者
+	void wake() {
+		_epoch.fetch_add( 1, std::memory_order_seq_cst );
+		syscall( SYS_futex, &_epoch, FUTEX_WAKE | _private, INT32_MAX, nullptr, nullptr, 0 );
+	};
+
+	// 等待者: 宣告要睡, 返回当前纪元
+	uint32_t prepare_wait() {
+		_waiters.fetch_add( 1, std::memory_order_seq_cst );
+		return _epoch.load( std::memory_order_seq_cst );
+	};
+
+	// 等待者: 复查发现条件已满足, 不睡了
+	void cancel_wait() {
+		_waiters.fetch_sub( 1, std::memory_order_relaxed );
+	};
+
+	// 等待者: 睡到被唤醒, 或到达截止时间(CLOCK_REALTIME 的绝对时间), 或纪元已变
+	void wait( uint32_t key_, const timespec& deadline_ ) {
+		syscall( SYS_futex, &_epoch, FUTEX_WAIT_BITSET | _private | FUTEX_CLOCK_REALTIME,
+				 key_, &deadline_, nullptr, FUTEX_BITSET_MATCH_ANY );
+		_waiters.fetch_sub( 1, std::memory_order_relaxed );
+	};
+
+	// fork 出的子进程: 父进程的等待者没跟过来, 计数清零
+	void reset() {
+		_waiters.store( 0, std::memory_order_relaxed );
+	};
+private:
+	static_assert( sizeof( std::atomic<uint32_t> ) == sizeof( uint32_t )
+				   && std::atomic<uint32_t>::is_always_lock_free );
+
+	// 纪元(futex 字), 每次唤醒都递增. 与等待者计数分处不同缓存行: 唤醒只改纪元, 生产者平时只读计数
+	alignas( 64 ) std::atomic<uint32_t>	_epoch { 0 };
+	alignas( 64 ) std::atomic<uint32_t>	_waiters { 0 };
+	int									_private = FUTEX_PRIVATE_FLAG;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,122 @@
+#include <algorithm>	// min
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "leonlog/LeonLog.hpp"
+
+namespace leon_log {
+
+//###### 各种变量 ###############################################################
+
+std::atomic<LogLevel_e>	g_log_level { LogLevel_e::Debug };
+std::atomic<LogLevel_e>	g_base_level { LogLevel_e::Debug };
+// 所有门槛中最低的, AppendLog 据此挡掉直接调用(不经宏)的低级别日志
+std::atomic<LogLevel_e>	s_log_floor { LogLevel_e::Debug };
+
+namespace {
+
+// 类别及各种级别设定, 只在设定级别、类别创建销毁时加锁访问.
+// 类别可能是其它模块的全局对象, 构造时本模块的全局变量未必已初始化, 所以放在函数内
+struct Levels_t {
+	std::mutex						mtx;
+	std::vector<LogCategory_t*>		cats;
+	std::map<str_t, LogLevel_e>		cat_levels;		// SetCategoryLevel 设定过的
+	size_t							overrides[LogLevel_e::VALUES_COUNT] {};	// 各级别的线程覆盖数
+};
+
+Levels_t& TheLevels() {
+	static Levels_t levels;
+	return levels;
+};
+
+// 重算各门槛(须持锁)
+void RefreshGates( Levels_t& lv_ ) {
+	LogLevel_e lowest = LogLevel_e::VALUES_COUNT;
+	for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l )
+		if( lv_.overrides[l] > 0 ) {
+			lowest = static_cast<LogLevel_e>( l );
+			break;
+		}
+
+	LogLevel_e floor = std::min( g_base_level.load(), lowest );
+	g_log_level.store( floor, std::memory_order_relaxed );
+	for( LogCategory_t* cat : lv_.cats ) {
+		auto it = lv_.cat_levels.find( cat->name() );
+		LogLevel_e level = it == lv_.cat_levels.end() ? g_base_level.load() : it->second;
+		cat->level.store( level, std::memory_order_relaxed );
+		cat->gate.store( std::min( level, lowest ), std::memory_order_relaxed );
+		floor = std::min( floor, cat->gate.load( std::memory_order_relaxed ) );
+	}
+	s_log_floor.store( floor, std::memory_order_relaxed );
+};
+
+// 线程退出时撤销它的覆盖
+struct OverrideHolder_t {
+	~OverrideHolder_t() {
+		if( tl_log_level != LogLevel_e::VALUES_COUNT )
+			SetThreadLogLevel( LogLevel_e::VALUES_COUNT );
+	};
+};
+
+}; // namespace
+
+//###### 各种函数实现 ############################################################
+
+LogCategory_t::LogCategory_t( str_cr name_ ) : _name( name_ ) {
+	Levels_t& lv = TheLevels();
+	std::lock_guard<std::mutex> lk( lv.mtx );
+	lv.cats.push_back( this );
+	RefreshGates( lv );
+};
+
+LogCategory_t::~LogCategory_t() {
+	Levels_t& lv = TheLevels();
+	std::lock_guard<std::mutex> lk( lv.mtx );
+	std::erase( lv.cats, this );
+	RefreshGates( lv );
+};
+
+void SetLogLevel( LogLevel_e level_ ) {
+	Levels_t& lv = TheLevels();
+	std::lock_guard<std::mutex> lk( lv.mtx );
+	g_base_level.store( std::clamp( level_, LogLevel_e::Debug, LogLevel_e::Fatal ) );
+	RefreshGates( lv );
+};
+
+void SetCategoryLevel( str_cr name_, LogLevel_e level_ ) {
+	Levels_t& lv = TheLevels();
+	std::lock_guard<std::mutex> lk( lv.mtx );
+	if( level_ >= LogLevel_e::VALUES_COUNT )
+		lv.cat_levels.erase( name_ );
+	else
+		lv.cat_levels[name_] = std::max( level_, LogLevel_e::Debug );
+	RefreshGates( lv );
+};
+
+void SetThreadLogLevel( LogLevel_e level_ ) {
+	thread_local OverrideHolder_t tl_holder;
+	( void )tl_holder;
+
+	level_ = std::clamp( level_, LogLevel_e::Debug, LogLevel_e::VALUES_COUNT );
+	Levels_t& lv = TheLevels();
+	std::lock_guard<std::mutex> lk( lv.mtx );
+	if( tl_log_level != LogLevel_e::VALUES_COUNT )
+		--lv.overrides[tl_log_level];
+	if( level_ != LogLevel_e::VALUES_COUNT )
+		++lv.overrides[level_];
+	tl_log_level = level_;
+	RefreshGates( lv );
+};
+
+void LockLevels() {
+	TheLevels().mtx.lock();
+};
+
+void UnlockLevels() {
+	TheLevels().mtx.unlock();
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
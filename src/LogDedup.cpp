@@ -0,0 +1,109 @@
+#include <chrono>
+#include <functional>	// hash
+
+#include "LogDedup.hpp"
+
+using namespace std::chrono;
+
+namespace leon_log {
+
+// 汇总里时戳的精度
+constexpr size_t SUMMARY_STAMP_PREC = 6;
+
+bool LogDedup_t::absorb( const LogEntry_t& log_, Emit_f emit_ ) {
+	std::string_view body = log_.body.view();
+	size_t hash = std::hash<std::string_view>()( body );
+	hash ^= ( reinterpret_cast<uintptr_t>( log_.lfmt ) + ( size_t( log_.tid ) << 8 ) + log_.level )
+			* 0x9e3779b97f4a7c15ull;
+	Slot_t* set = &_slots[hash % SETS * WAYS];
+	Slot_t* victim = set;
+	for( Slot_t* slot = set; slot < set + WAYS; ++slot ) {
+		if( !slot->used ) {
+			victim = slot;
+			continue;
+		}
+		if( slot->hash == hash && slot->lfmt == log_.lfmt && slot->tid == log_.tid
+				&& slot->level == log_.level && slot->kvs == log_.kvs && slot->body == body ) {
+			if( log_.stamp - slot->seen <= _window ) {
+				if( slot->repeats++ == 0 )
+					slot->first = log_.stamp;
+				slot->last = log_.stamp;
+				return true;
+			}
+			// 窗口已过, 照常写出, 重新计窗口
+			summarize( *slot, emit_ );
+			slot->seen = log_.stamp;
+			return false;
+		}
+		if( victim->used && slot->active() < victim->active() )
+			victim = slot;
+	}
+
+	Slot_t& slot = *victim;
+	if( slot.used )
+		summarize( slot, emit_ );
+	slot.used = true;
+	slot.hash = hash;
+	slot.lfmt = log_.lfmt;
+	slot.tid = log_.tid;
+	slot.kvs = log_.kvs;
+	slot.level = log_.level;
+	slot.body.assign( body );
+	slot.seen = log_.stamp;
+	slot.repeats = 0;
+	return false;
+};
+
+void LogDedup_t::expire( LogStamp_t now_, Emit_f emit_ ) {
+	for( Slot_t& slot : _slots )
+		if( slot.repeats > 0 && now_ - slot.seen > _window )
+			summarize( slot, emit_ );
+};
+
+void LogDedup_t::flush_all( Emit_f emit_ ) {
+	for( Slot_t& slot : _slots ) {
+		summarize( slot, emit_ );
+		slot.used = false;
+	}
+};
+
+void LogDedup_t::forget() {
+	for( Slot_t& slot : _slots )
+		slot = Slot_t {};
+};
+
+void LogDedup_t::summarize( Slot_t& slot_, Emit_f emit_ ) {
+	if( slot_.repeats == 0 )
+		return;
+
+	char first[LOG_STAMP_MAX], last[LOG_STAMP_MAX];
+	size_t first_len = FormatLogStamp(
+		first, duration_cast<nanoseconds>( slot_.first.time_since_epoch() ).count(), SUMMARY_STAMP_PREC );
+	size_t last_len = FormatLogStamp(
+		last, duration_cast<nanoseconds>( slot_.last.time_since_epoch() ).count(), SUMMARY_STAMP_PREC );
+
+	// 汇总带上原日志内容, 否则与其它线程的日志交错时分不清是哪条
+	LogEntry_t orig { slot_.last, slot_.tid, slot_.body, slot_.level };
+	orig.lfmt = slot_.lfmt;
+	orig.kvs = slot_.kvs;
+	char buf[LOG_LINE_MAX];
+	std::string_view body = BodyOf( orig, buf, sizeof( buf ) );
+
+	str_t text;
+	text.reserve( body.size() + 96 );
+	text.append( "此日志又重复了" ).append( std::to_string( slot_.repeats ) ).append( "次(" )
+	.append( first, first_len ).append( " ~ " ).append( last, last_len ).append( "):" ).append( body );
+	// 结构化字段原样带上
+	if( slot_.kvs > 0 ) {
+		uint32_t text_len = static_cast<uint32_t>( text.size() );
+		text.append( orig.fields() ).append( reinterpret_cast<const char*>( &text_len ), sizeof( text_len ) );
+	}
+	LogEntry_t summary { slot_.last, slot_.tid, std::move( text ), slot_.level };
+	summary.kvs = slot_.kvs;
+	emit_( summary );
+	slot_.repeats = 0;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+
+#include "LogEntry.hpp"
+
+namespace leon_log {
+
+/* LogDedup_t: 日志线程一侧的重复日志合并
+   记住最近写出的若干条日志(按线程、级别、内容散列, 4路组相联, 组满挤掉最久没出现的). 同一线程同级别、
+   内容逐字节相同的日志, 在上次写出后的一个窗口之内再出现, 只计数不写出(也就省了格式化);
+   窗口过后(或被挤掉时)补写一条"重复了N次"的汇总, 注明首末两次的时戳.
+   只供日志线程使用 */
+class LogDedup_t {
+public:
+	using Emit_f = void ( * )( const LogEntry_t& );
+
+	// 窗口为0即不合并
+	void set_window( LogStamp_t::duration window_ ) { _window = window_; };
+	bool enabled() const { return _window.count() > 0; };
+
+	// log_ 是窗口内的重复: 记下, 返回 true(不必写出). 否则登记它, 返回 false;
+	// 若因此挤掉了还有重复未报告的旧日志, 先经 emit_ 补写其汇总
+	bool absorb( const LogEntry_t& log_, Emit_f emit_ );
+	// 补写窗口已过的汇总
+	void expire( LogStamp_t now_, Emit_f emit_ );
+	// 补写所有汇总, 并忘掉所有日志(日志文件要关闭了)
+	void flush_all( Emit_f emit_ );
+	// 忘掉所有日志, 不补写汇总(fork 出的子进程里, 那些汇总归父进程写)
+	void forget();
+
+private:
+	struct Slot_t {
+		bool			used = false;
+		size_t			hash = 0;
+		const LogFmt_t*	lfmt = nullptr;
+		ThreadId_t		tid = 0;
+		uint16_t		kvs = 0;
+		LogLevel_e		level = LogLevel_e::Debug;
+		str_t			body;		// 原始内容(延迟格式化的就是打包的参数)
+		LogStamp_t		seen;		// 上次写出的时刻
+		LogStamp_t		first;		// 此后首次、末次重复的时刻
+		LogStamp_t		last;
+		uint64_t		repeats = 0;
+
+		// 最近一次出现的时刻
+		LogStamp_t active() const { return repeats > 0 ? last : seen; };
+	};
+
+	// 补写一个槽位的汇总
+	void summarize( Slot_t&, Emit_f emit_ );
+
+	static constexpr size_t	SETS = 64;
+	static constexpr size_t	WAYS = 4;
+	std::vector<Slot_t>		_slots { SETS * WAYS };
+	LogStamp_t::duration	_window {};
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "leonlog/LeonLog.hpp"
+#include "leonlog/LogFmt.hpp"
+
+namespace leon_log {
+
+// 线程编号: 线程名登记(RegistThread, 或首次添加日志)时分配, 日志里只存编号
+using ThreadId_t = uint16_t;
+constexpr size_t MAX_THREAD_NAMES = 4096;
+
+// 当前线程的编号(未登记过的线程, 以其16进制线程Id为名自动登记)
+ThreadId_t MyThreadId();
+// 编号对应的线程名
+str_cr ThreadNameOf( ThreadId_t );
+
+// LogBody_t: 日志内容. 短内容存于内部定长缓冲区, 免分配; 超长的才用堆(str_t 可直接接管)
+class LogBody_t {
+public:
+	static constexpr size_t INLINE_SIZE = 192;
+
+	LogBody_t() = default;
+	explicit LogBody_t( std::string_view sv_ ) { assign( sv_ ); };
+	explicit LogBody_t( str_t&& s_ ) { assign( std::move( s_ ) ); };
+	explicit LogBody_t( const char* s_ ) { assign( std::string_view( s_ ) ); };
+
+	LogBody_t( const LogBody_t& o_ ) { assign( o_.view() ); };
+	LogBody_t( LogBody_t&& o_ ) noexcept { take( o_ ); };
+	LogBody_t& operator=( const LogBody_t& o_ ) {
+		if( this != &o_ )
+			assign( o_.view() );
+		return *this;
+	};
+	LogBody_t& operator=( LogBody_t&& o_ ) noexcept {
+		if( this != &o_ )
+			take( o_ );
+		return *this;
+	};
+
+	void assign( std::string_view sv_ ) {
+		_size = static_cast<uint32_t>( sv_.size() );
+		if( _size <= INLINE_SIZE )
+			std::memcpy( _inl, sv_.data(), _size );
+		else
+			_long.assign( sv_ );
+	};
+	void assign( const char* s_ ) { assign( std::string_view( s_ ) ); };
+	// 短内容照样拷贝(源串留给调用者复用), 长内容直接接管其堆内存
+	void assign( str_t&& s_ ) {
+		if( s_.size() <= INLINE_SIZE )
+			assign( std::string_view( s_ ) );
+		else {
+			_size = static_cast<uint32_t>( s_.size() );
+			_long = std::move( s_ );
+		}
+	};
+
+	const char* data() const { return _size <= INLINE_SIZE ? _inl : _long.data(); };
+	size_t size() const { return _size; };
+	std::string_view view() const { return std::string_view( data(), _size ); };
+
+private:
+	void take( LogBody_t& o_ ) {
+		_size = o_._size;
+		if( _size <= INLINE_SIZE )
+			std::memcpy( _inl, o_._inl, _size );
+		else
+			_long = std::move( o_._long );
+	};
+
+	str_t		_long;
+	uint32_t	_size = 0;
+	char		_inl[INLINE_SIZE];
+};
+
+static_assert( LOG_ARGS_SIZE <= LogBody_t::INLINE_SIZE );
+
+// LogEntry: 定义一条日志记录所具有的基本内容
+struct LogEntry_t {
+	LogStamp_t		stamp;		// 日志产生时间
+	// 延迟格式化的日志(LOGF)才有: 格式描述符. 此时 body 内是打包的参数, 由日志线程格式化
+	const LogFmt_t*	lfmt = nullptr;
+	LogBody_t		body;		// 日志内容
+	ThreadId_t		tid;		// 产生日志的线程
+	// 结构化字段个数(见 Log_t::kv). 非0时 body 为: 正文 + 打包的字段 + 正文长度(uint32)
+	uint16_t		kvs = 0;
+	LogLevel_e		level;		// 日志级别
+
+	template <typename T>
+	LogEntry_t( LogStamp_t stamp_, ThreadId_t thread_, T&& body_, LogLevel_e level_ ):
+		stamp( stamp_ ),
+		body( std::forward<T>( body_ ) ),
+		tid( thread_ ),
+		level( level_ )
+	{};
+
+	LogEntry_t( LogStamp_t stamp_, ThreadId_t thread_, const LogFmt_t* fmt_,
+				const void* args_, size_t size_, LogLevel_e level_ ):
+		stamp( stamp_ ),
+		lfmt( fmt_ ),
+		body( std::string_view( static_cast<const char*>( args_ ), size_ ) ),
+		tid( thread_ ),
+		level( level_ )
+	{};
+
+	// 正文(不含结构化字段)
+	std::string_view text() const {
+		if( kvs == 0 )
+			return body.view();
+		uint32_t len;
+		std::memcpy( &len, body.data() + body.size() - sizeof( len ), sizeof( len ) );
+		return std::string_view( body.data(), len );
+	};
+	// 打包的结构化字段
+	std::string_view fields() const {
+		if( kvs == 0 )
+			return std::string_view();
+		size_t text_len = text().size();
+		return std::string_view( body.data() + text_len, body.size() - text_len - sizeof( uint32_t ) );
+	};
+};
+
+// 一条日志恰好占4条缓存行
+static_assert( sizeof( LogEntry_t ) == 256 );
+
+// 延迟格式化日志格式化之后的最大长度, 超长截断
+constexpr size_t LOG_LINE_MAX = 4096;
+
+// 日志内容. 延迟格式化的日志会被格式化至 buf_(最多 cap_ 字节)
+std::string_view BodyOf( const LogEntry_t&, char* buf_, size_t cap_ );
+
+// 二进制日志(见 leonlog/BinLog.hpp): 打开文件后先写文件头(文件不以文件头开始时)及会话字典, 再逐条写日志
+class LogOutput_t;
+void StartBinLog( LogOutput_t&, str_cr file_, size_t stamp_prec_ );
+void Write1Bin( LogOutput_t&, const LogEntry_t& );
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
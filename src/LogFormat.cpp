@@ -0,0 +1,426 @@
+#include <algorithm>	// min
+#include <charconv>
+#include <cmath>		// isfinite
+#include <cstdint>
+#include <cstring>		// memcpy
+#include <ctime>		// localtime_r, strftime
+
+#include "leonlog/LogFmt.hpp"
+
+namespace leon_log {
+
+//###### 各种函数实现 ############################################################
+
+namespace {
+
+// 占位符内的格式说明, 如 "{:x}"、"{:.3}"
+struct FmtSpec_t {
+	int		prec = -1;		// 浮点数小数位数, -1 表示最短表达
+	bool	hex = false;	// 整数16进制
+};
+
+// 输出缓冲区, 写满即截断
+struct OutBuf_t {
+	char*	cur;
+	char*	end;
+
+	void put( char c_ ) {
+		if( cur < end )
+			*cur++ = c_;
+	};
+	void put( const char* s_, size_t n_ ) {
+		n_ = std::min<size_t>( n_, end - cur );
+		std::memcpy( cur, s_, n_ );
+		cur += n_;
+	};
+};
+
+template <typename T>
+T LoadArg( const std::byte*& args_ ) {
+	T v;
+	std::memcpy( &v, args_, sizeof( T ) );
+	args_ += sizeof( T );
+	return v;
+};
+
+template <typename T>
+void PutInt( OutBuf_t& out_, T v_, const FmtSpec_t& spec_ ) {
+	auto [p, ec] = std::to_chars( out_.cur, out_.end, v_, spec_.hex ? 16 : 10 );
+	if( ec == std::errc() )
+		out_.cur = p;
+	else
+		out_.cur = out_.end;
+};
+
+template <typename T>
+void PutFloat( OutBuf_t& out_, T v_, const FmtSpec_t& spec_ ) {
+	auto [p, ec] = spec_.prec < 0
+				   ? std::to_chars( out_.cur, out_.end, v_ )
+				   : std::to_chars( out_.cur, out_.end, v_, std::chars_format::fixed, spec_.prec );
+	if( ec == std::errc() )
+		out_.cur = p;
+	else
+		out_.cur = out_.end;
+};
+
+// 按类型码取出一个参数并输出
+void PutArg( OutBuf_t& out_, char code_, const std::byte*& args_, const FmtSpec_t& spec_ ) {
+	switch( code_ ) {
+	case 'b':
+		if( LoadArg<bool>( args_ ) )
+			out_.put( "true", 4 );
+		else
+			out_.put( "false", 5 );
+		break;
+	case 'c': out_.put( LoadArg<char>( args_ ) ); break;
+	case 'a': PutInt( out_, LoadArg<int8_t>( args_ ), spec_ ); break;
+	case 'A': PutInt( out_, LoadArg<uint8_t>( args_ ), spec_ ); break;
+	case 's': PutInt( out_, LoadArg<int16_t>( args_ ), spec_ ); break;
+	case 'S': PutInt( out_, LoadArg<uint16_t>( args_ ), spec_ ); break;
+	case 'i': PutInt( out_, LoadArg<int32_t>( args_ ), spec_ ); break;
+	case 'I': PutInt( out_, LoadArg<uint32_t>( args_ ), spec_ ); break;
+	case 'l': PutInt( out_, LoadArg<int64_t>( args_ ), spec_ ); break;
+	case 'L': PutInt( out_, LoadArg<uint64_t>( args_ ), spec_ ); break;
+	case 'f': PutFloat( out_, LoadArg<float>( args_ ), spec_ ); break;
+	case 'd': PutFloat( out_, LoadArg<double>( args_ ), spec_ ); break;
+	case 'p': {
+		auto v = reinterpret_cast<uintptr_t>( LoadArg<const void*>( args_ ) );
+		if( v == 0 )
+			out_.put( "{nullptr}", 9 );
+		else {
+			out_.put( "0x", 2 );
+			PutInt( out_, v, FmtSpec_t { .hex = true } );
+		}
+		break;
+	}
+	default:
+		out_.put( "{?}", 3 );
+	}
+};
+
+}; // namespace
+
+size_t FormatLogArgs( char* out_, size_t cap_,
+					  char_cp fmt_, char_cp types_, const std::byte* args_ ) {
+	OutBuf_t out { out_, out_ + cap_ };
+
+	for( char_cp p = fmt_; *p != '\0'; ++p ) {
+		if( *p == '}' && p[1] == '}' ) {
+			out.put( '}' );
+			++p;
+			continue;
+		}
+		if( *p != '{' ) {
+			out.put( *p );
+			continue;
+		}
+		if( p[1] == '{' ) {
+			out.put( '{' );
+			++p;
+			continue;
+		}
+
+		// 解析占位符
+		char_cp q = p + 1;
+		FmtSpec_t spec;
+		if( *q == ':' ) {
+			++q;
+			if( *q == '.' ) {
+				spec.prec = 0;
+				for( ++q; *q >= '0' && *q <= '9'; ++q )
+					spec.prec = spec.prec * 10 + ( *q - '0' );
+			}
+			if( *q == 'x' ) {
+				spec.hex = true;
+				++q;
+			}
+		}
+		// 不认识的占位符, 或者参数已用完, 原样输出
+		if( *q != '}' || *types_ == '\0' ) {
+			out.put( *p );
+			continue;
+		}
+
+		PutArg( out, *types_++, args_, spec );
+		p = q;
+	}
+
+	return out.cur - out_;
+};
+
+size_t EscapeJson( char* out_, size_t cap_, std::string_view sv_ ) {
+	static constexpr char HEX[] = "0123456789abcdef";
+	char* p = out_;
+	char* end = out_ + cap_;
+	for( char c : sv_ ) {
+		char esc = 0;
+		switch( c ) {
+		case '"': esc = '"'; break;
+		case '\\': esc = '\\'; break;
+		case '\n': esc = 'n'; break;
+		case '\r': esc = 'r'; break;
+		case '\t': esc = 't'; break;
+		case '\b': esc = 'b'; break;
+		case '\f': esc = 'f'; break;
+		}
+		if( esc != 0 ) {
+			if( end - p < 2 )
+				break;
+			*p++ = '\\';
+			*p++ = esc;
+		} else if( static_cast<unsigned char>( c ) < 0x20 ) {
+			if( end - p < 6 )
+				break;
+			std::memcpy( p, "\\u00", 4 );
+			p[4] = HEX[c >> 4];
+			p[5] = HEX[c & 0xf];
+			p += 6;
+		} else {
+			// 多字节的 UTF-8 字符原样输出
+			if( p == end )
+				break;
+			*p++ = c;
+		}
+	}
+	return p - out_;
+};
+
+void AppendJson( str_t& out_, std::string_view sv_ ) {
+	// 逐个字符追加太慢, 先按最坏情况(每字节6个)扩容, 写完再截掉
+	size_t at = out_.size();
+	out_.resize( at + sv_.size() * 6 );
+	out_.resize( at + EscapeJson( out_.data() + at, sv_.size() * 6, sv_ ) );
+};
+
+namespace {
+
+template <typename T>
+T LoadKv( const char*& p_ ) {
+	T v;
+	std::memcpy( &v, p_, sizeof( T ) );
+	p_ += sizeof( T );
+	return v;
+};
+
+template <typename T>
+void AppendNum( str_t& out_, T v_ ) {
+	char buf[32];
+	auto r = std::to_chars( buf, buf + sizeof( buf ), v_ );
+	out_.append( buf, r.ptr );
+};
+
+// 文本格式下键及字符串值要不要加引号: 空串, 或含有分隔符、引号、控制字符的
+bool NeedQuote( std::string_view sv_ ) {
+	if( sv_.empty() )
+		return true;
+	for( char c : sv_ )
+		if( static_cast<unsigned char>( c ) <= ' ' || c == '"' || c == '=' || c == '\\' )
+			return true;
+	return false;
+};
+
+}; // namespace
+
+void FormatLogKvs( str_t& out_, std::string_view fields_, bool json_ ) {
+	const char* p = fields_.data();
+	const char* end = p + fields_.size();
+	while( p + 2 <= end ) {
+		char code = *p++;
+		std::string_view key( p + 1, static_cast<uint8_t>( *p ) );
+		p += 1 + key.size();
+
+		if( json_ ) {
+			out_.append( ",\"" );
+			AppendJson( out_, key );
+			out_.append( "\":" );
+		} else if( NeedQuote( key ) ) {
+			out_.append( " \"" );
+			AppendJson( out_, key );
+			out_.append( "\"=" );
+		} else
+			out_.append( " " ).append( key ).push_back( '=' );
+
+		switch( code ) {
+		case 'b':
+			out_.append( *p++ ? "true" : "false" );
+			break;
+		case 'l':
+			AppendNum( out_, LoadKv<int64_t>( p ) );
+			break;
+		case 'L':
+			AppendNum( out_, LoadKv<uint64_t>( p ) );
+			break;
+		case 'd': {
+			double v = LoadKv<double>( p );
+			if( json_ && !std::isfinite( v ) )
+				out_.append( "null" );
+			else
+				AppendNum( out_, v );	// 最短而能精确还原的表示
+			break;
+		}
+		case 'z': {
+			uint32_t len = LoadKv<uint32_t>( p );
+			std::string_view v( p, len );
+			p += len;
+			if( json_ || NeedQuote( v ) ) {
+				out_.push_back( '"' );
+				AppendJson( out_, v );
+				out_.push_back( '"' );
+			} else
+				out_.append( v );
+			break;
+		}
+		default:
+			// 不认识的类型码, 其后的字段无法再解析
+			out_.append( json_ ? "null" : "{?}" );
+			return;
+		}
+	}
+};
+
+// "00".."99" 两位一组的数字表, 一次除法出两位数字
+static constexpr char DIGIT_PAIRS[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static inline void Put2Digits( char* out_, uint32_t v_ ) {
+	std::memcpy( out_, DIGIT_PAIRS + v_ * 2, 2 );
+};
+
+// 秒以下部分: 总是查表生成全部9位数字, 再截取(而非四舍五入)前 prec_ 位, 无需按精度分支
+static size_t PutSubSecond( char* out_, uint32_t ns_, size_t prec_ ) {
+	prec_ = std::min<size_t>( prec_, 9 );
+	uint32_t low = ns_ % 100000000;
+	char digits[9];
+	digits[0] = static_cast<char>( '0' + ns_ / 100000000 );
+	Put2Digits( digits + 1, low / 1000000 );
+	Put2Digits( digits + 3, low / 10000 % 100 );
+	Put2Digits( digits + 5, low / 100 % 100 );
+	Put2Digits( digits + 7, low % 100 );
+
+	out_[0] = '.';
+	std::memcpy( out_ + 1, digits, prec_ );
+	return prec_ > 0 ? prec_ + 1 : 0;
+};
+
+// 拆分纳秒时戳为整秒及秒以下部分(向下取整)
+static inline void SplitStamp( int64_t ns_, int64_t& secs_, uint32_t& sub_sec_ ) {
+	secs_ = ns_ / 1000000000;
+	int64_t sub_sec = ns_ % 1000000000;
+	if( sub_sec < 0 ) {
+		--secs_;
+		sub_sec += 1000000000;
+	}
+	sub_sec_ = static_cast<uint32_t>( sub_sec );
+};
+
+size_t FormatLogStamp( char* out_, int64_t ns_, size_t prec_ ) {
+	int64_t secs;
+	uint32_t sub_sec;
+	SplitStamp( ns_, secs, sub_sec );
+
+	// 同一秒内的日志共用"秒"以上的部分, 只有跨秒时才需要 localtime/strftime
+	thread_local time_t	cached_secs = -1;
+	thread_local char	cached_pref[LOG_STAMP_MAX];
+	thread_local size_t	cached_len = 0;
+	if( secs != cached_secs ) [[unlikely]] {
+		time_t t = secs;
+		tm tm_buf;
+		localtime_r( &t, &tm_buf );
+		cached_len = strftime( cached_pref, sizeof( cached_pref ), "%y/%m/%d %H:%M:%S", &tm_buf );
+		cached_secs = secs;
+	}
+	std::memcpy( out_, cached_pref, cached_len );
+	return cached_len + PutSubSecond( out_ + cached_len, sub_sec, prec_ );
+};
+
+// 本地时间(整秒)的年月日时分秒: rfc_ 为"yyyy-mm-ddTHH:MM:SS", 否则为"yy/mm/dd HH:MM:SS", 返回写入字节数
+static size_t PutDateTime( char* out_, int64_t secs_, bool rfc_ ) {
+	int64_t days = secs_ / 86400;
+	int64_t sec_of_day = secs_ % 86400;
+	if( sec_of_day < 0 ) {
+		--days;
+		sec_of_day += 86400;
+	}
+
+	// 由"距1970-01-01的天数"推算年月日(公历, 以3月为年首, 400年为一个周期)
+	int64_t z = days + 719468;
+	int64_t era = ( z >= 0 ? z : z - 146096 ) / 146097;
+	int64_t doe = z - era * 146097;
+	int64_t yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+	int64_t doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+	int64_t mp = ( 5 * doy + 2 ) / 153;
+	uint32_t day = static_cast<uint32_t>( doy - ( 153 * mp + 2 ) / 5 + 1 );
+	uint32_t month = static_cast<uint32_t>( mp < 10 ? mp + 3 : mp - 9 );
+	int64_t year = yoe + era * 400 + ( month <= 2 );
+
+	char* p = out_;
+	if( rfc_ ) {
+		Put2Digits( p, static_cast<uint32_t>( ( year / 100 % 100 + 100 ) % 100 ) );
+		p += 2;
+	}
+	Put2Digits( p, static_cast<uint32_t>( ( year % 100 + 100 ) % 100 ) );
+	p[2] = rfc_ ? '-' : '/';
+	Put2Digits( p + 3, month );
+	p[5] = rfc_ ? '-' : '/';
+	Put2Digits( p + 6, day );
+	p[8] = rfc_ ? 'T' : ' ';
+	Put2Digits( p + 9, static_cast<uint32_t>( sec_of_day / 3600 ) );
+	p[11] = ':';
+	Put2Digits( p + 12, static_cast<uint32_t>( sec_of_day / 60 % 60 ) );
+	p[14] = ':';
+	Put2Digits( p + 15, static_cast<uint32_t>( sec_of_day % 60 ) );
+	return p + 17 - out_;
+};
+
+// UTC偏移"+hh:mm"
+static size_t PutUtcOff( char* out_, int64_t utc_off_ ) {
+	out_[0] = utc_off_ < 0 ? '-' : '+';
+	uint32_t mins = static_cast<uint32_t>( ( utc_off_ < 0 ? -utc_off_ : utc_off_ ) / 60 );
+	Put2Digits( out_ + 1, mins / 60 % 100 );
+	out_[3] = ':';
+	Put2Digits( out_ + 4, mins % 60 );
+	return 6;
+};
+
+size_t FormatLogStampAt( char* out_, int64_t ns_, size_t prec_, int64_t utc_off_ ) {
+	int64_t secs;
+	uint32_t sub_sec;
+	SplitStamp( ns_, secs, sub_sec );
+	size_t len = PutDateTime( out_, secs + utc_off_, false );
+	return len + PutSubSecond( out_ + len, sub_sec, prec_ );
+};
+
+size_t FormatRfc3339Stamp( char* out_, int64_t ns_, size_t prec_ ) {
+	int64_t secs;
+	uint32_t sub_sec;
+	SplitStamp( ns_, secs, sub_sec );
+
+	// 同 FormatLogStamp, 只有跨秒时才查时区
+	thread_local time_t		cached_secs = -1;
+	thread_local int64_t	cached_off = 0;
+	if( secs != cached_secs ) [[unlikely]] {
+		time_t t = secs;
+		tm tm_buf;
+		localtime_r( &t, &tm_buf );
+		cached_off = tm_buf.tm_gmtoff;
+		cached_secs = secs;
+	}
+	size_t len = PutDateTime( out_, secs + cached_off, true );
+	len += PutSubSecond( out_ + len, sub_sec, prec_ );
+	return len + PutUtcOff( out_ + len, cached_off );
+};
+
+size_t FormatRfc3339StampAt( char* out_, int64_t ns_, size_t prec_, int64_t utc_off_ ) {
+	int64_t secs;
+	uint32_t sub_sec;
+	SplitStamp( ns_, secs, sub_sec );
+	size_t len = PutDateTime( out_, secs + utc_off_, true );
+	len += PutSubSecond( out_ + len, sub_sec, prec_ );
+	return len + PutUtcOff( out_ + len, utc_off_ );
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
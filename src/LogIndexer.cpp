@@ -0,0 +1,114 @@
+#include <cerrno>		// errno, EINTR
+#include <climits>		// INT64_MAX
+#include <cstring>		// memcmp, memcpy, strerror
+#include <fcntl.h>		// open
+#include <iostream>
+#include <sys/stat.h>	// fstat
+#include <unistd.h>		// close, ftruncate, lseek, pread, write
+
+#include "LogIndexer.hpp"
+
+namespace leon_log {
+
+bool LogIndexer_t::open( str_cr log_file_, uint64_t size_, size_t every_, int64_t every_ns_ ) {
+	abandon();
+	str_t file = log_file_ + ".idx";
+	_fd = ::open( file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | ( size_ == 0 ? O_TRUNC : 0 ), 0644 );
+	if( _fd < 0 ) {
+		std::cerr << "打开索引文件(" << file << ")失败:" << std::strerror( errno ) << std::endl;
+		return false;
+	}
+
+	// 已有的索引须是本版本的, 否则重建. 末尾写了一半的, 及超出日志文件(它被截短过)的段, 都截掉
+	LogIdxHead_t head {};
+	struct stat st;
+	uint64_t len = fstat( _fd, &st ) == 0 ? st.st_size : 0;
+	bool valid = len >= sizeof( head ) && pread( _fd, &head, sizeof( head ), 0 ) == sizeof( head )
+				 && std::memcmp( head.magic, LOG_IDX_MAGIC, sizeof( head.magic ) ) == 0
+				 && head.version == LOG_IDX_VERSION && head.rec_size == sizeof( LogIdxRec_t );
+	if( valid ) {
+		len = sizeof( head ) + ( len - sizeof( head ) ) / sizeof( LogIdxRec_t ) * sizeof( LogIdxRec_t );
+		for( LogIdxRec_t rec; len > sizeof( head ); len -= sizeof( rec ) )
+			if( pread( _fd, &rec, sizeof( rec ), len - sizeof( rec ) ) != sizeof( rec ) || rec.end <= size_ )
+				break;
+	} else {
+		std::memcpy( head.magic, LOG_IDX_MAGIC, sizeof( head.magic ) );
+		head.version = LOG_IDX_VERSION;
+		head.rec_size = sizeof( LogIdxRec_t );
+		len = 0;
+	}
+	if( ftruncate( _fd, len ) != 0 || lseek( _fd, len, SEEK_SET ) < 0
+			|| ( len == 0 && write( _fd, &head, sizeof( head ) ) != sizeof( head ) ) ) {
+		std::cerr << "初始化索引文件(" << file << ")失败:" << std::strerror( errno ) << std::endl;
+		abandon();
+		return false;
+	}
+
+	_every = every_ > 0 ? every_ : SIZE_MAX;
+	_every_ns = every_ns_ > 0 ? every_ns_ : INT64_MAX;
+	_lines = 0;
+	_seg = LogIdxRec_t { size_, size_, 0, 0 };
+	return true;
+};
+
+void LogIndexer_t::cut( uint64_t offset_ ) {
+	if( _lines > 0 ) {
+		_seg.end = offset_;
+		_done.push_back( _seg );
+		_lines = 0;
+	}
+	_seg.begin = offset_;
+};
+
+int64_t LogIndexer_t::utc_off( int64_t ns_ ) {
+	time_t secs = ns_ / 1000000000;
+	if( secs != _off_secs ) {
+		tm lt;
+		localtime_r( &secs, &lt );
+		_off_ns = static_cast<int64_t>( lt.tm_gmtoff ) * 1000000000;
+		_off_secs = secs;
+	}
+	return _off_ns;
+};
+
+void LogIndexer_t::flush() {
+	if( _fd < 0 || _done.empty() )
+		return;
+
+	const char*	p = reinterpret_cast<const char*>( _done.data() );
+	size_t		left = _done.size() * sizeof( LogIdxRec_t );
+	while( left > 0 ) {
+		ssize_t n = ::write( _fd, p, left );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 ) {
+			// 索引只是锦上添花, 写不了就不写了(查询工具对没索引到的部分逐行查找)
+			std::cerr << "写索引文件失败, 不再索引:" << std::strerror( errno ) << std::endl;
+			abandon();
+			return;
+		}
+		p += n;
+		left -= n;
+	}
+	_done.clear();
+};
+
+void LogIndexer_t::close( uint64_t size_ ) {
+	if( _fd < 0 )
+		return;
+	cut( size_ );
+	flush();
+	abandon();
+};
+
+void LogIndexer_t::abandon() {
+	if( _fd >= 0 )
+		::close( _fd );
+	_fd = -1;
+	_lines = 0;
+	_done.clear();
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
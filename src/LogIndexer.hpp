@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "leonlog/LeonLog.hpp"
+#include "leonlog/LogIndex.hpp"
+
+namespace leon_log {
+
+/* LogIndexer_t: 日志线程一侧的时间索引(格式见 leonlog/LogIndex.hpp)
+   每写一行之前记下其时戳及位置; 当前段满了(行数, 或跨过了一个时间间隔)就在这一行之前切断.
+   切好的段在日志文件写出之后才写进索引, 所以索引不会指向还没写出的内容.
+   只供日志线程使用 */
+class LogIndexer_t {
+public:
+	LogIndexer_t() = default;
+	~LogIndexer_t() { abandon(); };
+
+	LogIndexer_t( const LogIndexer_t& ) = delete;
+	LogIndexer_t& operator=( const LogIndexer_t& ) = delete;
+
+	// 打开(必要时创建)日志文件 log_file_ 的索引, 日志文件此时长 size_(为0则清空旧索引).
+	// 每 every_ 行或每 every_ns_ 纳秒切一段. 失败返回 false, 不建索引
+	bool open( str_cr log_file_, uint64_t size_, size_t every_, int64_t every_ns_ );
+	bool is_open() const { return _fd >= 0; };
+
+	// 写一行之前: 其时戳(自纪元起的纳秒数)及在日志文件中的位置
+	void note( int64_t ns_, uint64_t offset_ ) {
+		if( _lines >= _every || ( _lines > 0 && ns_ - _since >= _every_ns ) )
+			cut( offset_ );
+		int64_t local = ns_ + utc_off( ns_ );
+		if( _lines++ == 0 ) {
+			_seg.begin = offset_;	// 此前不经 note 写出的内容(如启动时的提示)不归入任何段
+			_since = ns_;
+			_seg.min_ns = _seg.max_ns = local;
+		} else if( local < _seg.min_ns )
+			_seg.min_ns = local;
+		else if( local > _seg.max_ns )
+			_seg.max_ns = local;
+	};
+
+	// 把切好的段写进索引(日志文件写出之后调用)
+	void flush();
+	// 日志文件已关闭, 长 size_: 最后一段也记下, 关闭索引
+	void close( uint64_t size_ );
+	// 不记下也不写出, 直接关闭. 供 fork 出的子进程扔掉从父进程继承来的状态
+	void abandon();
+
+private:
+	// 当前段在 offset_ 处结束, 下一段由此开始
+	void cut( uint64_t offset_ );
+	// 某时刻本地时间相对UTC的偏移(纳秒), 每秒只查一次时区
+	int64_t utc_off( int64_t ns_ );
+
+	int							_fd = -1;
+	size_t						_every = 0;
+	int64_t						_every_ns = 0;
+	size_t						_lines = 0;		// 当前段的行数
+	int64_t						_since = 0;		// 当前段首行的时戳
+	LogIdxRec_t					_seg {};		// 当前段
+	std::vector<LogIdxRec_t>	_done;			// 已切好, 尚未写进索引的段
+	time_t						_off_secs = -1;	// utc_off 的缓存
+	int64_t						_off_ns = 0;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,506 @@
+#include <cerrno>		// errno, EINTR
+#include <algorithm>	// min
+#include <climits>		// IOV_MAX
+#include <cstdlib>		// aligned_alloc
+#include <cstring>		// memcpy, memmove, memset, strerror
+#include <fcntl.h>		// open, fallocate, O_DIRECT
+#include <iostream>
+#include <sys/mman.h>	// mmap, munmap
+#include <sys/stat.h>	// fstat, stat
+#include <unistd.h>		// close, fdatasync, ftruncate, pread, pwrite
+
+#include "LogOutput.hpp"
+
+namespace leon_log {
+
+bool LogOutput_t::open( str_cr file_ ) {
+	close();
+	_fd = ::open( file_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+	_owns_fd = true;
+	_failed = false;
+	_recovered = false;
+	_opened_size = 0;
+	_appended = 0;
+	if( _fd < 0 ) {
+		std::cerr << "打开日志文件(" << file_ << ")失败:" << std::strerror( errno ) << std::endl;
+		return false;
+	}
+	struct stat st;
+	_opened_size = fstat( _fd, &st ) == 0 ? st.st_size : 0;
+	return true;
+};
+
+bool LogOutput_t::open_mapped( str_cr file_ ) {
+	close();
+	_fd = ::open( file_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+	_owns_fd = true;
+	_failed = false;
+	_recovered = false;
+	_opened_size = 0;
+	_appended = 0;
+	if( _fd < 0 ) {
+		std::cerr << "打开日志文件(" << file_ << ")失败:" << std::strerror( errno ) << std::endl;
+		return false;
+	}
+	struct stat st;
+	uint64_t end = fstat( _fd, &st ) == 0 ? st.st_size : 0;
+
+	// 已提交位置头也映射进来, 更新它只是一次内存写
+	_head_file = file_ + ".mmhd";
+	void* head = MAP_FAILED;
+	int head_fd = ::open( _head_file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+	if( head_fd >= 0 ) {
+		if( ftruncate( head_fd, sizeof( MmapHead_t ) ) == 0 )
+			head = mmap( nullptr, sizeof( MmapHead_t ), PROT_READ | PROT_WRITE, MAP_SHARED, head_fd, 0 );
+		::close( head_fd );
+	}
+	if( head == MAP_FAILED ) {
+		unlink( _head_file.c_str() );
+		fcntl( _fd, F_SETFL, fcntl( _fd, F_GETFL ) | O_APPEND );
+		_opened_size = end;
+		return true;
+	}
+	_head = static_cast<MmapHead_t*>( head );
+
+	// 头还在, 说明上次没能正常关闭: 其后是预分配的空白(或写了一半的内容), 截掉
+	if( std::memcmp( _head->magic, MMAP_HEAD_MAGIC, sizeof( _head->magic ) ) == 0
+			&& _head->committed <= end ) {
+		end = _head->committed;
+		ftruncate( _fd, end );
+		_recovered = true;
+	}
+	std::memcpy( _head->magic, MMAP_HEAD_MAGIC, sizeof( _head->magic ) );
+	_head->committed = end;
+	_opened_size = end;
+
+	map_window( end, 0 );
+	return true;
+};
+
+bool LogOutput_t::open_direct( str_cr file_ ) {
+	close();
+	// 暂存区容量取整到块, 地址按块对齐
+	size_t capa = ( _buf_capa + DIRECT_ALIGN - 1 ) / DIRECT_ALIGN * DIRECT_ALIGN;
+	if( !_dbuf )
+		_dbuf.reset( static_cast<char*>( std::aligned_alloc( DIRECT_ALIGN, capa ) ) );
+	_fd = _dbuf ? ::open( file_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_DIRECT, 0644 ) : -1;
+	if( _fd < 0 && ( !_dbuf || errno == EINVAL ) )
+		return open( file_ );	// 文件系统不支持 O_DIRECT
+	_owns_fd = true;
+	_failed = false;
+	_recovered = false;
+	_opened_size = 0;
+	_appended = 0;
+	if( _fd < 0 ) {
+		std::cerr << "打开日志文件(" << file_ << ")失败:" << std::strerror( errno ) << std::endl;
+		return false;
+	}
+	_data = _dbuf.get();
+	_capa = capa;
+
+	// 上次没能正常关闭的, 尾部是末块补的0(文本日志里不会有0), 截掉
+	struct stat st;
+	uint64_t size = fstat( _fd, &st ) == 0 ? st.st_size : 0;
+	uint64_t end = trim_zeros( size );
+	if( end < size ) {
+		ftruncate( _fd, end );
+		_recovered = true;
+	}
+
+	// 末尾不足一块的读回暂存区, 下次写出时连同新内容重写这一块
+	_blk_off = end / DIRECT_ALIGN * DIRECT_ALIGN;
+	_used = end - _blk_off;
+	if( _used > 0 && pread( _fd, _data, DIRECT_ALIGN, _blk_off ) != static_cast<ssize_t>( _used ) ) {
+		::close( _fd );
+		_fd = -1;
+		_data = nullptr;
+		_used = 0;
+		return open( file_ );
+	}
+	_on_disk = _used;
+	_alloc_end = end;
+	_direct = true;
+	_opened_size = end;
+	return true;
+};
+
+uint64_t LogOutput_t::trim_zeros( uint64_t size_ ) {
+	// 从后往前, 一次读一暂存区(O_DIRECT 读也须对齐)
+	uint64_t end = size_;
+	while( end > 0 ) {
+		uint64_t from = ( end - 1 ) / _capa * _capa;
+		ssize_t n = pread( _fd, _data, _capa, from );
+		if( n <= 0 || static_cast<uint64_t>( n ) < end - from )
+			break;
+		size_t len = end - from;
+		while( len > 0 && _data[len - 1] == '\0' )
+			--len;
+		if( len > 0 )
+			return from + len;
+		end = from;
+	}
+	return end;
+};
+
+void LogOutput_t::prealloc( uint64_t end_ ) {
+	if( end_ <= _alloc_end )
+		return;
+	// 一次预分配一大段: 文件在磁盘上连续, 写入时也不必次次分配块、更新元数据.
+	// 不改变文件长度, 别人读到的(及进程被杀后留下的)只有已写出的内容
+	uint64_t to = ( end_ / DIRECT_EXTENT + 1 ) * DIRECT_EXTENT;
+	if( fallocate( _fd, FALLOC_FL_KEEP_SIZE, _alloc_end, to - _alloc_end ) == 0 )
+		_alloc_end = to;
+	else
+		_alloc_end = UINT64_MAX;	// 不支持(或磁盘满), 不再尝试, 由写入扩展文件
+};
+
+bool LogOutput_t::write_direct() {
+	// 长度须是整块, 末块不足的补0
+	size_t len = ( _used + DIRECT_ALIGN - 1 ) / DIRECT_ALIGN * DIRECT_ALIGN;
+	std::memset( _data + _used, 0, len - _used );
+	prealloc( _blk_off + len );
+
+	bool ok = true;
+	for( size_t done = 0; done < len; ) {
+		ssize_t n = pwrite( _fd, _data + done, len - done, _blk_off + done );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 ) {
+			if( !_failed ) {
+				_failed = true;
+				std::cerr << "写日志失败(fd=" << _fd << "):" << std::strerror( errno ) << std::endl;
+			}
+			ok = false;
+			break;
+		}
+		done += n;
+	}
+
+	// 没写成的丢掉(与普通方式一样), 只留已在文件里的; 写入位置不动, 下次从原处重写, 不留空洞
+	if( !ok ) {
+		_used = _on_disk;
+		return false;
+	}
+	// 整块已落盘, 不足一块的尾巴挪到暂存区开头
+	size_t full = _used / DIRECT_ALIGN * DIRECT_ALIGN;
+	std::memmove( _data, _data + full, _used - full );
+	_blk_off += full;
+	_used -= full;
+	_on_disk = _used;
+	return true;
+};
+
+void LogOutput_t::attach( int fd_ ) {
+	close();
+	_fd = fd_;
+	_owns_fd = false;
+	_failed = false;
+};
+
+void LogOutput_t::close() {
+	flush();
+	if( _mapped )
+		unmap_all();
+	// 截掉末块补的0, 并释放预分配的空间
+	if( _direct )
+		ftruncate( _fd, _blk_off + _used );
+	_direct = false;
+	if( _fd >= 0 && _owns_fd )
+		::close( _fd );
+	_fd = -1;
+	_data = nullptr;
+	_used = 0;
+};
+
+void LogOutput_t::abandon() {
+	// 映射的文件窗口及头仍归父进程, 只解除本进程的映射
+	if( _mapped )
+		munmap( _data, _capa );
+	if( _head != nullptr )
+		munmap( _head, sizeof( MmapHead_t ) );
+	_mapped = false;
+	_head = nullptr;
+	_direct = false;
+	if( _fd >= 0 && _owns_fd )
+		::close( _fd );
+	_fd = -1;
+	_data = nullptr;
+	_used = 0;
+	_pending = 0;
+	_iovs.clear();
+};
+
+bool LogOutput_t::map_window( uint64_t pos_, size_t need_ ) {
+	// 换窗口之前, 引用旧窗口的须先写出, 已写的内容要先提交
+	if( _referrer != nullptr && _referrer->pending() > 0 )
+		_referrer->flush();
+	if( _mapped ) {
+		_head->committed = pos_;
+		munmap( _data, _capa );
+		_data = nullptr;
+		_mapped = false;
+	}
+
+	static const uint64_t page = sysconf( _SC_PAGESIZE );
+	uint64_t start = pos_ / page * page;
+	size_t len = std::max<size_t>( LOG_MMAP_WINDOW, ( pos_ - start + need_ + page - 1 ) / page * page );
+
+	// 先给窗口分配好磁盘空间, 否则磁盘满时写映射内存会招来 SIGBUS
+	void* p = MAP_FAILED;
+	int err = posix_fallocate( _fd, start, len );
+	if( err == 0 ) {
+		p = mmap( nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, start );
+		err = errno;
+	}
+	if( p == MAP_FAILED ) {
+		// 映射不了(磁盘满, 或是 /dev/null 之类), 退回普通写文件方式
+		std::cerr << "日志文件无法内存映射, 改用普通写入:" << std::strerror( err ) << std::endl;
+		ftruncate( _fd, pos_ );
+		fcntl( _fd, F_SETFL, fcntl( _fd, F_GETFL ) | O_APPEND );
+		munmap( _head, sizeof( MmapHead_t ) );
+		_head = nullptr;
+		unlink( _head_file.c_str() );
+		_used = 0;
+		return false;
+	}
+
+	_data = static_cast<char*>( p );
+	_mapped = true;
+	_map_off = start;
+	_capa = len;
+	_used = pos_ - start;
+	return true;
+};
+
+void LogOutput_t::unmap_all() {
+	uint64_t end = _map_off + _used;
+	munmap( _data, _capa );
+	_data = nullptr;
+	_mapped = false;
+
+	// 先截掉预分配的空白, 再删头文件, 其间崩溃也无妨
+	ftruncate( _fd, end );
+	munmap( _head, sizeof( MmapHead_t ) );
+	_head = nullptr;
+	unlink( _head_file.c_str() );
+};
+
+const char* LogOutput_t::append( const void* data_, size_t size_ ) {
+	_appended += size_;
+
+	// 内存映射方式: 直接拷进文件窗口, 窗口不够就往后换一个(换不成就退回普通方式)
+	if( _mapped && _used + size_ > _capa )
+		map_window( _map_off + _used, size_ );
+	if( _mapped ) {
+		char* dest = _data + _used;
+		std::memcpy( dest, data_, size_ );
+		_used += size_;
+		return dest;
+	}
+
+	// O_DIRECT 方式: 暂存区满了就写出. 比暂存区还大的, 分段拷进来写出
+	if( _direct ) {
+		if( _used + size_ > _capa )
+			flush();
+		if( _used + size_ <= _capa ) {
+			char* dest = _data + _used;
+			std::memcpy( dest, data_, size_ );
+			_used += size_;
+			_pending += size_;
+			return dest;
+		}
+		for( const char* src = static_cast<const char*>( data_ ); size_ > 0; ) {
+			size_t n = std::min( size_, _capa - _used );
+			std::memcpy( _data + _used, src, n );
+			_used += n;
+			_pending += n;
+			src += n;
+			size_ -= n;
+			if( _used == _capa ) {
+				write_direct();
+				_pending = _used;
+			}
+		}
+		return nullptr;
+	}
+
+	if( _data == nullptr ) [[unlikely]] {
+		if( !_buf )
+			_buf = std::make_unique<char[]>( _buf_capa );
+		_data = _buf.get();
+		_capa = _buf_capa;
+	}
+
+	// 比整个缓冲区还大, 就不拷贝了, 先写出之前的, 再直接写它
+	if( size_ > _capa ) {
+		flush();
+		iovec iov { const_cast<void*>( data_ ), size_ };
+		writev_all( &iov, 1 );
+		return nullptr;
+	}
+
+	if( _used + size_ > _capa )
+		flush();
+
+	char* dest = _data + _used;
+	std::memcpy( dest, data_, size_ );
+	_used += size_;
+	refer( dest, size_ );
+	return dest;
+};
+
+void LogOutput_t::refer( const char* data_, size_t size_ ) {
+	// 与上一段首尾相接的, 并作一段
+	if( !_iovs.empty() ) {
+		iovec& last = _iovs.back();
+		if( static_cast<const char*>( last.iov_base ) + last.iov_len == data_ ) {
+			last.iov_len += size_;
+			_pending += size_;
+			return;
+		}
+	}
+	_iovs.push_back( { const_cast<char*>( data_ ), size_ } );
+	_pending += size_;
+};
+
+bool LogOutput_t::flush() {
+	// 引用了本缓冲区的输出须先写出, 之后本缓冲区才能腾空
+	if( _referrer != nullptr && _referrer->pending() > 0 )
+		_referrer->flush();
+
+	// 内存映射方式下内容早已在文件里, 只需提交
+	if( _mapped ) {
+		_head->committed = _map_off + _used;
+		return true;
+	}
+	if( _direct ) {
+		bool ok = _pending == 0 || write_direct();
+		_pending = 0;
+		return ok;
+	}
+
+	bool ok = true;
+	if( !_iovs.empty() )
+		ok = writev_all( _iovs.data(), _iovs.size() );
+	_iovs.clear();
+	_used = 0;
+	_pending = 0;
+	return ok;
+};
+
+bool LogOutput_t::sync() {
+	// 内存映射方式下, 追加的内容都在页缓存里, 一并写回
+	while( _fd >= 0 && fdatasync( _fd ) != 0 )
+		if( errno != EINTR )
+			return false;
+	return _fd >= 0;
+};
+
+bool LogOutput_t::moved( str_cr file_ ) const {
+	struct stat opened, now;
+	if( _fd < 0 || fstat( _fd, &opened ) != 0 )
+		return false;
+	return stat( file_.c_str(), &now ) != 0 || now.st_ino != opened.st_ino || now.st_dev != opened.st_dev;
+};
+
+// 崩溃时用: 写完整段(off_ 为 UINT64_MAX 则追加), 只调 write/pwrite
+static bool CrashWriteAll( int fd_, const char* data_, size_t size_, uint64_t off_ ) {
+	while( size_ > 0 ) {
+		ssize_t n = off_ == UINT64_MAX ? ::write( fd_, data_, size_ ) : ::pwrite( fd_, data_, size_, off_ );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			return false;
+		data_ += n;
+		size_ -= n;
+		if( off_ != UINT64_MAX )
+			off_ += n;
+	}
+	return true;
+};
+
+bool LogOutput_t::crash_flush() {
+	if( _fd < 0 )
+		return false;
+
+	// 内存映射方式: 内容早已在文件里, 提交即可, 之后用 pwrite 接着写(与映射同在页缓存里)
+	if( _mapped ) {
+		_crash_off = _map_off + _used;
+		_head->committed = _crash_off;
+		return true;
+	}
+
+	// O_DIRECT 方式: 暂存区按整块写出, 再去掉 O_DIRECT, 之后就能从真正的末尾不按块写了
+	if( _direct ) {
+		if( _used > _on_disk ) {
+			size_t len = ( _used + DIRECT_ALIGN - 1 ) / DIRECT_ALIGN * DIRECT_ALIGN;
+			std::memset( _data + _used, 0, len - _used );
+			if( !CrashWriteAll( _fd, _data, len, _blk_off ) )
+				return false;
+		}
+		_crash_off = _blk_off + _used;
+		return fcntl( _fd, F_SETFL, fcntl( _fd, F_GETFL ) & ~O_DIRECT ) == 0;
+	}
+
+	// 普通方式: 逐段写出缓冲(及引用)的内容. 文件是追加方式打开的, 之后接着追加
+	for( const iovec& iov : _iovs )
+		if( !CrashWriteAll( _fd, static_cast<const char*>( iov.iov_base ), iov.iov_len, UINT64_MAX ) )
+			return false;
+	_iovs.clear();
+	_used = 0;
+	_pending = 0;
+	return true;
+};
+
+void LogOutput_t::crash_write( const char* data_, size_t size_ ) {
+	if( _mapped || _direct ) {
+		if( CrashWriteAll( _fd, data_, size_, _crash_off ) )
+			_crash_off += size_;
+	} else
+		CrashWriteAll( _fd, data_, size_, UINT64_MAX );
+};
+
+void LogOutput_t::crash_close( bool sync_ ) {
+	if( sync_ )
+		fdatasync( _fd );
+	// 截掉预分配的空白(及末块补的0). 内存映射方式的头文件留着, 下次启动照常修复并注明上次没能正常关闭
+	if( _mapped )
+		_head->committed = _crash_off;
+	if( _mapped || _direct )
+		ftruncate( _fd, _crash_off );
+};
+
+bool LogOutput_t::writev_all( iovec* iovs_, size_t count_ ) {
+	if( _fd < 0 )
+		return false;
+
+	while( count_ > 0 ) {
+		ssize_t n = ::writev( _fd, iovs_, static_cast<int>( std::min<size_t>( count_, IOV_MAX ) ) );
+		if( n < 0 ) {
+			if( errno == EINTR )
+				continue;
+			if( !_failed ) {
+				_failed = true;
+				std::cerr << "写日志失败(fd=" << _fd << "):" << std::strerror( errno ) << std::endl;
+			}
+			return false;
+		}
+
+		// 跳过已写完的段, 部分写入的段调整起点后重写
+		size_t done = static_cast<size_t>( n );
+		while( count_ > 0 && done >= iovs_->iov_len ) {
+			done -= iovs_->iov_len;
+			++iovs_;
+			--count_;
+		}
+		if( count_ > 0 ) {
+			iovs_->iov_base = static_cast<char*>( iovs_->iov_base ) + done;
+			iovs_->iov_len -= done;
+		}
+	}
+	return true;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
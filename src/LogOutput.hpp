@@ -0,0 +1,146 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>	// free
+#include <memory>
+#include <sys/uio.h>	// iovec
+#include <vector>
+
+#include "leonlog/LeonLog.hpp"
+
+namespace leon_log {
+
+// 日志文件输出缓冲区的容量
+constexpr size_t LOG_OUT_BUF_SIZE = 1 << 20;
+// stdout 输出缓冲区的容量(只有二进制日志才需要另行拷贝文本)
+constexpr size_t STO_OUT_BUF_SIZE = 1 << 16;
+// 内存映射方式下, 每次映射(并预分配)的文件窗口大小
+constexpr size_t LOG_MMAP_WINDOW = 16 << 20;
+// O_DIRECT 方式下, 写入的对齐单位(文件位置、长度及暂存区地址都须按它对齐)
+constexpr size_t DIRECT_ALIGN = 4096;
+// O_DIRECT 方式下, 每次预分配的磁盘空间
+constexpr uint64_t DIRECT_EXTENT = 64 << 20;
+
+// 内存映射方式的"已提交位置"头, 存于日志文件旁的 ".mmhd" 文件. 正常关闭时删除,
+// 下次启动若发现它还在, 说明上次没能正常关闭, 日志文件按头里记录的位置截断
+constexpr char MMAP_HEAD_MAGIC[] = "LEONLOGM";
+struct MmapHead_t {
+	char		magic[8];
+	uint64_t	committed;	// 此前的内容均已完整写入
+};
+
+/* LogOutput_t: 日志线程的输出引擎, 直接操作文件描述符
+   日志线程每清空一轮队列, 所有日志先追加到本对象的大缓冲区, 一轮结束再 flush, 一次 writev 写出.
+   除了拷贝进来的内容, 也可以"引用"别处的内存(比如 stdout 引用日志文件缓冲区里的行),
+   被引用者须在本对象 flush 之前保持不变. 为此被引用者要腾空缓冲区时, 会先 flush 引用者.
+   以内存映射方式打开时, "缓冲区"就是映射进来的文件窗口, 追加即写入(由内核负责落盘),
+   flush 只是更新已提交位置, 没有写文件的系统调用, 进程被杀也不丢已追加的内容.
+   以 O_DIRECT 方式打开时, "缓冲区"是按块对齐的暂存区, flush 按整块绕过页缓存写出(末块补0凑整),
+   不足一块的尾巴留在暂存区, 下次连同新内容重写那一块. 文件按 DIRECT_EXTENT 大段预分配(不改变文件长度),
+   关闭时释放. 写失败的内容丢弃, 写入位置不前移, 文件中间不会留下空洞.
+   本类只供日志线程使用, 不是线程安全的 */
+class LogOutput_t {
+public:
+	explicit LogOutput_t( size_t capa_ ) : _capa( capa_ ), _buf_capa( capa_ ) {};
+	~LogOutput_t() { close(); };
+
+	LogOutput_t( const LogOutput_t& ) = delete;
+	LogOutput_t& operator=( const LogOutput_t& ) = delete;
+
+	// 以追加方式打开(必要时创建)文件, 失败返回 false
+	bool open( str_cr file_ );
+	// 以内存映射方式打开(必要时创建)文件, 上次未能正常关闭的先行修复. 无法映射时退回 open
+	bool open_mapped( str_cr file_ );
+	// 以 O_DIRECT 方式打开(必要时创建)文件, 上次未能正常关闭留下的尾部空白先行截掉. 文件系统不支持时退回 open
+	bool open_direct( str_cr file_ );
+	// 使用一个已打开的文件描述符(比如 STDOUT_FILENO), 关闭时不会 close 它
+	void attach( int fd_ );
+	// 写出缓冲内容并关闭
+	void close();
+	// 不写出也不截断, 直接丢掉缓冲内容(及映射)并关闭. 供 fork 出的子进程扔掉从父进程继承来的状态
+	void abandon();
+	bool is_open() const { return _fd >= 0; };
+	// 打开时文件已有内容的长度(内存映射方式下为修复后的长度)
+	uint64_t opened_size() const { return _opened_size; };
+	// 打开时发现上次未能正常关闭(仅内存映射及 O_DIRECT 方式)
+	bool recovered() const { return _recovered; };
+	// 文件当前(含尚在缓冲区里)的长度: 打开时的长度加上此后追加的. 关闭后仍保留, 直至再次打开
+	uint64_t size() const { return _opened_size + _appended; };
+
+	// 指定引用本对象缓冲区的另一个输出, 本对象腾空缓冲区之前会先让它 flush
+	void referred_by( LogOutput_t* other_ ) { _referrer = other_; };
+
+	// 拷贝一段内容进缓冲区, 返回其在缓冲区内的地址.
+	// 内容比整个缓冲区还大时直接写出, 返回 nullptr
+	const char* append( const void* data_, size_t size_ );
+	// 引用一段外部内存, 不拷贝
+	void refer( const char* data_, size_t size_ );
+
+	// 把已缓冲(及引用)的内容写出, 返回是否全部写成功
+	bool flush();
+	// 尚未写出的字节数
+	size_t pending() const { return _pending; };
+	// 把已写出的内容落到盘上(fdatasync), 返回是否成功. 尚在缓冲区里的不算
+	bool sync();
+	// 路径 file_ 已不指向所打开的文件(被改名、删除或换成了别的文件)
+	bool moved( str_cr file_ ) const;
+
+	// 以下供崩溃时的信号处理函数用: 只调异步信号安全的系统调用, 不分配内存、不加锁、不输出错误.
+	// crash_flush 写出(或提交)尚未写出的内容, 失败返回 false; 此后 crash_write 直接写进文件,
+	// 最后 crash_close 落盘(sync_ 时)并截掉预分配的空白. 之后本对象不可再用
+	bool crash_flush();
+	void crash_write( const char* data_, size_t size_ );
+	void crash_close( bool sync_ );
+
+private:
+	// 把若干段内容全部写出(处理好部分写入及信号中断)
+	bool writev_all( iovec* iovs_, size_t count_ );
+
+	// 映射从文件位置 pos_ 起(至少 need_ 字节)的窗口, 失败则退回普通写文件方式
+	bool map_window( uint64_t pos_, size_t need_ );
+	// 解除映射, 文件截断至已提交位置
+	void unmap_all();
+
+	// O_DIRECT 方式: 暂存区按整块写出, 不足一块的尾巴挪回暂存区开头
+	bool write_direct();
+	// O_DIRECT 方式: 确保文件至少已预分配至 end_
+	void prealloc( uint64_t end_ );
+	// O_DIRECT 方式: 文件(长 size_)去掉尾部的0之后的长度
+	uint64_t trim_zeros( uint64_t size_ );
+
+	std::unique_ptr<char[]>	_buf;
+	char*					_data = nullptr;	// 当前缓冲区: _buf, 或映射的文件窗口
+	size_t					_capa;
+	const size_t			_buf_capa;
+	size_t					_used = 0;
+	size_t					_pending = 0;
+	std::vector<iovec>		_iovs;
+	LogOutput_t*			_referrer = nullptr;
+	int						_fd = -1;
+	bool					_owns_fd = false;
+	bool					_failed = false;	// 已报告过写失败, 避免刷屏
+	uint64_t				_opened_size = 0;
+	uint64_t				_appended = 0;
+	bool					_recovered = false;
+
+	// 以下仅用于内存映射方式
+	bool					_mapped = false;
+	uint64_t				_map_off = 0;		// 映射窗口在文件中的起始位置
+	MmapHead_t*				_head = nullptr;
+	str_t					_head_file;
+
+	// 以下仅用于 O_DIRECT 方式
+	struct FreeDel_t { void operator()( char* p_ ) const { std::free( p_ ); }; };
+	std::unique_ptr<char, FreeDel_t>	_dbuf;	// 按块对齐的暂存区
+	bool					_direct = false;
+	uint64_t				_blk_off = 0;		// 暂存区开头在文件中的位置(块对齐)
+	size_t					_on_disk = 0;		// 暂存区开头已在文件里的字节数(上次写出的末块)
+	uint64_t				_alloc_end = 0;		// 已预分配至文件何处
+
+	// 崩溃时(内存映射及 O_DIRECT 方式)接着写的位置
+	uint64_t				_crash_off = 0;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,106 @@
+#include <unistd.h>		// STDOUT_FILENO, STDERR_FILENO
+
+#include "LogSink.hpp"
+
+namespace leon_log {
+
+bool LogSink_t::start() {
+	if( _target == "stdout" )
+		_out.attach( STDOUT_FILENO );
+	else if( _target == "stderr" )
+		_out.attach( STDERR_FILENO );
+	else if( !_out.open( _target ) )
+		return false;
+
+	if( _async ) {
+		_stop = false;
+		_thread = std::thread( &LogSink_t::thread_body, this );
+	}
+	_opened = true;
+	return true;
+};
+
+void LogSink_t::stop() {
+	if( _thread.joinable() ) {
+		{
+			std::lock_guard<std::mutex> lk( _mtx );
+			_stop = true;
+		}
+		_cv.notify_one();
+		_thread.join();
+	}
+	_out.close();
+	_opened = false;
+	_staged.clear();
+	_staged_lines = 0;
+	_handed.clear();
+};
+
+void LogSink_t::put( const char* line_, size_t size_ ) {
+	if( !_async ) {
+		_out.append( line_, size_ );
+		return;
+	}
+	_staged.append( line_, size_ );
+	++_staged_lines;
+};
+
+void LogSink_t::flush() {
+	if( !_async ) {
+		_out.flush();
+		return;
+	}
+	if( _staged.empty() )
+		return;
+
+	bool handed = false;
+	{
+		std::lock_guard<std::mutex> lk( _mtx );
+		if( _handed.size() + _staged.size() <= SINK_BUF_SIZE ) {
+			_handed.append( _staged );
+			handed = true;
+		}
+	}
+	if( handed )
+		_cv.notify_one();
+	else
+		_dropped.fetch_add( _staged_lines, std::memory_order_relaxed );
+	_staged.clear();
+	_staged_lines = 0;
+};
+
+uint64_t LogSink_t::take_dropped() {
+	uint64_t dropped = _dropped.load( std::memory_order_relaxed );
+	uint64_t fresh = dropped - _dropped_told;
+	_dropped_told = dropped;
+	return fresh;
+};
+
+void LogSink_t::thread_body() {
+	RegistThread( "LogSink" );
+
+	// 与日志线程一样, 不与业务线程争抢
+	nice( 19 );
+
+	str_t writing;
+	writing.reserve( SINK_BUF_SIZE );
+	bool stopping = false;
+	while( !stopping ) {
+		{
+			std::unique_lock<std::mutex> lk( _mtx );
+			_cv.wait( lk, [this] { return _stop || !_handed.empty(); } );
+			writing.swap( _handed );
+			stopping = _stop;
+		}
+		// 写的时候不持锁, 日志线程照常交接
+		if( !writing.empty() ) {
+			_out.append( writing.data(), writing.size() );
+			_out.flush();
+			writing.clear();
+		}
+	}
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "leonlog/LeonLog.hpp"
+#include "LogOutput.hpp"
+
+namespace leon_log {
+
+// 异步输出交给输出线程、尚未写出的内容最多这么多, 再多就丢弃
+constexpr size_t SINK_BUF_SIZE = 4 << 20;
+
+/* LogSink_t: 日志文件之外的一个输出(文件, 或 stdout/stderr), 只接收不低于某级别的日志
+   日志线程把每条日志格式化一次, 分发给所有想要它的输出. 同步输出由日志线程直接写;
+   异步输出有自己的线程: 日志线程把一轮的行先暂存在本地, 一轮结束才加锁交接一次,
+   输出线程换出交来的内容慢慢写. 输出再慢也只会让交接缓冲区满, 满了就丢弃, 不会拖住日志线程 */
+class LogSink_t {
+public:
+	LogSink_t( str_cr target_, LogLevel_e level_, bool async_ )
+		: _target( target_ ), _level( level_ ), _async( async_ ), _out( STO_OUT_BUF_SIZE ) {};
+	~LogSink_t() { stop(); };
+
+	LogSink_t( const LogSink_t& ) = delete;
+	LogSink_t& operator=( const LogSink_t& ) = delete;
+
+	str_cr target() const { return _target; };
+	LogLevel_e level() const { return _level; };
+	bool async() const { return _async; };
+	bool wants( LogLevel_e level_ ) const { return _opened && level_ >= _level; };
+
+	// 打开输出, 异步的还要启动输出线程. 打不开返回 false
+	bool start();
+	// 写完已交来的内容, 停止输出线程, 关闭输出
+	void stop();
+
+	// 以下只供日志线程调用
+	// 追加一行
+	void put( const char* line_, size_t size_ );
+	// 本轮的内容写出(同步), 或交给输出线程(异步)
+	void flush();
+	// 自上次调用以来因交接缓冲区满而丢弃的行数
+	uint64_t take_dropped();
+
+private:
+	void thread_body();
+
+	const str_t				_target;
+	const LogLevel_e		_level;
+	const bool				_async;
+	LogOutput_t				_out;	// 同步时归日志线程, 异步时归输出线程
+	bool					_opened = false;
+
+	// 异步: 日志线程本轮暂存的, 及已交接而输出线程尚未取走的
+	str_t					_staged;
+	size_t					_staged_lines = 0;
+	str_t					_handed;
+	std::mutex				_mtx;
+	std::condition_variable	_cv;
+	bool					_stop = false;
+	std::thread				_thread;
+	std::atomic<uint64_t>	_dropped { 0 };
+	uint64_t				_dropped_told = 0;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -1,31 +1,51 @@
-#include <algorithm>    // for_each, max, min, sort, swap
+#include <algorithm>    // all_of, for_each, max, min, sort, swap
 #include <atomic>
-#include <cerrno>		// errno
+#include <bit>			// bit_width
+#include <cerrno>		// errno, program_invocation_short_name
 #include <chrono>
 #include <cmath>		// abs, ceil, floor, isnan, log, log10, pow, round, sqrt
+#include <charconv>		// to_chars
+#include <csignal>		// sigaction, raise
 #include <cstring>		// strlen, strncmp, strncpy, memset, memcpy, memmove, strerror
+#include <fcntl.h>		// open
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <leonutils/Chrono.hpp>
 #include <leonutils/CpuAffinity.hpp>
-#include <leonutils/CraflinRQ.tpp>
 #include <leonutils/Exceptions.hpp>
 #include <leonutils/MemoryOrder.hpp>
 #include <memory>
 #include <mutex>
-#include <semaphore.h>
+#include <new>			// placement new
+#include <pthread.h>		// pthread_atfork
 #include <shared_mutex>
+#include <string_view>
 #include <sys/syscall.h>	// SYS_gettid
 #include <sys/sysinfo.h>	// get_nprocs
+#include <sys/uio.h>		// writev
 #include <thread>
 #include <unistd.h>		// syscall
+#include <unordered_map>
+#include <vector>
 
 #include "leonlog/LeonLog.hpp"
 #include "leonlog/LeonLogVer.hpp"
+#include "leonlog/LogFmt.hpp"
+#include "leonlog/LogStats.hpp"
+#include "leonlog/SharedLog.hpp"
 #include "leonlog/StatusFile.hpp"
 #include "leonlog/ThreadName.hpp"
+#include "Compressor.hpp"
+#include "EventCount.hpp"
+#include "LogDedup.hpp"
+#include "LogEntry.hpp"
+#include "LogIndexer.hpp"
+#include "LogOutput.hpp"
+#include "LogSink.hpp"
+#include "SharedRing.hpp"
+#include "SpscRQ.tpp"
 
 using namespace leon_utl;
 using namespace std::chrono;
@@ -37,37 +57,91 @@ using aptid_t = std::atomic<pthread_t>;
 using ofs_t = std::ofstream;
 using std::cerr;
 using std::endl;
+using std::make_shared;
 using std::make_unique;
 using std::max;
 using std::min;
 using std::shared_lock;
 using std::shared_mutex;
+using std::shared_ptr;
+using std::string_view;
 using std::thread;
 using std::unique_lock;
 using std::unique_ptr;
+using std::vector;
 
 namespace leon_log {
 
 //###### 各种类型 ###############################################################
 
-// LogEntry: 定义一条日志记录所具有的基本内容
-struct LogEntry_t {
-	LogStamp_t	stamp;	// 日志产生时间
-	str_t		tname;	// 产生日志的线程
-	str_t		body;	// 日志内容
-	LogLevel_e	level;	// 日志级别
+// LogQue_t: 日志队列(每个产生日志的线程独占一个, 唯一的消费者是日志线程)
+using LogQue_t = SpscRQ_t<LogEntry_t>;
 
-	template <typename T>
-	LogEntry_t( LogStamp_t stamp_, str_cr thread_, T&& body_, LogLevel_e level_ ):
-		stamp( stamp_ ),
-		tname( thread_ ),
-		body( std::forward<T>( body_ ) ),
-		level( level_ )
-	{};
+// ProducerStats_t: 生产者一侧的计数. 只由所属线程写(读了再写, 不做原子加, 不争抢), 取快照时别的线程读
+struct ProducerStats_t {
+	using ctr_t = std::atomic<uint64_t>;
+	ctr_t		enqueued[LogLevel_e::VALUES_COUNT] {};
+	ctr_t		retries[LogLevel_e::VALUES_COUNT] {};
+	ctr_t		spilled[LogLevel_e::VALUES_COUNT] {};
+	ctr_t		enque_ns[LogStats_t::LATENCY_BUCKETS] {};
+	uint32_t	tick = 0;	// 入队计数, 用于抽样(只有所属线程访问)
+
+	static void bump( ctr_t& c_ ) {
+		c_.store( c_.load( mo_relaxed ) + 1, mo_relaxed );
+	};
+	// 累加至快照
+	void add_to( LogStats_t& st_ ) const {
+		for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l ) {
+			st_.enqueued[l] += enqueued[l].load( mo_relaxed );
+			st_.retries[l] += retries[l].load( mo_relaxed );
+			st_.spilled[l] += spilled[l].load( mo_relaxed );
+		}
+		for( size_t b = 0; b < LogStats_t::LATENCY_BUCKETS; ++b )
+			st_.enque_ns[b] += enque_ns[b].load( mo_relaxed );
+	};
+};
+
+// ThreadQue_t: 某个线程的日志队列, 及其归属状态
+struct ThreadQue_t {
+	LogQue_t	que;
+	// 所属线程已退出, 日志线程清空此队列后即可将其注销
+	abool_t		orphan { false };
+	// 队满时(Overflow_e::EvictLower)所属线程请日志线程丢弃本队列中低于 evict_below 级别的日志,
+	// 每等着一条挤掉一条, evict_need 是尚欠的条数
+	std::atomic<int>		evict_below { 0 };
+	std::atomic<uint32_t>	evict_need { 0 };
+	// 所属线程的计数, 与队列的读写指针分开, 免得伪共享
+	alignas( 64 ) ProducerStats_t	stats;
+
+	explicit ThreadQue_t( size_t capa_ ) : que( capa_ ) {};
+};
+using ThreadQueP_t = shared_ptr<ThreadQue_t>;
+
+// QueHolder_t: 线程局部的队列持有者, 线程退出时把队列标记为"孤儿"
+struct QueHolder_t {
+	ThreadQueP_t	tque;
+	uint64_t		gen = 0;	// 队列所属的"日志系统启动批次"
+
+	~QueHolder_t() {
+		if( tque )
+			tque->orphan.store( true, mo_release );
+	};
 };
 
-// LogQue_t: 日志队列(一个队列服务整个APP)
-using LogQue_t = CraflinRQ_t<LogEntry_t>;
+// OverflowPolicy_t: 某一级别日志在队列满时的处理策略
+struct OverflowPolicy_t {
+	Overflow_e	how;
+	SysDura_t	timeout;	// 最多等待多久
+};
+
+// SpillRec_t: 溢出文件内一条日志的头部, 其后紧跟日志内容(LOGF 的已先格式化), 文件里不存任何地址
+struct SpillRec_t {
+	LogStamp_t		stamp;
+	uint32_t		size;
+	ThreadId_t		tid;
+	uint16_t		kvs;
+	uint8_t			level;
+};
 
 //###### 各种常量 ###############################################################
 
@@ -91,16 +165,86 @@ void WriterThreadBody( str_cp run_on_cpus );
 // 日志线程的核心工作：出队日志，写日志
 void ProcessLogs();
 
-// 写一条日志
-void Write1Log( ofs_t&, const LogEntry_t& );
+// 清空一轮所有线程的日志队列, 按时戳归并后写入输出缓冲区, 返回写出的条数
+size_t DrainQues();
+
+// 写一条日志(至输出缓冲区)
+void Write1Log( const LogEntry_t& );
+
+// 把输出缓冲区写出(日志文件及stdout)
+void FlushOutputs();
+
+// 没有待写的日志时, 睡到有新日志, 或到达截止时间
+void WaitForLogs( const timespec& deadline );
+
+// 日志入队, 队满时按该级别的策略处理
+bool EnqueLog( LogEntry_t& );
+
+// 队列满时, 按该级别的策略处理这条日志, 返回是否最终入队(或溢出至文件)
+bool EnqueOverflow( ThreadQue_t&, LogEntry_t& );
+
+// 把一条日志写入溢出文件
+bool SpillLog( const LogEntry_t& );
+
+// 补写溢出文件中的日志, 返回补写的条数
+size_t ReplaySpill();
+
+// 把自上次报告以来因队列满而丢弃的日志数写进日志
+void ReportDrops();
+
+// 写 Fatal 的线程等日志线程写出(并落盘)它刚入队的日志, 最多等 s_fatal_wait
+void WaitDurable();
+
+// 共享内存日志的生产者: 日志写进环里, 环满时按该级别的策略处理
+bool RingEnque( LogEntry_t& );
+// 收集者: 取出环里的日志写出, 本轮最多取一圈, 返回写出的条数
+size_t DrainRing();
+
+// 发布日志线程一侧最近一个写盘间隔的度量(见 LogStats.hpp)
+void PublishStats();
+// 生产者一侧的计数之和(含已注销的队列), 及此刻各队列内的日志总数
+LogStats_t SumProducerStats();
+
+// 安装/卸载致命信号处理函数
+void InstallCrashHandler();
+void RemoveCrashHandler();
+
+// 致命信号处理函数: 叫停生产者及日志线程, 清空日志队列, 写崩溃标记, 再按原方式重发信号
+void CrashHandler( int );
+
+// 日志线程发现进程正在崩溃, 就此停手, 把队列留给信号处理函数
+[[noreturn]] void ParkWriter();
+
+// fork 处理函数(pthread_atfork): fork 前叫停日志线程、拿住各锁; fork 后父进程放开, 子进程重置并另起日志线程
+void BeforeFork();
+void AfterForkParent();
+void AfterForkChild();
+// 日志线程发现有线程正在 fork, 停在两轮之间等它 fork 完
+void PauseForFork();
+// 子进程的日志文件名: 扩展名前加上 pid
+str_t PerPidFile( str_cr file_, pid_t pid_ );
 
 // 完成一次日志轮转(将当前日志文件保存、关闭、改名)
 void RenameLogFile();
+// 删除超出保留个数的已轮转文件
+void PruneRotated();
+// 从 now_ 算起, 下一个自动轮转的时间边界(按本地时间), 不按时间轮转则为 0
+time_t NextRotateAt( time_t now_ );
+
+// 取得(必要时创建并登记)当前线程的日志队列
+ThreadQue_t& MyLogQue();
+
+// 所有线程日志队列内的日志总数及总容量
+size_t QueuedLogs();
+size_t QuesCapacity();
 
 //###### 各种变量 ###############################################################
 
-// 日志级别
-LogLevel_e	g_log_level = LogLevel_e::Debug;
+// 日志级别各门槛中最低的(见 LogCategory.cpp)
+extern std::atomic<LogLevel_e>	s_log_floor;
+// fork 前后拿住/放开级别表的锁(见 LogCategory.cpp)
+void LockLevels();
+void UnlockLevels();
 
 // 写盘间隔(每隔多少秒确保保存一次)
 decltype( timespec::tv_nsec )	s_flush_ns = 1000000000;	// 单位:纳秒
@@ -108,12 +252,18 @@ decltype( timespec::tv_nsec )	s_flush_ns = 1000000000;	// 单位:纳秒
 unsigned int					s_exit_secs = 3;	// 单位:秒
 // 时戳精度(0~9代表精确到秒的几位小数)
 size_t							s_stamp_pre = 6;
-// 时戳单位(为了截断时戳到指定精度,每次要用的除数)
-uint64_t						s_time_unit = 1;		//多少纳秒
 // 日志文件名, 包含全路径
 str_t							s_log_file;
 // 日志文件名中缀, 用于日志文件轮转
 str_t							s_log_infix;
+// 自动轮转: 文件长度上限(0为不限), 时间边界, 保留个数(0为不限)
+uint64_t						s_rot_bytes = 0;
+Rotate_e						s_rot_every = NoRotate;
+size_t							s_rot_keep = 0;
+// 以下只有日志线程访问: 当前文件开始写的时刻, 下次按时间轮转的时刻, 是否正在自动轮转
+time_t							s_file_since = 0;
+time_t							s_next_rotate = 0;
+bool							s_auto_roll = false;
 // 状态文件名, 包含全路径
 str_t							s_status_file;
 // 状态输出周期
@@ -122,16 +272,62 @@ LogStamp_t::duration			s_status_interval;
 LogStamp_t						s_next_status;
 
 // 给每个线程起个名字,输出的日志内能够看出每条日志都是由谁产生的
-thread_local str_t				tl_t_name = ThreadId2Hex();
+// 线程名只登记一次, 分得一个编号, 日志里只存编号. 名字表只增不改, 日志线程读时无需加锁
+constexpr ThreadId_t			NO_THREAD_ID = 0xFFFF;
+thread_local ThreadId_t			tl_t_id = NO_THREAD_ID;
+str_t							s_t_names[MAX_THREAD_NAMES];	// 编号到线程名的映射
+// 最后一个编号留给名字表满了之后才登记的线程, 它们共用这个名字. 只在此设定一次, 此后不再改写
+constexpr ThreadId_t			TOO_MANY_THREADS = MAX_THREAD_NAMES - 1;
+[[maybe_unused]] const bool		s_too_many_named = ( s_t_names[TOO_MANY_THREADS] = "(线程太多)", true );
+std::atomic<size_t>				s_t_count { 0 };	// 已分配的编号数量
+std::unordered_map<str_t, ThreadId_t>	s_name2id;	// 线程名到编号的映射
 Names2LinuxTId_t				s_t_ids;		// 线程名到t_id的映射
-shared_mutex					s_mtx4nids;		// 更新s_t_ids时的同步控制
+shared_mutex					s_mtx4nids;		// 更新s_t_ids, s_name2id时的同步控制
 
 // 日志时戳,为空就用当前时间
 thread_local const LogStamp_t*	tl_stamp = nullptr;
 
-// 缓存日志的队列,整个系统产生的所有日志都存放于此,等待writer线程来消费
-unique_ptr<LogQue_t>			s_log_que = nullptr;
-unique_ptr<ofs_t>				s_log_ofs = nullptr;
+// 缓存日志的队列,每个线程各自一个,首次添加日志(或登记线程名)时创建,等待writer线程来消费
+vector<ThreadQueP_t>			s_all_ques;
+std::mutex						s_mtx4ques;		// 更新s_all_ques时的同步控制
+std::atomic<uint64_t>			s_ques_ver { 0 };	// s_all_ques 的版本号,每次增删队列都递增
+// 日志线程持有的队列清单快照, 只有它自己改. 它停手后信号处理函数据此抢救, 不碰别的线程正在改的 s_all_ques
+vector<ThreadQueP_t>			s_writer_ques;
+uint64_t						s_writer_ques_ver = 0;
+std::atomic<uint64_t>			s_log_gen { 0 };	// 日志系统启动批次,每次 StartLog 都递增
+size_t							s_que_capa = DEFAULT_LOG_QUE_SIZE;
+thread_local QueHolder_t		tl_que;
+
+// 度量(见 LogStats.hpp): 已注销队列的生产者计数之和(受 s_mtx4ques 保护), StartLog 时的基数
+LogStats_t						s_retired_stats {};
+LogStats_t						s_base_stats {};
+// 日志线程本间隔内的度量(只有日志线程访问), 及每个写盘间隔发布一次的(受 s_mtx4stats 保护)
+struct WriterStats_t {
+	size_t		que_high = 0;
+	int64_t		lag_max = 0;
+	int64_t		lag_sum = 0;
+	uint64_t	lag_count = 0;
+	uint64_t	lines = 0;
+	uint64_t	bytes = 0;
+	uint64_t	syncs = 0;
+	steady_clock::time_point	since = steady_clock::now();
+};
+WriterStats_t					s_writer_stats;
+LogStats_t						s_pub_stats {};
+std::mutex						s_mtx4stats;
+
+// 日志线程的输出: 日志文件, 及 stdout(文本日志时直接引用日志文件缓冲区里的行)
+LogOutput_t						s_log_out { LOG_OUT_BUF_SIZE };
+LogOutput_t						s_sto_out { STO_OUT_BUF_SIZE };
+// 其它输出(AddLogSink 增加的), 及它们之中最低的级别(低于此级别的日志不必给它们)
+vector<std::unique_ptr<LogSink_t>>	s_sinks;
+LogLevel_e						s_sinks_min = LogLevel_e::VALUES_COUNT;
+// 重复日志合并(窗口为0即不合并)
+LogDedup_t						s_dedup;
+// 日志文件的时间索引(见 leonlog/LogIndex.hpp), 及每多少行、每多少纳秒切一段(行数为0即不建索引)
+LogIndexer_t					s_index;
+size_t							s_idx_every = 0;
+int64_t							s_idx_every_ns = 0;
 
 // 写日志的线程
 thread	s_writer;
@@ -139,8 +335,10 @@ thread	s_writer;
 // 生成"状态文本"的回调函数
 WriteStatus_f	s_wr_status;
 
-// 用于其它线程通知日志线程"新日志已入队"的信号量
-sem_t	s_new_log;
+// 用于其它线程通知日志线程"新日志已入队", 日志线程宣告要睡时才真正唤醒
+EventCount_t	s_new_log;
+// 日志线程睡在哪里: 平时是 s_new_log; 作为收集者时睡在共享内存环上, 别的进程也叫得醒
+EventCount_t*	s_wake = &s_new_log;
 // 是否正在进行日志文件轮转
 abool_t	s_is_rolling { false };
 // 指示writer线程是否还应继续运行的标志. 若将其置false, 日志线程将清空日志队列后退出
@@ -153,9 +351,92 @@ abool_t	s_headr_foot { true };
 bool	s_to_stdout { false };
 // 输出至stdout的内容是否也带时戳
 bool	s_sto_stamp { false };
+// 日志文件是否采用二进制格式(见 leonlog/BinLog.hpp)
+bool	s_bin_log { false };
+// 文本日志是否采用 JSON lines 格式
+bool	s_json_log { false };
+// 日志文件是否以内存映射方式写入
+bool	s_mmap_log { false };
+// 日志文件是否以 O_DIRECT 方式写入
+bool	s_direct_log { false };
+// 落盘策略(见 SetDurability): 这一级别及以上的日志写出后随即 fdatasync, VALUES_COUNT 为从不
+LogLevel_e	s_sync_level = LogLevel_e::VALUES_COUNT;
+// 写 Fatal 的线程是否等到它已落盘, 最多等多久
+bool		s_fatal_waits = false;
+SysDura_t	s_fatal_wait = 1s;
+// 本轮写出的日志中有须落盘的(只有日志线程访问)
+bool		s_need_sync = false;
+// 日志线程开始清空队列的轮次, 及已写出(须落盘的也已落盘)的轮次. 等落盘的生产者据此知道自己的日志已落盘
+std::atomic<uint64_t>	s_pass_begun { 0 };
+std::atomic<uint64_t>	s_pass_done { 0 };
+// 是否在 StartLog 时安装致命信号处理函数
+bool	s_crash_handler { false };
+// 进程正在崩溃: 不再接受新日志, 日志线程停手, 由信号处理函数清空队列
+abool_t	s_crashing { false };
+// 日志线程正在处理日志(除了睡觉以外的时候), 信号处理函数须等它停手才能接管队列
+abool_t	s_writer_busy { false };
+// 日志线程已因崩溃而停手(ParkWriter), 此后不会再碰输出及队列
+abool_t	s_writer_parked { false };
 // logger 线程的 pthread_id
 aptid_t	s_log_tid {};
 
+// 各级别日志在队列满时的处理策略
+OverflowPolicy_t	s_overflow[LogLevel_e::VALUES_COUNT] = {
+	{ DropNewest, 1s },	// Debug
+	{ DropNewest, 1s },	// Infor
+	{ EvictLower, 1s },	// Notif
+	{ EvictLower, 1s },	// Warnn
+	{ Block, 1s },		// Error
+	{ Spill, 1s },		// Fatal
+};
+// 各级别因队列满而丢弃的日志数, 及日志线程上次报告时的值
+std::atomic<uint64_t>	s_dropped[LogLevel_e::VALUES_COUNT];
+uint64_t				s_dropped_told[LogLevel_e::VALUES_COUNT];
+
+// 溢出文件: 生产者加锁追加, 日志线程从 s_spill_read 处读出补写, 全部补写后清空
+int						s_spill_fd = -1;
+str_t					s_spill_file;
+std::mutex				s_mtx4spill;
+std::atomic<uint64_t>	s_spill_end { 0 };	// 已完整写入的字节数
+uint64_t				s_spill_read = 0;	// 已补写的字节数(只有日志线程访问)
+
+// 要处理的致命信号, 及安装前的处理方式(卸载时恢复, 崩溃时也交还给它)
+constexpr int			FATAL_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+constexpr char_cp		FATAL_SIG_NAMES[] = { "SIGSEGV", "SIGBUS", "SIGFPE", "SIGILL", "SIGABRT" };
+struct sigaction		s_old_actions[std::size( FATAL_SIGNALS )];
+bool					s_handler_on = false;
+// 本地时间与UTC之差(秒), 启动时取得, 信号处理函数里不能查时区
+int64_t					s_utc_off = 0;
+// 二进制日志崩溃时抢救出的日志另存为文本(日志文件名加".crash")
+str_t					s_crash_file;
+// 信号处理函数最多花多少时间等日志线程停手, 及抢救日志
+constexpr auto			CRASH_WAIT_WRITER = 200ms;
+constexpr auto			CRASH_DRAIN_LIMIT = 500ms;
+
+// fork 出的子进程的日志方式, fork 处理函数是否已注册
+ForkLog_e				s_fork_log = ForkSameFile;
+std::once_flag			s_atfork_once;
+// 正在 fork 的线程数, 非0时日志线程停在两轮之间(s_writer_busy 为 false), 最多等它这么久
+std::atomic<int>		s_forking { 0 };
+constexpr auto			FORK_WAIT_WRITER = 1s;
+// 本进程是 fork 出的子进程, 与父进程同写一个日志文件: 不轮转, 不压缩, 溢出文件另起
+bool					s_share_file = false;
+// StartLog 指定的日志线程CPU, 子进程重启日志线程时还要用
+str_t					s_run_cpus;
+
+// 多进程共享内存日志(见 leonlog/SharedLog.hpp): 本进程作为生产者或收集者所用的环
+SharedRing_t			s_ring;
+// 本进程是生产者: 日志都写进环里, 没有日志线程
+bool					s_ring_producer = false;
+// 生产者的标签(收集者输出的线程名为"标签/线程名")
+str_t					s_ring_label;
+// 收集者要收集的环(空为不收集), 及新建时的槽位数
+str_t					s_collect_ring;
+size_t					s_collect_slots = DEFAULT_RING_SLOTS;
+// 收集者上次报告时环里的丢弃数、跳过数(只有日志线程访问)
+uint64_t				s_ring_dropped_told = 0;
+uint64_t				s_ring_lost_told = 0;
+
 //###### 各种函数实现 ############################################################
 
 inline str_t ThreadId2Hex( thread::id thread_id ) {
@@ -179,21 +460,57 @@ void StartLog( str_cr file_, LogLevel_e levl_, size_t prec_, size_t capa_,
 	if( s_is_running.load( mo_acquire ) )
 		throw bad_usage( "日志系统已启动, 不能重复初始化!" );
 
-//	const_cast<LogLevel_e&>( g_log_level ) =
-	g_log_level = min( LogLevel_e::Fatal, max( LogLevel_e::Debug, levl_ ) );
+	// 作为收集者: 先确认环里没有别的收集者
+	if( !s_collect_ring.empty() ) {
+		if( !s_ring.attached() || s_ring.name() != s_collect_ring || s_ring.stale() )
+			s_ring.attach( s_collect_ring, s_collect_slots );
+		s_ring.collect();
+		s_ring_dropped_told = s_ring.dropped();
+		s_ring_lost_told = s_ring.lost();
+		s_wake = &s_ring.wake();
+	}
+
+	SetLogLevel( levl_ );
 	s_stamp_pre = min<decltype( s_stamp_pre )>( prec_, 9 );
-	s_time_unit = std::pow( 10.0, 9 - s_stamp_pre );
 	s_log_file = file_;
-	s_log_que = make_unique<LogQue_t>( capa_ );
+	s_que_capa = capa_;
+	s_run_cpus = cpus_;
+	s_log_gen.fetch_add( 1, mo_acq_rel );
 	s_headr_foot.store( head_ );
 	s_to_stdout = stdo_;
 	s_sto_stamp = stot_;
-	if( sem_init( &s_new_log, 0, 0 ) )
-		throw std::runtime_error( "信号量创建失败, 不能启动日志系统!" );
+	for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l ) {
+		s_dropped[l].store( 0, mo_relaxed );
+		s_dropped_told[l] = 0;
+	}
+	// 度量从本次启动算起
+	{
+		LogStats_t base = SumProducerStats();
+		unique_lock<std::mutex> lk( s_mtx4stats );
+		s_base_stats = base;
+		s_pub_stats = LogStats_t {};
+		s_writer_stats = WriterStats_t {};
+	}
+
+	// 有级别要溢出至文件, 才需要溢出文件
+	if( s_log_file != "/dev/null" && std::any_of( std::begin( s_overflow ), std::end( s_overflow ),
+			[]( const OverflowPolicy_t& p ) { return p.how == Spill; } ) ) {
+		s_spill_file = s_log_file + ( s_share_file ? '.' + std::to_string( getpid() ) : str_t() ) + ".spill";
+		s_spill_fd = open( s_spill_file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+		s_spill_end.store( 0, mo_release );
+		s_spill_read = 0;
+	}
+
+	// 打不开的输出就不用了, 但不妨碍日志系统启动
+	for( auto& sink : s_sinks )
+		if( !sink->start() )
+			cerr << "打开日志输出(" << sink->target() << ")失败, 将不会输出至此!" << endl;
 
+	s_crashing.store( false, mo_release );
+	s_writer_parked.store( false, mo_release );
 	RegistThread( "MainThread" );
 	s_should_run.store( true, mo_release );
-	s_writer = std::thread( WriterThreadBody, &cpus_ );
+	s_writer = std::thread( WriterThreadBody, &s_run_cpus );
 	steady_clock::time_point time_out = steady_clock::now() + 1s;
 	while( !s_is_running.load( mo_acquire ) && steady_clock::now() < time_out )
 		std::this_thread::sleep_for( 1ns );
@@ -201,8 +518,15 @@ void StartLog( str_cr file_, LogLevel_e levl_, size_t prec_, size_t capa_,
 	if( !s_is_running.load( mo_acquire ) ) {
 		s_should_run.store( false, mo_release );
 		s_writer.detach();
+		s_ring.resign();
 		throw std::runtime_error( "日志系统启动失败" );
 	}
+
+	if( s_crash_handler )
+		InstallCrashHandler();
+	if( !s_share_file )
+		StartCompressor( s_log_file );
+	std::call_once( s_atfork_once, [] { pthread_atfork( BeforeFork, AfterForkParent, AfterForkChild ); } );
 };
 
 void StopLog( bool ft_, bool rn_, str_cr infix_ ) {
@@ -210,6 +534,14 @@ void StopLog( bool ft_, bool rn_, str_cr infix_ ) {
 // 		throw bad_usage( "日志系统尚未启动, 怎么关闭?" );
 		return;
 
+	// 生产者没有日志线程. 环的映射留着, 免得别的线程此刻正在写
+	if( s_ring_producer ) {
+		s_is_running.store( false, mo_release );
+		s_ring_producer = false;
+		return;
+	}
+
+	RemoveCrashHandler();
 	if( ft_ )
 		LOG_DEBUG( "将要停止日志系统......" );
 
@@ -221,14 +553,14 @@ void StopLog( bool ft_, bool rn_, str_cr infix_ ) {
 	steady_clock::time_point time_out =
 		steady_clock::now() + seconds( s_exit_secs );
 	while( s_is_running.load( mo_acquire ) && steady_clock::now() < time_out ) {
-		// 为避免 s_writer 苦等信号量而不能退出, 多给它发点
-		sem_post( &s_new_log );
+		// 为避免 s_writer 苦等而不能退出, 多叫它几次
+		s_wake->wake();
 		std::this_thread::sleep_for( 1us );
 	}
 
 // 如果日志线程还在运行,就强制把它杀了
 	if( s_is_running.load( mo_acquire ) ) {
-		cerr << "====队内日志太多(" << s_log_que->size() << '/' << s_log_que->capa()
+		cerr << "====队内日志太多(" << QueuedLogs() << '/' << QuesCapacity()
 			 << "),写不完了.将要杀掉日志线程...====" << endl;
 		pthread_cancel( s_writer.native_handle() );
 		s_writer.detach();
@@ -241,10 +573,29 @@ void StopLog( bool ft_, bool rn_, str_cr infix_ ) {
 #endif
 	if( s_writer.joinable() )
 		s_writer.join();
+	// 最后改名的文件来不及压缩了, 下次启动时再压
+	StopCompressor();
+	for( auto& sink : s_sinks )
+		sink->stop();
+
+	if( s_spill_fd >= 0 ) {
+		unique_lock<std::mutex> lk( s_mtx4spill );
+		close( s_spill_fd );
+		s_spill_fd = -1;
+		// 日志线程被杀的话, 溢出文件里可能还有没补写的, 留着备查
+		if( s_spill_end.load( mo_acquire ) == s_spill_read )
+			unlink( s_spill_file.c_str() );
+	}
 
-	if( sem_destroy( &s_new_log ) )
-		throw std::runtime_error( "信号量销毁失败!" );
-	s_log_que = nullptr;
+	s_share_file = false;
+	// 辞去收集者. 映射留着, 本进程别的线程可能还在叫醒它
+	s_ring.resign();
+	s_wake = &s_new_log;
+	unique_lock<std::mutex> lk( s_mtx4ques );
+	for( auto& tq : s_all_ques )
+		tq->stats.add_to( s_retired_stats );
+	s_all_ques.clear();
+	s_ques_ver.fetch_add( 1, mo_release );
 };
 
 bool IsLogging() {
@@ -286,55 +637,522 @@ Names2LinuxTId_t LinuxThreadIds() {
 	return result;
 };
 
+// 为线程名分配编号(同名线程共用一个编号), 须持有 s_mtx4nids 的独占锁
+static ThreadId_t InternThreadName( str_cr name_ ) {
+	auto it = s_name2id.find( name_ );
+	if( it != s_name2id.end() )
+		return it->second;
+
+	size_t id = s_t_count.load( mo_relaxed );
+	if( id >= TOO_MANY_THREADS ) {
+		// 名字表已满, 只好都算在预留的编号名下
+		s_name2id[name_] = TOO_MANY_THREADS;
+		return TOO_MANY_THREADS;
+	}
+
+	s_t_names[id] = name_;
+	s_name2id[name_] = static_cast<ThreadId_t>( id );
+	s_t_count.store( id + 1, mo_release );
+	return static_cast<ThreadId_t>( id );
+};
+
+ThreadId_t MyThreadId() {
+	if( tl_t_id == NO_THREAD_ID ) [[unlikely]] {
+		unique_lock<shared_mutex> ex_lk( s_mtx4nids );
+		tl_t_id = InternThreadName( ThreadId2Hex() );
+	}
+	return tl_t_id;
+};
+
+str_cr ThreadNameOf( ThreadId_t id_ ) {
+	return s_t_names[id_];
+};
+
 // 登记一个线程名, 此后输出该线程的日志时, 会包含此名，而非线程Id
 void RegistThread( str_cr my_name ) {
-	tl_t_name = my_name;
-	unique_lock<shared_mutex> ex_lk( s_mtx4nids );
-	s_t_ids[my_name] = syscall( SYS_gettid );
+	{
+		unique_lock<shared_mutex> ex_lk( s_mtx4nids );
+		s_t_ids[my_name] = syscall( SYS_gettid );
+		tl_t_id = InternThreadName( my_name );
+	}
+
+	// 日志系统已启动的话, 顺便创建本线程的日志队列, 免得首条日志还要付出创建代价
+	if( s_is_running.load( mo_acquire ) )
+		MyLogQue();
+};
+
+ThreadQue_t& MyLogQue() {
+	uint64_t gen = s_log_gen.load( mo_acquire );
+	if( tl_que.tque && tl_que.gen == gen ) [[likely]]
+		return *tl_que.tque;
+
+	// 首次使用, 或日志系统已重启过(旧队列已随旧系统注销)
+	if( tl_que.tque )
+		tl_que.tque->orphan.store( true, mo_release );
+	tl_que.tque = make_shared<ThreadQue_t>( s_que_capa );
+	tl_que.gen = gen;
+
+	unique_lock<std::mutex> lk( s_mtx4ques );
+	s_all_ques.push_back( tl_que.tque );
+	s_ques_ver.fetch_add( 1, mo_release );
+	return *tl_que.tque;
+};
+
+size_t QueuedLogs() {
+	unique_lock<std::mutex> lk( s_mtx4ques );
+	size_t result = 0;
+	for( auto& tq : s_all_ques )
+		result += tq->que.size();
+	return result;
+};
+
+size_t QuesCapacity() {
+	unique_lock<std::mutex> lk( s_mtx4ques );
+	size_t result = 0;
+	for( auto& tq : s_all_ques )
+		result += tq->que.capa();
+	return result;
 };
 
 // 添加日志的主函数, 此处是实现。此函数只是把日志加入队列, 等待日志线程来写入文件
 template <typename T>
 bool AppendLog( LogLevel_e level_, T&& body_ ) {
-	// 只有不低于门限值的日志才能得到输出
-	if( level_ < g_log_level )
+	// 只有不低于门限值的日志才能得到输出. 宏已确切判断过, 这里只挡直接调用的(按最低的门槛)
+	if( level_ < s_log_floor.load( mo_relaxed ) )
 		return false;
 
 	// 日志系统必须已经启动
 	if( ! s_is_running.load( mo_acquire ) ) {
 		cerr << LOG_LEVEL_NAMES[level_]
-			 << ",早期日志," << tl_t_name << ',' << body_ << "\n";
+			 << ",早期日志," << ThreadNameOf( MyThreadId() ) << ',' << body_ << "\n";
 		return true;
 	}
 
 	// 时戳不能反复取, 入队失败重试还要用这个时戳
 	LogStamp_t stamp = tl_stamp ? *tl_stamp : system_clock::now();
+	LogEntry_t entry( stamp, MyThreadId(), std::forward<T>( body_ ), level_ );
+	return EnqueLog( entry );
+};
+template bool AppendLog<str_cr>( LogLevel_e, str_cr );
+template bool AppendLog<str_t&>( LogLevel_e, str_t& );
+template bool AppendLog<str_t>( LogLevel_e, str_t&& );
 
-	// 日志入队重试次数
-	constexpr int ENQUE_RETRIES = 10;
-	auto tries = ENQUE_RETRIES;
-
-	// 日志入队
-	while( ! s_log_que->enque(
-				LogEntry_t( stamp, tl_t_name,
-							std::forward<T>( body_ ), level_ ) ) ) {
-		sem_post( &s_new_log );
-		--tries;
-		if( tries <= 0 ) {
-			cerr << LOG_LEVEL_NAMES[LogLevel_e::Error]
-				 << "," << tl_t_name << ",日志入队失败,抛弃日志:"
-				 << body_ << endl;
-			return false;
+bool AppendLogKv( LogLevel_e level_, str_t&& body_, uint16_t kvs_ ) {
+	if( level_ < s_log_floor.load( mo_relaxed ) )
+		return false;
+
+	LogStamp_t stamp = tl_stamp ? *tl_stamp : system_clock::now();
+	LogEntry_t entry( stamp, MyThreadId(), std::move( body_ ), level_ );
+	entry.kvs = kvs_;
+
+	if( ! s_is_running.load( mo_acquire ) ) {
+		str_t text( entry.text() );
+		FormatLogKvs( text, entry.fields(), false );
+		cerr << LOG_LEVEL_NAMES[level_] << ",早期日志," << ThreadNameOf( entry.tid ) << ','
+			 << text << "\n";
+		return true;
+	}
+
+	return EnqueLog( entry );
+};
+
+// 添加延迟格式化日志, 只拷贝打包好的参数, 格式化留给日志线程
+bool AppendLogArgs( LogLevel_e level_, const LogFmt_t* fmt_,
+					const void* args_, size_t size_ ) {
+	if( level_ < s_log_floor.load( mo_relaxed ) )
+		return false;
+
+	LogStamp_t stamp = tl_stamp ? *tl_stamp : system_clock::now();
+	LogEntry_t entry( stamp, MyThreadId(), fmt_, args_, size_, level_ );
+
+	if( ! s_is_running.load( mo_acquire ) ) {
+		char buf[1024];
+		cerr << LOG_LEVEL_NAMES[level_] << ",早期日志," << ThreadNameOf( entry.tid ) << ','
+			 << BodyOf( entry, buf, sizeof( buf ) ) << "\n";
+		return true;
+	}
+
+	return EnqueLog( entry );
+};
+
+bool EnqueLog( LogEntry_t& entry_ ) {
+	// 日志入队(本线程独占的队列, 不与其它线程争抢). 只有入队成功时才会移走 entry_
+	if( s_crashing.load( mo_relaxed ) ) [[unlikely]]
+		return false;
+	if( s_ring_producer )
+		return RingEnque( entry_ );
+
+	ThreadQue_t& my_tq = MyLogQue();
+	ProducerStats_t& stats = my_tq.stats;
+	LogLevel_e level = entry_.level;
+	// 抽样量入队耗时
+	bool timed = ++stats.tick % LogStats_t::LATENCY_SAMPLE == 0;
+	steady_clock::time_point start;
+	if( timed ) [[unlikely]]
+		start = steady_clock::now();
+
+	bool queued = true;
+	if( my_tq.que.enque( std::move( entry_ ) ) ) [[likely]]
+		s_wake->notify();	// 日志线程正要睡(或已睡)才唤醒它
+	else
+		queued = EnqueOverflow( my_tq, entry_ );
+
+	if( queued )
+		ProducerStats_t::bump( stats.enqueued[level] );
+	if( timed ) [[unlikely]] {
+		uint64_t ns = duration_cast<nanoseconds>( steady_clock::now() - start ).count();
+		size_t bucket = min<size_t>( ns == 0 ? 0 : std::bit_width( ns ) - 1, LogStats_t::LATENCY_BUCKETS - 1 );
+		ProducerStats_t::bump( stats.enque_ns[bucket] );
+	}
+	if( level == LogLevel_e::Fatal && queued && s_fatal_waits ) [[unlikely]]
+		WaitDurable();
+	return queued;
+};
+
+void WaitDurable() {
+	// 日志线程自己写的等不到自己
+	if( pthread_equal( pthread_self(), s_log_tid.load( mo_relaxed ) ) )
+		return;
+
+	// 已入队, 此刻正在进行(或下一轮开始)的那一轮清空队列必定带走它
+	uint64_t target = s_pass_begun.load( mo_seq_cst ) + 1;
+	steady_clock::time_point deadline = steady_clock::now() + s_fatal_wait;
+	while( s_pass_done.load( mo_acquire ) < target && s_is_running.load( mo_acquire )
+			&& !s_crashing.load( mo_relaxed ) && steady_clock::now() < deadline ) {
+		s_wake->wake();
+		std::this_thread::sleep_for( 10us );
+	}
+};
+
+bool EnqueOverflow( ThreadQue_t& tq_, LogEntry_t& entry_ ) {
+	// 过载时最忌讳的就是慢而阻塞的输出(如cerr), 丢弃的日志只计数, 由日志线程报告
+	const OverflowPolicy_t& policy = s_overflow[entry_.level];
+	Overflow_e how = policy.how;
+	if( how == Spill ) {
+		if( SpillLog( entry_ ) ) {
+			ProducerStats_t::bump( tq_.stats.spilled[entry_.level] );
+			s_wake->notify();
+			return true;
 		}
+		how = Block;
+	}
+
+	if( how == EvictLower && entry_.level > LogLevel_e::Debug ) {
+		tq_.evict_below.store( entry_.level, mo_relaxed );
+		tq_.evict_need.fetch_add( 1, mo_release );
+	}
+
+	if( how != DropNewest ) {
+		steady_clock::time_point deadline = policy.timeout >= hours( 24 )
+											? steady_clock::time_point::max()
+											: steady_clock::now() + policy.timeout;
+		do {
+			s_wake->wake();
+			std::this_thread::sleep_for( 10us );
+			ProducerStats_t::bump( tq_.stats.retries[entry_.level] );
+			if( tq_.que.enque( std::move( entry_ ) ) ) {
+				s_wake->notify();
+				return true;
+			}
+		} while( s_is_running.load( mo_acquire ) && !s_crashing.load( mo_relaxed )
+				 && steady_clock::now() < deadline );
+	}
+
+	s_dropped[entry_.level].fetch_add( 1, mo_relaxed );
+	return false;
+};
+
+bool SpillLog( const LogEntry_t& entry_ ) {
+	// 格式描述符的地址不能存进文件(溢出文件若被别的进程或下次启动读到, 地址就无效了), LOGF 的在此先格式化
+	char fmt_buf[LOG_LINE_MAX];
+	string_view body = entry_.lfmt == nullptr ? entry_.body.view() : BodyOf( entry_, fmt_buf, sizeof( fmt_buf ) );
+	SpillRec_t rec { entry_.stamp, static_cast<uint32_t>( body.size() ),
+					 entry_.tid, entry_.kvs, static_cast<uint8_t>( entry_.level ) };
+	iovec iov[2] = {
+		{ &rec, sizeof( rec ) },
+		{ const_cast<char*>( body.data() ), body.size() }
 	};
+	ssize_t total = sizeof( rec ) + body.size();
+
+	unique_lock<std::mutex> lk( s_mtx4spill );
+	if( s_spill_fd < 0 )
+		return false;
 
-	// 发信号
-	sem_post( &s_new_log );
+	uint64_t end = s_spill_end.load( mo_relaxed );
+	ssize_t n;
+	do
+		n = pwritev( s_spill_fd, iov, 2, end );
+	while( n < 0 && errno == EINTR );
+	if( n != total )
+		return false;	// 磁盘满之类, 半截记录在 s_spill_end 之外, 会被下一条覆盖
+
+	s_spill_end.store( end + total, mo_release );
 	return true;
 };
-template bool AppendLog<str_cr>( LogLevel_e, str_cr );
-template bool AppendLog<str_t&>( LogLevel_e, str_t& );
-template bool AppendLog<str_t>( LogLevel_e, str_t&& );
+
+size_t ReplaySpill() {
+	if( s_spill_fd < 0 )
+		return 0;
+
+	static vector<char>	body;
+	size_t				count = 0;
+	uint64_t			end = s_spill_end.load( mo_acquire );
+	while( s_spill_read < end ) {
+		SpillRec_t rec;
+		if( pread( s_spill_fd, &rec, sizeof( rec ), s_spill_read ) != sizeof( rec ) )
+			break;
+		body.resize( rec.size );
+		if( pread( s_spill_fd, body.data(), rec.size, s_spill_read + sizeof( rec ) )
+				!= static_cast<ssize_t>( rec.size ) )
+			break;
+
+		// 补写的日志时戳会早于本轮已写出的日志, 无法再与之归并
+		LogEntry_t entry( rec.stamp, rec.tid, string_view( body.data(), rec.size ),
+						  static_cast<LogLevel_e>( rec.level ) );
+		entry.kvs = rec.kvs;
+		Write1Log( entry );
+		s_spill_read += sizeof( rec ) + rec.size;
+		++count;
+	}
+
+	// 已全部补写, 清空溢出文件
+	if( count > 0 ) {
+		unique_lock<std::mutex> lk( s_mtx4spill );
+		if( s_spill_read == s_spill_end.load( mo_relaxed ) ) {
+			ftruncate( s_spill_fd, 0 );
+			s_spill_end.store( 0, mo_release );
+			s_spill_read = 0;
+		}
+	}
+	return count;
+};
+
+void ReportDrops() {
+	str_t report;
+	for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l ) {
+		uint64_t dropped = s_dropped[l].load( mo_relaxed );
+		if( dropped == s_dropped_told[l] )
+			continue;
+		report.append( 1, ' ' ).append( LOG_LEVEL_NAMES[l] ).append( 1, '=' )
+		.append( std::to_string( dropped - s_dropped_told[l] ) );
+		s_dropped_told[l] = dropped;
+	}
+	str_t sink_report;
+	for( auto& sink : s_sinks )
+		if( uint64_t dropped = sink->take_dropped(); dropped > 0 )
+			sink_report.append( 1, ' ' ).append( sink->target() ).append( 1, '=' )
+			.append( std::to_string( dropped ) );
+
+	LogEntry_t aLog { system_clock::now(), MyThreadId(), str_t{}, LogLevel_e::Warnn };
+	if( !report.empty() ) {
+		aLog.body.assign( "队列满, 自上次报告以来丢弃的日志:" + report );
+		Write1Log( aLog );
+	}
+	if( !sink_report.empty() ) {
+		aLog.body.assign( "输出太慢, 自上次报告以来丢弃的行:" + sink_report );
+		Write1Log( aLog );
+	}
+	if( s_ring.collecting() ) {
+		uint64_t dropped = s_ring.dropped(), lost = s_ring.lost();
+		if( dropped != s_ring_dropped_told || lost != s_ring_lost_told ) {
+			aLog.body.assign( "共享内存环(" + s_ring.name() + "), 自上次报告以来: 环满丢弃 "
+							  + std::to_string( dropped - s_ring_dropped_told ) + " 条, 生产者没写完而跳过 "
+							  + std::to_string( lost - s_ring_lost_told ) + " 条" );
+			Write1Log( aLog );
+			s_ring_dropped_told = dropped;
+			s_ring_lost_told = lost;
+		}
+	}
+};
+
+bool RingEnque( LogEntry_t& entry_ ) {
+	// 格式描述符只在本进程有效, 延迟格式化的在这里格式化; 带字段的放不下, 就连字段一起转成文本
+	char		buf[LOG_LINE_MAX];
+	str_t		flat;
+	string_view	body;
+	uint16_t	kvs = 0;
+	if( entry_.lfmt != nullptr )
+		body = BodyOf( entry_, buf, sizeof( buf ) );
+	else if( entry_.kvs == 0 || entry_.body.size() <= RING_BODY_MAX ) {
+		body = entry_.body.view();
+		kvs = entry_.kvs;
+	} else {
+		flat.assign( entry_.text() );
+		FormatLogKvs( flat, entry_.fields(), false );
+		body = flat;
+	}
+
+	int64_t ns = duration_cast<nanoseconds>( entry_.stamp.time_since_epoch() ).count();
+	str_cr thread = ThreadNameOf( entry_.tid );
+	if( s_ring.put( ns, entry_.level, s_ring_label, thread, body, kvs ) ) [[likely]]
+		return true;
+
+	// 环满: 按该级别的策略等一会儿, 或直接丢弃(溢出文件是本进程的, 这里用不上, 视同等待)
+	const OverflowPolicy_t& policy = s_overflow[entry_.level];
+	if( policy.how != DropNewest ) {
+		steady_clock::time_point deadline = policy.timeout >= hours( 24 )
+											? steady_clock::time_point::max()
+											: steady_clock::now() + policy.timeout;
+		do {
+			std::this_thread::sleep_for( 10us );
+			if( s_ring.put( ns, entry_.level, s_ring_label, thread, body, kvs ) )
+				return true;
+		} while( steady_clock::now() < deadline );
+	}
+	s_dropped[entry_.level].fetch_add( 1, mo_relaxed );
+	s_ring.count_drop();
+	return false;
+};
+
+size_t DrainRing() {
+	if( !s_ring.collecting() )
+		return 0;
+
+	// "标签/线程名"到线程编号, 只有日志线程访问
+	struct SvHash_t {
+		using is_transparent = void;
+		size_t operator()( string_view sv_ ) const { return std::hash<string_view> {}( sv_ ); };
+	};
+	static std::unordered_map<str_t, ThreadId_t, SvHash_t, std::equal_to<>>	tids;
+	static RingRec_t	rec;
+	size_t written = 0;
+	for( size_t quota = s_ring.slots(); written < quota && s_ring.take( rec ); ++written ) {
+		string_view name( rec.thread, strnlen( rec.thread, RING_THREAD_MAX ) );
+		auto it = tids.find( name );
+		if( it == tids.end() ) {
+			unique_lock<shared_mutex> ex_lk( s_mtx4nids );
+			it = tids.emplace( name, InternThreadName( str_t( name ) ) ).first;
+		}
+		LogEntry_t log( LogStamp_t( duration_cast<LogStamp_t::duration>( nanoseconds( rec.stamp ) ) ), it->second,
+						string_view( rec.body, rec.size ), static_cast<LogLevel_e>( rec.level ) );
+		log.kvs = rec.kvs;
+		if( !s_dedup.enabled() || !s_dedup.absorb( log, Write1Log ) )
+			Write1Log( log );
+	}
+	return written;
+};
+
+uint64_t DroppedLogs( LogLevel_e level_ ) {
+	return s_dropped[level_].load( mo_relaxed );
+};
+
+void PublishStats() {
+	WriterStats_t& ws = s_writer_stats;
+	steady_clock::time_point now = steady_clock::now();
+	double secs = max( duration<double>( now - ws.since ).count(), 1e-9 );
+
+	unique_lock<std::mutex> lk( s_mtx4stats );
+	LogStats_t& pub = s_pub_stats;
+	pub.que_high = ws.que_high;
+	pub.lag_max_ns = ws.lag_max;
+	pub.lag_avg_ns = ws.lag_count == 0 ? 0 : ws.lag_sum / static_cast<int64_t>( ws.lag_count );
+	pub.lines_per_sec = ws.lines / secs;
+	pub.bytes_per_sec = ws.bytes / secs;
+	pub.lines_total += ws.lines;
+	pub.bytes_total += ws.bytes;
+	pub.syncs_total += ws.syncs;
+	lk.unlock();
+
+	ws = WriterStats_t {};
+	ws.since = now;
+};
+
+LogStats_t SumProducerStats() {
+	unique_lock<std::mutex> lk( s_mtx4ques );
+	LogStats_t st = s_retired_stats;
+	for( auto& tq : s_all_ques ) {
+		tq->stats.add_to( st );
+		st.queued += tq->que.size();
+	}
+	return st;
+};
+
+LogStats_t SnapLogStats() {
+	LogStats_t st = SumProducerStats();
+
+	unique_lock<std::mutex> lk( s_mtx4stats );
+	const LogStats_t& base = s_base_stats;
+	for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l ) {
+		st.enqueued[l] -= base.enqueued[l];
+		st.retries[l] -= base.retries[l];
+		st.spilled[l] -= base.spilled[l];
+		st.dropped[l] = s_dropped[l].load( mo_relaxed );
+	}
+	for( size_t b = 0; b < LogStats_t::LATENCY_BUCKETS; ++b )
+		st.enque_ns[b] -= base.enque_ns[b];
+
+	st.when = system_clock::now();
+	st.que_capa = s_que_capa;
+	st.que_high = s_pub_stats.que_high;
+	st.lag_max_ns = s_pub_stats.lag_max_ns;
+	st.lag_avg_ns = s_pub_stats.lag_avg_ns;
+	st.lines_per_sec = s_pub_stats.lines_per_sec;
+	st.bytes_per_sec = s_pub_stats.bytes_per_sec;
+	st.lines_total = s_pub_stats.lines_total;
+	st.bytes_total = s_pub_stats.bytes_total;
+	st.syncs_total = s_pub_stats.syncs_total;
+	return st;
+};
+
+uint64_t LogStats_t::enque_percentile( double p_ ) const {
+	uint64_t total = 0;
+	for( uint64_t n : enque_ns )
+		total += n;
+	if( total == 0 )
+		return 0;
+
+	uint64_t want = static_cast<uint64_t>( std::ceil( p_ * total ) );
+	uint64_t seen = 0;
+	for( size_t b = 0; b < LATENCY_BUCKETS; ++b ) {
+		seen += enque_ns[b];
+		if( seen >= want && seen > 0 )
+			return ( uint64_t( 2 ) << b ) - 1;
+	}
+	return UINT64_MAX;
+};
+
+void PrintLogStats( std::ostream& os_, const LogStats_t& st_ ) {
+	auto per_level = [&os_]( char_cp name_, const uint64_t ( &v_ )[LogLevel_e::VALUES_COUNT] ) {
+		for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l )
+			os_ << name_ << '.' << LOG_LEVEL_NAMES[l] << '=' << v_[l] << '\n';
+	};
+	per_level( "enqueued", st_.enqueued );
+	per_level( "retries", st_.retries );
+	per_level( "spilled", st_.spilled );
+	per_level( "dropped", st_.dropped );
+	os_ << "enque_p50_ns=" << st_.enque_percentile( 0.5 ) << '\n'
+		<< "enque_p99_ns=" << st_.enque_percentile( 0.99 ) << '\n'
+		<< "enque_p999_ns=" << st_.enque_percentile( 0.999 ) << '\n'
+		<< "queued=" << st_.queued << '\n'
+		<< "que_capa=" << st_.que_capa << '\n'
+		<< "que_high=" << st_.que_high << '\n'
+		<< "lag_max_ns=" << st_.lag_max_ns << '\n'
+		<< "lag_avg_ns=" << st_.lag_avg_ns << '\n'
+		<< "lines_per_sec=" << st_.lines_per_sec << '\n'
+		<< "bytes_per_sec=" << st_.bytes_per_sec << '\n'
+		<< "lines_total=" << st_.lines_total << '\n'
+		<< "bytes_total=" << st_.bytes_total << '\n'
+		<< "syncs_total=" << st_.syncs_total << '\n';
+};
+
+void WriteLogStats( std::ostream& os_ ) {
+	PrintLogStats( os_, SnapLogStats() );
+};
+
+void SetOverflowPolicy( LogLevel_e level_, Overflow_e how_, SysDura_t timeout_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改队满策略!" );
+	s_overflow[level_] = { how_, timeout_ };
+};
+
+void SetDurability( LogLevel_e sync_level_, bool wait_fatal_, SysDura_t timeout_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改落盘策略!" );
+	// 要等 Fatal 落盘, Fatal 就必须触发落盘
+	s_sync_level = wait_fatal_ ? min( sync_level_, LogLevel_e::Fatal ) : sync_level_;
+	s_fatal_waits = wait_fatal_;
+	s_fatal_wait = timeout_;
+};
 
 // 设置写盘间隔(每隔多少秒确保保存一次,默认3s)
 void SetFlushIntrvl( SysDura_t interval_ns_ ) {
@@ -350,6 +1168,119 @@ void SetLogStampPtr( const LogStamp_t* tstamp ) {
 	tl_stamp = tstamp;
 };
 
+void SetBinaryLog( bool binary_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改日志文件格式!" );
+	s_bin_log = binary_;
+};
+
+void SetJsonLog( bool json_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改日志格式!" );
+	s_json_log = json_;
+};
+
+void SetMmapLog( bool mmap_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改日志文件写入方式!" );
+	s_mmap_log = mmap_;
+};
+
+void SetDirectLog( bool direct_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改日志文件写入方式!" );
+	s_direct_log = direct_;
+};
+
+void AddLogSink( str_cr target_, LogLevel_e level_, bool async_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再增加输出!" );
+	s_sinks.push_back( make_unique<LogSink_t>( target_, level_, async_ ) );
+	s_sinks_min = min( s_sinks_min, level_ );
+};
+
+void ClearLogSinks() {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再清除输出!" );
+	s_sinks.clear();
+	s_sinks_min = LogLevel_e::VALUES_COUNT;
+};
+
+void SetDedupWindow( SysDura_t window_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改重复日志合并设置!" );
+	s_dedup.set_window( window_ );
+};
+
+void SetTimeIndex( size_t every_lines_, SysDura_t every_time_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改时间索引设置!" );
+	s_idx_every = every_lines_;
+	s_idx_every_ns = duration_cast<nanoseconds>( every_time_ ).count();
+};
+
+void SetRotation( uint64_t max_bytes_, Rotate_e every_, size_t keep_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改轮转策略!" );
+	s_rot_bytes = max_bytes_;
+	s_rot_every = every_;
+	s_rot_keep = keep_;
+};
+
+time_t NextRotateAt( time_t now_ ) {
+	if( s_rot_every == NoRotate )
+		return 0;
+
+	tm lt;
+	localtime_r( &now_, &lt );
+	lt.tm_sec = 0;
+	lt.tm_min = 0;
+	if( s_rot_every == Daily ) {
+		lt.tm_hour = 0;
+		++lt.tm_mday;
+	} else
+		++lt.tm_hour;
+	lt.tm_isdst = -1;	// 让 mktime 自己判断夏令时
+	return mktime( &lt );
+};
+
+void StartSharedLog( str_cr ring_, LogLevel_e levl_, str_cr label_, size_t slots_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能重复初始化!" );
+	if( !s_collect_ring.empty() )
+		throw bad_usage( "本进程是收集者, 不能再作为共享内存日志的生产者!" );
+
+	s_ring.attach( ring_, slots_ );
+	SetLogLevel( levl_ );
+	s_ring_label = label_.empty() ? str_t( program_invocation_short_name ) : label_;
+	for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l )
+		s_dropped[l].store( 0, mo_relaxed );
+	s_crashing.store( false, mo_release );
+	RegistThread( "MainThread" );
+	s_ring_producer = true;
+	s_is_running.store( true, mo_release );
+	std::call_once( s_atfork_once, [] { pthread_atfork( BeforeFork, AfterForkParent, AfterForkChild ); } );
+};
+
+void SetLogCollector( str_cr ring_, size_t slots_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改收集者设置!" );
+	s_collect_ring = ring_;
+	s_collect_slots = slots_;
+};
+
+void SetForkLog( ForkLog_e how_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改 fork 后的日志方式!" );
+	s_fork_log = how_;
+};
+
+void SetCrashHandler( bool on_ ) {
+	if( s_is_running.load( mo_acquire ) )
+		throw bad_usage( "日志系统已启动, 不能再更改致命信号处理!" );
+	s_crash_handler = on_;
+};
+
 void RotateLogFile( str_cr infix ) {
 // 本函数不会直接改名日志文件,只是置位全局变量,由日志线程完成真正的改名
 // 先确保日志线程真的进入事件循环,否则它首次进入事件循环就会去轮转日志
@@ -358,10 +1289,12 @@ void RotateLogFile( str_cr infix ) {
 		std::this_thread::sleep_for( 1ms );
 	if( !s_is_running.load( mo_acquire ) )
 		throw bad_usage( "日志系统尚未启动, 怎么轮转?" );
+	if( s_share_file )
+		throw bad_usage( "与父进程共用日志文件, 轮转归父进程!" );
 
 	s_log_infix = infix;
 	s_is_rolling.store( true, mo_release );
-	sem_post( &s_new_log );
+	s_wake->wake();
 	time_out = steady_clock::now() + 10s;
 	while( s_is_rolling.load( mo_acquire ) && steady_clock::now() < time_out )
 		std::this_thread::sleep_for( 1ns );
@@ -385,8 +1318,9 @@ void WriteStatus() {
 		return;
 
 	auto now_tp = system_clock::now();
-	if( now_tp < s_next_status )
+	if( now_tp < s_next_status || !s_wr_status )
 		return;
+	s_next_status = now_tp + s_status_interval;
 
 	ofs_t f { s_status_file, std::ios_base::out | std::ios_base::trunc };
 	s_wr_status( f );
@@ -405,22 +1339,25 @@ void WriterThreadBody( str_cp cpus_ ) {
 
 	// 日志线程自己也可以添加日志,当然就也可以注册有意义的线程名称
 	RegistThread( "Logger" );
-	// cpus_ 只在启动时存在, 一旦主线程离开 StartLog 函数, 就不能使用此对象了!!!
+	// cpus_ 指向 s_run_cpus, 下次 StartLog 时会被改写, 只在启动时读一次
 	if( cpus_ != nullptr && ! cpus_->empty() )
 		PthreadOnlyCPU( *cpus_ );
 
 	while( s_should_run.load( mo_acquire ) ) {
 		ProcessLogs();
-
-		path tmp = path( s_log_file );
-		if( s_log_file != "/dev/null" && exists( tmp ) ) {
-			if( file_size( tmp ) == 0 )
-				try { remove( tmp ); } catch( const std::exception& e ) {
-					cerr << "删除空文件(" << tmp << ")甩出异常:" << e.what();
-				}
-
-			else if( s_is_rolling.load( mo_acquire ) )
-				RenameLogFile();
+		// 与父进程共用的文件, 空不空、轮不轮转都归父进程管
+		if( s_log_file == "/dev/null" || s_share_file )
+			continue;
+
+		// 写了多少字节日志线程自己有数, 只有看似空文件时才去核实一下
+		std::error_code ec;
+		if( s_log_out.size() == 0 ) {
+			if( file_size( s_log_file, ec ) == 0 && !ec && !remove( s_log_file, ec ) && ec )
+				cerr << "删除空文件(" << s_log_file << ")失败:" << ec.message() << endl;
+			remove( s_log_file + ".idx", ec );
+		} else if( s_is_rolling.load( mo_acquire ) || s_auto_roll ) {
+			RenameLogFile();
+			PruneRotated();
 		}
 	}
 
@@ -428,132 +1365,740 @@ void WriterThreadBody( str_cp cpus_ ) {
 };
 
 void ProcessLogs() {
-	s_log_ofs = make_unique<ofs_t>( s_log_file,
-									std::ios_base::out | std::ios_base::app );
-	s_log_ofs->imbue( std::locale( "C" ) );
-	s_log_ofs->clear();
-
-	// 每过1秒Flush一下, 所以需要记录时间
+	s_writer_busy.store( true, mo_seq_cst );
+	if( s_mmap_log && s_log_file != "/dev/null" )
+		s_log_out.open_mapped( s_log_file );
+	else if( s_direct_log && !s_bin_log && s_log_file != "/dev/null" )
+		s_log_out.open_direct( s_log_file );
+	else
+		s_log_out.open( s_log_file );
+	// 与父进程共用的文件, 两边写的行交错, 各记各的索引对不上, 索引归父进程
+	if( s_idx_every > 0 && !s_bin_log && !s_share_file && s_log_out.is_open() && s_log_file != "/dev/null" )
+		s_index.open( s_log_file, s_log_out.opened_size(), s_idx_every, s_idx_every_ns );
+	if( s_to_stdout )
+		s_sto_out.attach( STDOUT_FILENO );
+	s_log_out.referred_by( s_bin_log ? nullptr : &s_sto_out );
+	if( s_bin_log )
+		StartBinLog( s_log_out, s_log_file, s_stamp_pre );
+
+	// 每清空一轮队列都会写出, 而等信号最多等一个写盘间隔, 所以 SetFlushIntrvl 的保证依然成立
 	timespec tsNextFlush, tsNow;
 	timespec_get( &tsNextFlush, TIME_UTC );
 	tsNextFlush += s_flush_ns;
 
-	LogEntry_t aLog {system_clock::now(), "Logger", str_t{}, LogLevel_e::Infor};
-	if( s_is_rolling.load( mo_acquire ) ) {
-		aLog.body = "---------- 日志文件已轮转 ----------";
-		Write1Log( *s_log_ofs, aLog );
+	LogEntry_t aLog {system_clock::now(), MyThreadId(), str_t{}, LogLevel_e::Infor};
+	s_file_since = system_clock::to_time_t( aLog.stamp );
+	s_next_rotate = NextRotateAt( s_file_since );
+	if( s_log_out.recovered() ) {
+		aLog.level = LogLevel_e::Warnn;
+		aLog.body.assign( "---------- 上次未能正常关闭, 日志文件已修复至" +
+						  std::to_string( s_log_out.opened_size() ) + "字节处 ----------" );
+		Write1Log( aLog );
+		aLog.level = LogLevel_e::Infor;
+	}
+	// 共用的文件由父进程轮转, 轮转前后的提示也归父进程写
+	if( s_is_rolling.load( mo_acquire ) || s_auto_roll ) {
+		if( !s_share_file ) {
+			aLog.body.assign( "---------- 日志文件已轮转 ----------" );
+			Write1Log( aLog );
+		}
 	} else if( s_headr_foot.load( mo_acquire ) ) {
-		aLog.body = "====== leonlog-" + str_t( PROJECT_VERSION ) + " 日志已启动("
-					+ LOG_LEVEL_NAMES[g_log_level] + ") ======";
-		Write1Log( *s_log_ofs, aLog );
+		aLog.body.assign( "====== leonlog-" + str_t( PROJECT_VERSION ) + " 日志已启动("
+						  + LOG_LEVEL_NAMES[g_base_level.load()] + ") ======" );
+		Write1Log( aLog );
 	}
 	s_is_rolling.store( false, mo_release );
+	s_auto_roll = false;
 	s_is_running.store( true, mo_release );
 
 	// 主循环, 等待日志->写日志->判断是否需要轮转或退出, 周而复始...
-	while( s_should_run.load( mo_acquire ) && !s_is_rolling.load( mo_acquire ) ) {
-		// 等一个信号
-		sem_timedwait( &s_new_log, &tsNextFlush );
+	while( s_should_run.load( mo_acquire ) && !s_is_rolling.load( mo_acquire ) && !s_auto_roll ) {
+		if( s_forking.load( mo_seq_cst ) > 0 ) [[unlikely]]
+			PauseForFork();
+		if( s_crashing.load( mo_seq_cst ) ) [[unlikely]]
+			ParkWriter();
 
-		while( s_log_que->deque( aLog ) )
-			Write1Log( *s_log_ofs, aLog );
+		// 本轮所有日志先拼进输出缓冲区, 再一次写出
+		uint64_t pass = s_pass_begun.fetch_add( 1, mo_seq_cst ) + 1;
+		size_t written = DrainQues() + ReplaySpill() + DrainRing();
 
-		// 每1秒Flush一下
 		timespec_get( &tsNow, TIME_UTC );
+		bool file_moved = false;
 		if( tsNow > tsNextFlush ) {
-			s_log_ofs->flush();
+			// 与父进程共用的文件被父进程轮转走了, 本轮之后换到新文件
+			file_moved = s_share_file && s_log_out.moved( s_log_file );
+			PublishStats();
+			ReportDrops();
+			if( s_dedup.enabled() )
+				s_dedup.expire( system_clock::now(), Write1Log );
 			tsNextFlush = tsNow;
 			tsNextFlush += s_flush_ns;
 			WriteStatus();
 		}
+		FlushOutputs();
+		s_pass_done.store( pass, mo_release );
+
+		// 到了长度上限或时间边界, 就在本轮之后自行轮转
+		s_auto_roll = s_share_file ? file_moved
+					  : ( s_rot_bytes > 0 && s_log_out.size() >= s_rot_bytes )
+					  || ( s_next_rotate > 0 && tsNow.tv_sec >= s_next_rotate );
+		if( s_auto_roll )
+			break;
+
+		// 本轮有活干, 下轮就不睡了. 睡觉期间不碰队列, 崩溃时信号处理函数不必等
+		if( written == 0 ) {
+			s_writer_busy.store( false, mo_seq_cst );
+			WaitForLogs( tsNextFlush );
+			s_writer_busy.store( true, mo_seq_cst );
+		}
 	}
 
 	if( s_should_run.load( mo_acquire ) ) {
-		// 这是需要轮转日志
-		aLog.level = LogLevel_e::Notif;
-		aLog.tname = "Logger";
-		aLog.stamp = system_clock::now();
-		aLog.body = "---------- 日志文件将轮转 ----------";
-		Write1Log( *s_log_ofs, aLog );
+		// 这是需要轮转日志. 文件要关了, 未报告的重复都在这个文件里报告完
+		if( s_dedup.enabled() )
+			s_dedup.flush_all( Write1Log );
+		if( !s_share_file ) {
+			aLog.level = LogLevel_e::Notif;
+			aLog.stamp = system_clock::now();
+			aLog.body.assign( "---------- 日志文件将轮转 ----------" );
+			Write1Log( aLog );
+		}
 	} else {
 		// 开始清盘, 如果此时日志还在源源不断地入队, 就会导致我们停不下来!
 		// 所以在 stopLogging 函数内会杀掉本线程!
-		while( s_log_que->size() > 0 )
-			if( s_log_que->deque( aLog ) )
-				Write1Log( *s_log_ofs, aLog );
+		while( DrainQues() + ReplaySpill() > 0 )
+			;
+		// 别的进程不会停下来, 环里的只收一圈
+		DrainRing();
+		ReportDrops();
+		if( s_dedup.enabled() )
+			s_dedup.flush_all( Write1Log );
 
 		if( s_headr_foot.load( mo_acquire ) ) {
 			aLog.level = LogLevel_e::Infor;
-			aLog.tname = "Logger";
 			aLog.stamp = system_clock::now();
-			aLog.body = "================ 日志已停止 =================";
-			Write1Log( *s_log_ofs, aLog );
+			aLog.body.assign( "================ 日志已停止 =================" );
+			Write1Log( aLog );
 		}
+		PublishStats();
 	}
 
-	s_log_ofs->close();
-	s_log_ofs = nullptr;
+	FlushOutputs();
+	s_pass_done.store( s_pass_begun.load( mo_acquire ), mo_release );
+	s_sto_out.close();
+	s_log_out.close();
+	s_index.close( s_log_out.size() );
+	s_writer_busy.store( false, mo_release );
 };
 
-char_cp const LOG_STAMP_FORMAT = "%y/%m/%d %H:%M:%S";
+size_t DrainQues() {
+	// 队列清单的快照只在清单有变时才去加锁更新
+	vector<ThreadQueP_t>& ques = s_writer_ques;
+	uint64_t ver = s_ques_ver.load( mo_acquire );
+	if( ver != s_writer_ques_ver ) {
+		unique_lock<std::mutex> lk( s_mtx4ques );
+		ques = s_all_ques;
+		s_writer_ques_ver = s_ques_ver.load( mo_acquire );
+	}
 
-inline void Write1Log( ofs_t& p_out, const LogEntry_t& log ) {
+	// 每个队列本轮最多只取开始时已有的条数, 免得生产者源源不断时本轮停不下来
+	struct Head_t {
+		LogStamp_t	stamp;
+		size_t		index;
+		bool operator>( const Head_t& o ) const { return stamp > o.stamp; };
+	};
+	static vector<size_t>	quotas;
+	static vector<Head_t>	heads;
+	quotas.assign( ques.size(), 0 );
+	heads.clear();
+	size_t written = 0;
+	for( size_t i = 0; i < ques.size(); ++i ) {
+		LogQue_t& que = ques[i]->que;
+		quotas[i] = que.size();
+		s_writer_stats.que_high = max( s_writer_stats.que_high, quotas[i] );
+		// 队满的线程请求挤掉低级别日志: 趁归并之前, 立即丢掉队头那几条低级别的, 够腾出所欠的空位即止.
+		// 队头不是低级别的就挤不动了(不能从队列中间取), 它只能等着本轮照常写出腾位
+		if( ques[i]->evict_need.load( mo_relaxed ) != 0 ) {
+			uint32_t need = ques[i]->evict_need.exchange( 0, mo_acquire );
+			int below = ques[i]->evict_below.load( mo_relaxed );
+			for( ; need > 0 && quotas[i] > 0 && que.front()->level < below; --need, --quotas[i] ) {
+				s_dropped[que.front()->level].fetch_add( 1, mo_relaxed );
+				que.pop();
+				++written;
+			}
+		}
+		if( quotas[i] > 0 )
+			heads.push_back( { ques[i]->que.front()->stamp, i } );
+	}
 
-	// 构造时戳
-	LogStamp_t tpSecPart =
-		time_point_cast<LogStamp_t::duration>(
-			std::chrono::floor<seconds>( log.stamp ) );
-	str_t time_str = fmt( tpSecPart, LOG_STAMP_FORMAT );
+	// 多路归并: 每次写出队头时戳最早的那条, 以保持日志文件按时间排序.
+	// 写盘滞后按本轮开始的时刻计, 免得每条都取一次时间
+	LogStamp_t now = heads.empty() ? LogStamp_t() : system_clock::now();
+	auto later = std::greater<Head_t>();
+	std::make_heap( heads.begin(), heads.end(), later );
+	while( ! heads.empty() ) {
+		std::pop_heap( heads.begin(), heads.end(), later );
+		size_t i = heads.back().index;
+		heads.pop_back();
+
+		if( s_crashing.load( mo_relaxed ) ) [[unlikely]]
+			ParkWriter();
+
+		LogQue_t& que = ques[i]->que;
+		const LogEntry_t& log = *que.front();
+		int64_t lag = max<int64_t>( duration_cast<nanoseconds>( now - log.stamp ).count(), 0 );
+		s_writer_stats.lag_max = max( s_writer_stats.lag_max, lag );
+		s_writer_stats.lag_sum += lag;
+		++s_writer_stats.lag_count;
+		if( !s_dedup.enabled() || !s_dedup.absorb( log, Write1Log ) )
+			Write1Log( log );
+		que.pop();
+		++written;
+
+		if( --quotas[i] > 0 ) {
+			heads.push_back( { que.front()->stamp, i } );
+			std::push_heap( heads.begin(), heads.end(), later );
+		}
+	}
 
-	// 输出时戳(尽量不拼接字符串,应该快点?)
-	p_out << time_str;
+	// 注销已清空的孤儿队列(其线程已退出)
+	bool has_orphan = false;
+	for( auto& tq : ques )
+		if( tq->orphan.load( mo_acquire ) && tq->que.size() == 0 )
+			has_orphan = true;
+	if( has_orphan ) {
+		unique_lock<std::mutex> lk( s_mtx4ques );
+		std::erase_if( s_all_ques, []( const ThreadQueP_t& tq ) {
+			if( !tq->orphan.load( mo_acquire ) || tq->que.size() != 0 )
+				return false;
+			// 计数并入已注销的
+			tq->stats.add_to( s_retired_stats );
+			return true;
+		} );
+		s_ques_ver.fetch_add( 1, mo_release );
+	}
+
+	return written;
+};
+
+inline void Write1Log( const LogEntry_t& log ) {
+	// 二进制日志直接写原始时戳及参数, 只有 stdout 及其它输出还需要文本
+	bool to_sinks = log.level >= s_sinks_min;
+	++s_writer_stats.lines;
+	if( log.level >= s_sync_level )
+		s_need_sync = true;
+	if( s_bin_log ) {
+		uint64_t before = s_log_out.size();
+		Write1Bin( s_log_out, log );
+		s_writer_stats.bytes += s_log_out.size() - before;
+		if( !s_to_stdout && !to_sinks )
+			return;
+	}
+
+	// 整行先在(日志线程独占的)行缓冲区内拼好, 再一次写出
+	static str_t line;
+	line.clear();
+
+	// 时戳: 同一秒内只需拷贝缓存的前缀, 秒以下部分查表生成
+	char stamp[LOG_STAMP_MAX];
+	int64_t ns = duration_cast<nanoseconds>( log.stamp.time_since_epoch() ).count();
+	size_t stamp_len = s_json_log ? FormatRfc3339Stamp( stamp, ns, s_stamp_pre )
+								  : FormatLogStamp( stamp, ns, s_stamp_pre );
+
+	// 延迟格式化的日志, 在此才真正格式化
+	static char fmt_buf[LOG_LINE_MAX];
+	string_view body = BodyOf( log, fmt_buf, sizeof( fmt_buf ) );
+
+	if( s_json_log ) {
+		line.append( "{\"ts\":\"" ).append( stamp, stamp_len );
+		line.append( "\",\"level\":\"" ).append( LOG_LEVEL_NAMES[log.level] );
+		line.append( "\",\"thread\":\"" );
+		AppendJson( line, ThreadNameOf( log.tid ) );
+		line.append( "\",\"msg\":\"" );
+		AppendJson( line, body );
+		line.push_back( '"' );
+		if( log.kvs > 0 )
+			FormatLogKvs( line, log.fields(), true );
+		line.append( "}\n" );
+	} else {
+		line.append( stamp, stamp_len ).push_back( ',' );
+		line.append( LOG_LEVEL_NAMES[log.level] ).push_back( ',' );
+		line.append( ThreadNameOf( log.tid ) ).push_back( ',' );
+		line.append( body );
+		if( log.kvs > 0 )
+			FormatLogKvs( line, log.fields(), false );
+		line.push_back( '\n' );
+	}
 
-	// 是否精确到秒以下
-	str_t nsec_str;
-	if( s_stamp_pre > 0 ) {
-		uint64_t sub_sec =
-			duration_cast<nanoseconds>( log.stamp - tpSecPart ).count();
-		sub_sec /= s_time_unit;
-		nsec_str = fmt( sub_sec, s_stamp_pre, 0, 0, '0' );
-		p_out << '.' << nsec_str;
+	const char* kept = nullptr;
+	if( !s_bin_log ) {
+		if( s_index.is_open() )
+			s_index.note( ns, s_log_out.size() );
+		kept = s_log_out.append( line.data(), line.size() );
+		s_writer_stats.bytes += line.size();
 	}
 
-	p_out << ',' << LOG_LEVEL_NAMES[log.level]
-		  << ',' << log.tname << ',' << log.body << "\n";
+	// 格式化好的行分发给想要它的其它输出
+	if( to_sinks )
+		for( auto& sink : s_sinks )
+			if( sink->wants( log.level ) )
+				sink->put( line.data(), line.size() );
 
 	// 要否也输出至stdout
 	if( !s_to_stdout )
 		return;
-	// 输出至stdout时还要不要时戳
-	if( s_sto_stamp ) {
-		std::cout << time_str;
-		if( s_stamp_pre > 0 )
-			std::cout << '.' << nsec_str;
-		std::cout << ',';
+	// 输出至stdout时还要不要时戳(JSON 行总是完整输出). 该行已在日志文件缓冲区里的话, 直接引用, 不必再拷贝
+	size_t skip = s_sto_stamp || s_json_log ? 0 : stamp_len + 1;
+	if( kept != nullptr )
+		s_sto_out.refer( kept + skip, line.size() - skip );
+	else
+		s_sto_out.append( line.data() + skip, line.size() - skip );
+};
+
+void WaitForLogs( const timespec& deadline_ ) {
+	// 先宣告要睡, 再复查一遍, 免得错过宣告之前刚入队的日志
+	uint32_t key = s_wake->prepare_wait();
+	if( QueuedLogs() > 0 || s_spill_end.load( mo_acquire ) > s_spill_read
+			|| ( s_ring.collecting() && s_ring.ready() ) || !s_should_run.load( mo_acquire ) || s_is_rolling.load( mo_acquire ) )
+		s_wake->cancel_wait();
+	else
+		s_wake->wait( key, deadline_ );
+};
+
+void FlushOutputs() {
+	s_sto_out.flush();
+	s_log_out.flush();
+	s_index.flush();
+	for( auto& sink : s_sinks )
+		sink->flush();
+	// 本轮有须落盘的, 再多也只 fdatasync 一次(组提交)
+	if( s_need_sync ) {
+		s_need_sync = false;
+		s_log_out.sync();
+		++s_writer_stats.syncs;
+	}
+};
+
+string_view BodyOf( const LogEntry_t& log_, char* buf_, size_t cap_ ) {
+	if( log_.lfmt == nullptr )
+		return log_.text();
+
+	size_t len = FormatLogArgs( buf_, cap_, log_.lfmt->fmt, log_.lfmt->types,
+								reinterpret_cast<const std::byte*>( log_.body.data() ) );
+	return string_view( buf_, len );
+};
+
+void InstallCrashHandler() {
+	// 信号处理函数里不能查时区, 先记下当前的UTC偏移
+	time_t now = time( nullptr );
+	tm tm_buf;
+	localtime_r( &now, &tm_buf );
+	s_utc_off = tm_buf.tm_gmtoff;
+	s_crash_file = s_log_file + ".crash";
+
+	struct sigaction act {};
+	act.sa_handler = CrashHandler;
+	act.sa_flags = SA_ONSTACK;
+	sigemptyset( &act.sa_mask );
+	for( size_t i = 0; i < std::size( FATAL_SIGNALS ); ++i )
+		sigaction( FATAL_SIGNALS[i], &act, &s_old_actions[i] );
+	s_handler_on = true;
+};
+
+void RemoveCrashHandler() {
+	if( !s_handler_on )
+		return;
+	for( size_t i = 0; i < std::size( FATAL_SIGNALS ); ++i )
+		sigaction( FATAL_SIGNALS[i], &s_old_actions[i], nullptr );
+	s_handler_on = false;
+};
+
+void ParkWriter() {
+	// 信号处理函数不能加锁, 只能用我们的快照: 停手前补上新建的队列. 锁被崩溃的线程占着的, 就用旧的
+	if( s_ques_ver.load( mo_acquire ) != s_writer_ques_ver ) {
+		unique_lock<std::mutex> lk( s_mtx4ques, std::try_to_lock );
+		if( lk.owns_lock() ) {
+			s_writer_ques = s_all_ques;
+			s_writer_ques_ver = s_ques_ver.load( mo_acquire );
+		}
+	}
+	s_writer_parked.store( true, mo_seq_cst );
+	s_writer_busy.store( false, mo_seq_cst );
+	for( ;; )
+		pause();
+};
+
+void PauseForFork() {
+	// 与 BeforeFork 配对: 它先计数再看 s_writer_busy, 我们先置 s_writer_busy 再看计数, 总有一方看得见另一方
+	while( s_forking.load( mo_seq_cst ) > 0 ) {
+		s_writer_busy.store( false, mo_seq_cst );
+		while( s_forking.load( mo_acquire ) > 0 )
+			std::this_thread::sleep_for( 10us );
+		s_writer_busy.store( true, mo_seq_cst );
+	}
+};
+
+void BeforeFork() {
+	// 日志线程此时要么在睡, 要么写完本轮就会停手. 它卡住了(比如写盘阻塞)也不要紧: 子进程反正要扔掉它的状态
+	s_forking.fetch_add( 1, mo_seq_cst );
+	steady_clock::time_point time_out = steady_clock::now() + FORK_WAIT_WRITER;
+	while( s_writer_busy.load( mo_seq_cst ) && steady_clock::now() < time_out )
+		std::this_thread::yield();
+
+	// 子进程里只剩 fork 的这个线程, 别的线程持有的锁就再也解不开了. 先都拿到手, fork 之后再放开
+	s_mtx4nids.lock();
+	s_mtx4ques.lock();
+	s_mtx4spill.lock();
+	s_mtx4stats.lock();
+	LockCompressor();
+	LockLevels();
+};
+
+void AfterForkParent() {
+	UnlockLevels();
+	UnlockCompressor();
+	s_mtx4stats.unlock();
+	s_mtx4spill.unlock();
+	s_mtx4ques.unlock();
+	s_mtx4nids.unlock();
+	s_forking.fetch_sub( 1, mo_seq_cst );
+};
+
+void AfterForkChild() {
+	UnlockLevels();
+	ForgetCompressor();
+	s_mtx4stats.unlock();
+	s_mtx4spill.unlock();
+	s_mtx4ques.unlock();
+	// 读写锁记着持有者的线程号, 子进程里的线程号变了, 解不了锁, 只能就地重建(反正只剩本线程)
+	new( &s_mtx4nids ) shared_mutex;
+	s_forking.store( 0, mo_relaxed );
+	// 收集者仍是父进程. 共享内存日志的生产者, 子进程接着往环里写就是了
+	if( s_ring.attached() )
+		s_ring.after_fork();
+	s_wake = &s_new_log;
+	s_collect_ring.clear();
+	if( !s_is_running.load( mo_acquire ) || s_ring_producer )
+		return;
+
+	// 日志线程及各输出的线程都没跟过来. 线程对象就地重建(析构会等一个不存在的线程);
+	// 各输出连同其线程对象一并弃之不顾, 按原设置重建
+	new( &s_writer ) thread;
+	vector<unique_ptr<LogSink_t>> sinks;
+	for( auto& sink : s_sinks ) {
+		sinks.push_back( make_unique<LogSink_t>( sink->target(), sink->level(), sink->async() ) );
+		sink.release();
+	}
+	s_sinks.swap( sinks );
+
+	// 队列里、缓冲区里、待汇总的日志都归父进程写, 这里只管扔掉
+	s_log_out.abandon();
+	s_sto_out.abandon();
+	s_index.abandon();
+	s_dedup.forget();
+	s_new_log.reset();
+	s_all_ques.clear();
+	s_writer_ques.clear();
+	s_ques_ver.fetch_add( 1, mo_release );
+	if( s_spill_fd >= 0 ) {
+		close( s_spill_fd );
+		s_spill_fd = -1;
+	}
+	RemoveCrashHandler();
+	s_should_run.store( false, mo_release );
+	s_is_rolling.store( false, mo_release );
+	s_auto_roll = false;
+	s_writer_busy.store( false, mo_release );
+	s_is_running.store( false, mo_release );
+	if( s_fork_log == ForkNoLog )
+		return;
+
+	// 父进程会自行轮转、压缩、清理的文件, 子进程写着写着就可能被压缩或删掉, 也只能各写各的
+	str_t parent_file = s_log_file;
+	bool per_pid = s_fork_log == ForkPerPid || s_bin_log || s_mmap_log || s_direct_log
+				   || s_rot_bytes > 0 || s_rot_every != NoRotate || CompressorOn();
+	s_share_file = !per_pid && parent_file != "/dev/null";
+	// StartLog 会把调用者登记为"MainThread", 子进程里的这个线程还用它在父进程里的名字
+	ThreadId_t my_id = tl_t_id;
+	try {
+		StartLog( per_pid ? PerPidFile( parent_file, getpid() ) : parent_file, g_base_level.load(),
+				  s_stamp_pre, s_que_capa, s_run_cpus, false, s_to_stdout, s_sto_stamp );
+	} catch( const std::exception& e ) {
+		s_share_file = false;
+		tl_t_id = my_id;
+		cerr << "fork 出的子进程(pid=" << getpid() << ")重启日志失败:" << e.what() << endl;
+		return;
+	}
+	tl_t_id = my_id;
+	AppendLog( LogLevel_e::Notif, "---------- 自父进程(pid=" + std::to_string( getppid() )
+			   + ") fork 而来, 日志已重启 ----------" );
+};
+
+str_t PerPidFile( str_cr file_, pid_t pid_ ) {
+	if( file_ == "/dev/null" )
+		return file_;
+	// 不用"主名-xxx"的形式, 免得被父进程当作轮转出的文件去压缩、清理
+	path p( file_ );
+	p.replace_filename( p.stem().string() + '.' + std::to_string( pid_ ) + p.extension().string() );
+	return p.string();
+};
+
+// 信号处理函数专用的行缓冲区(及 JSON 行转义前的正文), 及二进制日志时另存文本的文件
+static char	s_crash_line[LOG_LINE_MAX + 256];
+static char	s_crash_body[LOG_LINE_MAX];
+static int	s_crash_fd = -1;
+
+// 信号处理函数用: 不经 Write1Log, 只用纯计算把一条日志格式化为文本行, 返回行长
+static size_t CrashLine( LogStamp_t stamp_, LogLevel_e level_, string_view thread_,
+						 const LogFmt_t* lfmt_, string_view body_ ) {
+	char* p = s_crash_line;
+	char* end = s_crash_line + sizeof( s_crash_line ) - 1;	// 留一个给换行
+	auto put = [&p, end]( string_view sv_ ) {
+		size_t n = min<size_t>( sv_.size(), end - p );
+		std::memcpy( p, sv_.data(), n );
+		p += n;
+	};
+
+	// JSON 行(结构化字段就不要了)
+	if( s_json_log && !s_bin_log ) {
+		if( lfmt_ != nullptr )
+			body_ = string_view( s_crash_body, FormatLogArgs( s_crash_body, sizeof( s_crash_body ),
+								 lfmt_->fmt, lfmt_->types, reinterpret_cast<const std::byte*>( body_.data() ) ) );
+		put( "{\"ts\":\"" );
+		p += FormatRfc3339StampAt( p, duration_cast<nanoseconds>( stamp_.time_since_epoch() ).count(),
+								   s_stamp_pre, s_utc_off );
+		put( "\",\"level\":\"" );
+		put( LOG_LEVEL_NAMES[level_] );
+		put( "\",\"thread\":\"" );
+		p += EscapeJson( p, end - p, thread_ );
+		put( "\",\"msg\":\"" );
+		p += EscapeJson( p, end - p > 2 ? end - p - 2 : 0, body_ );
+		put( "\"}" );
+		*p++ = '\n';
+		return p - s_crash_line;
+	}
+
+	p += FormatLogStampAt( p, duration_cast<nanoseconds>( stamp_.time_since_epoch() ).count(),
+						   s_stamp_pre, s_utc_off );
+	put( "," );
+	put( LOG_LEVEL_NAMES[level_] );
+	put( "," );
+	put( thread_ );
+	put( "," );
+	if( lfmt_ != nullptr )
+		p += FormatLogArgs( p, end - p, lfmt_->fmt, lfmt_->types,
+							reinterpret_cast<const std::byte*>( body_.data() ) );
+	else
+		put( body_ );
+	*p++ = '\n';
+	return p - s_crash_line;
+};
+
+// 信号处理函数用: 文本日志直接写进日志文件; 二进制日志, 或日志线程没能停手(输出仍归它)、
+// 日志文件写不出去的, 另存至崩溃文件
+static void CrashOut( size_t size_ ) {
+	if( s_crash_fd < 0 ) {
+		s_log_out.crash_write( s_crash_line, size_ );
+		return;
+	}
+	for( const char* p = s_crash_line; s_crash_fd >= 0 && size_ > 0; ) {
+		ssize_t n = write( s_crash_fd, p, size_ );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			break;
+		p += n;
+		size_ -= n;
 	}
-	std::cout << LOG_LEVEL_NAMES[log.level]
-			  << ',' << log.tname << ',' << log.body << endl;
+};
+
+void CrashHandler( int sig_ ) {
+	// 只处理一次. 别的线程同时崩溃的, 等着进程被第一个处理者重发的信号终结
+	static abool_t entered { false };
+	if( entered.exchange( true ) )
+		for( ;; )
+			pause();
+
+	// 先叫停生产者及日志线程
+	s_crashing.store( true, mo_seq_cst );
+	timespec start;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	auto elapsed = [&start]() {
+		timespec now;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		return seconds( now.tv_sec - start.tv_sec ) + nanoseconds( now.tv_nsec - start.tv_nsec );
+	};
+
+	// 叫醒睡着的日志线程, 等它停手. 崩在日志线程里的就不必等了, 队列本来就归它(也就是我们)消费
+	bool in_writer = pthread_equal( pthread_self(), s_log_tid.load( mo_relaxed ) );
+	if( !in_writer )
+		s_wake->wake();
+	while( !in_writer && !s_writer_parked.load( mo_seq_cst ) && elapsed() < CRASH_WAIT_WRITER ) {
+		timespec one_ms { 0, 1000000 };
+		nanosleep( &one_ms, nullptr );
+	}
+	// 日志线程没能停手的话, 输出及队列都仍归它, 只能把崩溃标记另存
+	bool took_over = in_writer || s_writer_parked.load( mo_seq_cst );
+
+	// 接手了的, 先把日志线程攒着没写出的内容直接写进日志文件(二进制日志也是). 只动日志文件:
+	// 其它输出、stdout、索引的写出要加锁、分配内存, 重发信号后本来也就丢了
+	bool flushed = took_over && s_log_out.crash_flush();
+	if( s_bin_log || !flushed )
+		s_crash_fd = open( s_crash_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+
+	// 多路归并, 每次取队头时戳最早的一条. 不用堆, 免得分配内存.
+	// 队列清单用日志线程停手前的快照, 那之后新建的队列就抢救不到了
+	size_t saved = 0;
+	while( took_over ) {
+		ThreadQue_t* earliest = nullptr;
+		LogEntry_t* first = nullptr;
+		for( auto& tq : s_writer_ques ) {
+			LogEntry_t* head = tq->que.front();
+			if( head != nullptr && ( first == nullptr || head->stamp < first->stamp ) ) {
+				earliest = tq.get();
+				first = head;
+			}
+		}
+		if( first == nullptr )
+			break;
+
+		CrashOut( CrashLine( first->stamp, first->level, ThreadNameOf( first->tid ),
+							 first->lfmt, first->text() ) );
+		earliest->que.pop();
+		if( ++saved % 256 == 0 && elapsed() > CRASH_DRAIN_LIMIT )
+			break;
+	}
+
+	// 崩溃标记
+	char body[LogBody_t::INLINE_SIZE];
+	char* p = body;
+	char* end = body + sizeof( body );
+	auto put = [&p, end]( string_view sv_ ) {
+		size_t n = min<size_t>( sv_.size(), end - p );
+		std::memcpy( p, sv_.data(), n );
+		p += n;
+	};
+	size_t sig_idx = std::find( std::begin( FATAL_SIGNALS ), std::end( FATAL_SIGNALS ), sig_ )
+					 - std::begin( FATAL_SIGNALS );
+	put( "========== 进程收到致命信号 " );
+	p = std::to_chars( p, end, sig_ ).ptr;
+	put( "(" );
+	put( sig_idx < std::size( FATAL_SIG_NAMES ) ? FATAL_SIG_NAMES[sig_idx] : "?" );
+	put( "), 已从日志队列抢救出 " );
+	p = std::to_chars( p, end, saved ).ptr;
+	put( " 条日志 ==========" );
+	size_t len = CrashLine( system_clock::now(), LogLevel_e::Fatal,
+							tl_t_id == NO_THREAD_ID ? string_view( "?" ) : string_view( ThreadNameOf( tl_t_id ) ),
+							nullptr, string_view( body, p - body ) );
+	CrashOut( len );
+	write( STDERR_FILENO, s_crash_line, len );
+
+	if( s_crash_fd >= 0 )
+		close( s_crash_fd );
+	// 崩溃标记是 Fatal 的, 该落盘就落盘
+	if( flushed )
+		s_log_out.crash_close( s_sync_level <= LogLevel_e::Fatal );
+
+	// 交还给原先的处理方式(原先是忽略的, 改为缺省, 免得崩溃指令反复执行), 重发信号
+	if( sig_idx < std::size( FATAL_SIGNALS ) ) {
+		struct sigaction& old = s_old_actions[sig_idx];
+		if( !( old.sa_flags & SA_SIGINFO ) && old.sa_handler == SIG_IGN )
+			old.sa_handler = SIG_DFL;
+		sigaction( sig_, &old, nullptr );
+	}
+	raise( sig_ );
 };
 
 void RenameLogFile() {
+	// 自动轮转及未指定中缀的, 以文件开始写的时刻为中缀
+	str_t	infix = s_log_infix;
+	if( s_auto_roll || infix.empty() ) {
+		char buf[32];
+		tm lt;
+		localtime_r( &s_file_since, &lt );
+		infix.assign( buf, strftime( buf, sizeof( buf ), "%Y%m%d-%H%M%S", &lt ) );
+	}
+
 	path	old_path( s_log_file );
-	path	new_path = old_path.parent_path() /
-					   ( old_path.stem().string() + '-' + s_log_infix );
+	path	new_path = old_path.parent_path() / ( old_path.stem().string() + '-' + infix );
 	new_path += old_path.extension();
 
-	// 如果新起的文件名已被占用,就另想一个名字
-	char	suf_chr = 'a' - 1;
-	while( exists( new_path ) ) {
-		if( ++suf_chr > 'z' ) {
-			cerr << "改名日志文件(" << old_path
-				 << ")失败,期望文件名(" << new_path << ")已存在!";
-			return;
-		}
+	// 如果新起的文件名已被占用(或已有同名的压缩文件),就加上序号, 直到不重名
+	auto	taken = []( path p ) { return exists( p ) || exists( p += ".gz" ); };
+	for( unsigned seq = 1; taken( new_path ); ++seq ) {
 		new_path = old_path.parent_path() /
-				   ( old_path.stem().string() + '-' + s_log_infix + suf_chr );
+				   ( old_path.stem().string() + '-' + infix + '-' + std::to_string( seq ) );
 		new_path += old_path.extension();
 	}
-	rename( old_path, new_path );
+	std::error_code ec;
+	rename( old_path, new_path, ec );
+	if( ec ) {
+		cerr << "改名日志文件(" << old_path << ")失败:" << ec.message() << endl;
+		return;
+	}
+	// 索引跟着改名(没有就算了). 压缩后索引仍留着, 按块解压即可用
+	rename( s_log_file + ".idx", new_path.string() + ".idx", ec );
+	CompressLater( new_path );
+};
+
+str_t RotatedKey( str_cr live_, str_cr file_ ) {
+	// 只看文件名. 去掉".gz"及扩展名, 剩下"主名-YYYYMMDD-HHMMSS[-n]"; 压缩中途的".part"不算
+	path	live( live_ );
+	str_t	name = path( file_ ).filename().string();
+	str_t	ext = live.extension().string();
+	if( name.ends_with( ".gz" ) )
+		name.resize( name.size() - 3 );
+	str_t	prefix = live.stem().string() + '-';
+	if( !name.ends_with( ext ) || name.compare( 0, prefix.size(), prefix ) != 0 )
+		return {};
+	str_t	infix = name.substr( prefix.size(), name.size() - prefix.size() - ext.size() );
+
+	auto	digits = [&]( size_t pos_, size_t len_ ) {
+		return pos_ + len_ <= infix.size() && len_ > 0
+			   && std::all_of( infix.begin() + pos_, infix.begin() + pos_ + len_,
+							   []( char c_ ) { return c_ >= '0' && c_ <= '9'; } );
+	};
+	constexpr size_t STAMP_LEN = 15;	// "YYYYMMDD-HHMMSS"
+	if( !digits( 0, 8 ) || infix.size() < STAMP_LEN || infix[8] != '-' || !digits( 9, 6 ) )
+		return {};
+	// 序号补足位数, 好直接按字符串比较; 没有序号的在同一时刻的各序号之前
+	str_t	seq( 10, '0' );
+	if( infix.size() > STAMP_LEN ) {
+		size_t len = infix.size() - STAMP_LEN - 1;
+		if( infix[STAMP_LEN] != '-' || !digits( STAMP_LEN + 1, len ) || len > seq.size() )
+			return {};
+		seq.replace( seq.size() - len, len, infix, STAMP_LEN + 1, len );
+	}
+	return infix.substr( 0, STAMP_LEN ) + '-' + seq;
+};
+
+void PruneRotated() {
+	if( s_rot_keep == 0 )
+		return;
+
+	path	live( s_log_file );
+	path	dir = live.parent_path().empty() ? path( "." ) : live.parent_path();
+	vector<std::pair<str_t, path>> rotated;
+	std::error_code ec;
+	for( const auto& ent : directory_iterator( dir, ec ) ) {
+		str_t key = RotatedKey( s_log_file, ent.path().string() );
+		if( !key.empty() )
+			rotated.emplace_back( std::move( key ), ent.path() );
+	}
+	if( rotated.size() <= s_rot_keep )
+		return;
+
+	// 新的在前, 留下前 s_rot_keep 个
+	std::sort( rotated.begin(), rotated.end(), std::greater<>() );
+	for( size_t i = s_rot_keep; i < rotated.size(); ++i ) {
+		if( !remove( rotated[i].second, ec ) && ec )
+			cerr << "删除旧日志文件(" << rotated[i].second << ")失败:" << ec.message() << endl;
+		// 连同其索引("x.log.gz"的索引是"x.log.idx")
+		path idx = rotated[i].second;
+		if( idx.extension() == ".gz" )
+			idx.replace_extension();
+		remove( idx += ".idx", ec );
+	}
 };
 
 }; // namespace leon_log
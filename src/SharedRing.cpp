@@ -0,0 +1,297 @@
+#include <algorithm>	// min, max
+#include <bit>			// bit_ceil
+#include <cerrno>		// errno, ESRCH
+#include <csignal>		// kill
+#include <cstddef>		// offsetof
+#include <cstring>		// memcpy, memset, memcmp, strerror
+#include <fcntl.h>		// O_*
+#include <leonutils/Exceptions.hpp>
+#include <leonutils/MemoryOrder.hpp>
+#include <new>			// placement new
+#include <stdexcept>
+#include <sys/mman.h>	// shm_open, mmap, munmap
+#include <sys/stat.h>	// fstat
+#include <thread>
+#include <unistd.h>		// ftruncate, close, getpid
+
+#include "SharedRing.hpp"
+
+using namespace leon_utl;
+using namespace std::chrono;
+using namespace std::chrono_literals;
+using std::string_view;
+
+namespace leon_log {
+
+constexpr char		RING_MAGIC[8] = { 'L', 'E', 'O', 'N', 'R', 'I', 'N', 'G' };
+constexpr uint32_t	RING_VERSION = 1;
+// 头部独占一页, 槽位从第二页开始
+constexpr size_t	RING_HEAD_SIZE = 4096;
+
+struct SharedRing_t::Head_t {
+	char					magic[8];
+	std::atomic<uint32_t>	version { 0 };		// 创建者初始化完才置上
+	uint32_t				slot_size = 0;
+	uint64_t				slots = 0;
+	std::atomic<int32_t>	collector { 0 };	// 收集者的 pid, 没有为 0
+	// 生产者认领的下一个位置, 收集者要读的下一个位置, 各占一条缓存行
+	alignas( 64 ) std::atomic<uint64_t>	tail { 0 };
+	alignas( 64 ) std::atomic<uint64_t>	head { 0 };
+	std::atomic<uint64_t>	dropped { 0 };
+	std::atomic<uint64_t>	lost { 0 };
+	alignas( 64 ) EventCount_t	wake { true };
+};
+
+struct SharedRing_t::Slot_t {
+	std::atomic<uint64_t>	seq;		// ==位置: 空闲; ==位置+1: 已发布
+	std::atomic<int32_t>	owner;		// 认领者的 pid, 空闲时为 0
+	uint32_t				sum;		// rec 的校验和
+	RingRec_t				rec;
+};
+// 跨进程使用的原子量必须免锁
+static_assert( std::atomic<uint64_t>::is_always_lock_free && std::atomic<int32_t>::is_always_lock_free );
+
+// 校验和(FNV-1a), 覆盖头部字段及实际内容
+static uint32_t Checksum( const RingRec_t& rec_ ) {
+	const auto* p = reinterpret_cast<const unsigned char*>( &rec_ );
+	size_t len = offsetof( RingRec_t, body ) + std::min<size_t>( rec_.size, RING_BODY_MAX );
+	uint32_t h = 2166136261u;
+	for( size_t i = 0; i < len; ++i )
+		h = ( h ^ p[i] ) * 16777619u;
+	return h;
+};
+
+// 进程是否已不存在(没有权限发信号的也算活着)
+static bool IsDead( pid_t pid_ ) {
+	return pid_ == 0 || ( kill( pid_, 0 ) != 0 && errno == ESRCH );
+};
+
+SharedRing_t::Slot_t& SharedRing_t::slot( uint64_t pos_ ) const {
+	return reinterpret_cast<Slot_t*>( _base )[pos_ & ( _slots - 1 )];
+};
+
+void SharedRing_t::attach( str_cr name_, size_t slots_ ) {
+	static_assert( sizeof( Head_t ) <= RING_HEAD_SIZE && sizeof( Slot_t ) == 1024 );
+	detach();
+
+	str_t	shm = "/leonlog-" + name_;
+	size_t	slots = std::bit_ceil( std::max<size_t>( slots_, 2 ) );
+	size_t	size = RING_HEAD_SIZE + slots * sizeof( Slot_t );
+	int fd = shm_open( shm.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+	bool creator = fd >= 0;
+	if( !creator && errno == EEXIST )
+		fd = shm_open( shm.c_str(), O_RDWR | O_CLOEXEC, 0 );
+	if( fd < 0 )
+		throw std::runtime_error( "打开共享内存(" + shm + ")失败:" + std::strerror( errno ) );
+
+	struct stat st {};
+	if( creator ) {
+		if( ftruncate( fd, size ) != 0 ) {
+			int err = errno;
+			close( fd );
+			shm_unlink( shm.c_str() );
+			throw std::runtime_error( "创建共享内存(" + shm + ")失败:" + std::strerror( err ) );
+		}
+	} else {
+		// 别人刚创建的, 等它定下长度. 槽位数由创建者说了算
+		steady_clock::time_point time_out = steady_clock::now() + 1s;
+		while( fstat( fd, &st ) == 0 && static_cast<size_t>( st.st_size ) < RING_HEAD_SIZE
+				&& steady_clock::now() < time_out )
+			std::this_thread::sleep_for( 1ms );
+		size = st.st_size;
+	}
+	fstat( fd, &st );
+	void* p = size >= RING_HEAD_SIZE
+			  ? mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+	int err = errno;
+	close( fd );
+	if( p == MAP_FAILED )
+		throw std::runtime_error( "映射共享内存(" + shm + ")失败:" + std::strerror( err ) );
+
+	Head_t* head = static_cast<Head_t*>( p );
+	char* base = static_cast<char*>( p ) + RING_HEAD_SIZE;
+	if( creator ) {
+		new( head ) Head_t;
+		std::memcpy( head->magic, RING_MAGIC, sizeof( RING_MAGIC ) );
+		head->slot_size = sizeof( Slot_t );
+		head->slots = slots;
+		for( size_t i = 0; i < slots; ++i )
+			reinterpret_cast<Slot_t*>( base )[i].seq.store( i, mo_relaxed );
+		head->version.store( RING_VERSION, mo_release );
+	} else {
+		steady_clock::time_point time_out = steady_clock::now() + 1s;
+		while( head->version.load( mo_acquire ) == 0 && steady_clock::now() < time_out )
+			std::this_thread::sleep_for( 1ms );
+		if( std::memcmp( head->magic, RING_MAGIC, sizeof( RING_MAGIC ) ) != 0
+				|| head->version.load( mo_acquire ) != RING_VERSION || head->slot_size != sizeof( Slot_t )
+				|| std::popcount( head->slots ) != 1 || RING_HEAD_SIZE + head->slots * sizeof( Slot_t ) > size ) {
+			munmap( p, size );
+			throw std::runtime_error( "共享内存(" + shm + ")不是本版本的 leonlog 日志环!" );
+		}
+		slots = head->slots;
+	}
+
+	_name = name_;
+	_head = head;
+	_base = base;
+	_size = size;
+	_slots = slots;
+	_ino = st.st_ino;
+	_pid = getpid();
+	_stall_pos = UINT64_MAX;
+};
+
+void SharedRing_t::detach() {
+	if( _head == nullptr )
+		return;
+	resign();
+	munmap( _head, _size );
+	_head = nullptr;
+	_base = nullptr;
+	_size = 0;
+	_slots = 0;
+};
+
+bool SharedRing_t::stale() const {
+	int fd = shm_open( ( "/leonlog-" + _name ).c_str(), O_RDONLY | O_CLOEXEC, 0 );
+	if( fd < 0 )
+		return true;
+	struct stat st {};
+	bool same = fstat( fd, &st ) == 0 && st.st_ino == _ino;
+	close( fd );
+	return !same;
+};
+
+void SharedRing_t::after_fork() {
+	_pid = getpid();
+	_collecting = false;
+};
+
+bool SharedRing_t::put( int64_t stamp_, LogLevel_e level_, string_view label_, string_view thread_,
+						string_view body_, uint16_t kvs_ ) {
+	// 认领一个槽位: 它的序号等于认领位置才是空闲的
+	uint64_t pos = _head->tail.load( mo_relaxed );
+	Slot_t* s;
+	for( ;; ) {
+		s = &slot( pos );
+		int64_t dif = static_cast<int64_t>( s->seq.load( mo_acquire ) - pos );
+		if( dif == 0 ) {
+			if( _head->tail.compare_exchange_weak( pos, pos + 1, mo_relaxed ) )
+				break;
+		} else if( dif < 0 )
+			return false;	// 这个槽位上一圈的还没被读走, 环满了
+		else
+			pos = _head->tail.load( mo_relaxed );
+	}
+
+	s->owner.store( _pid, mo_relaxed );
+	RingRec_t& rec = s->rec;
+	rec.stamp = stamp_;
+	rec.level = static_cast<uint8_t>( level_ );
+	rec.size = static_cast<uint16_t>( std::min( body_.size(), RING_BODY_MAX ) );
+	// 截断了的结构化字段没法解读, 调用者应事先把它们转成文本
+	rec.kvs = body_.size() > RING_BODY_MAX ? 0 : kvs_;
+	std::memcpy( rec.body, body_.data(), rec.size );
+	char*	t = rec.thread;
+	size_t	room = RING_THREAD_MAX;
+	for( string_view part : { label_, string_view( "/" ), thread_ } ) {
+		size_t n = std::min( part.size(), room );
+		std::memcpy( t, part.data(), n );
+		t += n;
+		room -= n;
+	}
+	std::memset( t, 0, room );
+	s->sum = Checksum( rec );
+
+	// 发布. 序号已变说明收集者等不及, 已把这个槽位跳过了
+	uint64_t expect = pos;
+	if( s->seq.compare_exchange_strong( expect, pos + 1, mo_release, mo_relaxed ) )
+		_head->wake.notify();
+	return true;
+};
+
+void SharedRing_t::count_drop() {
+	_head->dropped.fetch_add( 1, mo_relaxed );
+};
+
+void SharedRing_t::collect() {
+	int32_t cur = _head->collector.load( mo_acquire );
+	do {
+		if( cur != _pid && !IsDead( cur ) )
+			throw bad_usage( "共享内存环(" + _name + ")已有收集者(pid=" + std::to_string( cur ) + ")!" );
+	} while( !_head->collector.compare_exchange_weak( cur, _pid, mo_acq_rel ) );
+
+	_collecting = true;
+	_stall_pos = UINT64_MAX;
+	// 上一个收集者可能死在睡觉时, 它留下的等待者计数作废
+	_head->wake.reset();
+};
+
+void SharedRing_t::resign() {
+	if( !_collecting )
+		return;
+	int32_t me = _pid;
+	_head->collector.compare_exchange_strong( me, 0, mo_acq_rel );
+	_collecting = false;
+};
+
+bool SharedRing_t::take( RingRec_t& rec_ ) {
+	for( ;; ) {
+		uint64_t pos = _head->head.load( mo_relaxed );
+		Slot_t& s = slot( pos );
+		uint64_t seq = s.seq.load( mo_acquire );
+		if( seq == pos + 1 ) {
+			std::memcpy( &rec_, &s.rec, offsetof( RingRec_t, body ) );
+			std::memcpy( rec_.body, s.rec.body, std::min<size_t>( rec_.size, RING_BODY_MAX ) );
+			bool intact = rec_.size <= RING_BODY_MAX && s.sum == Checksum( rec_ );
+			s.owner.store( 0, mo_relaxed );
+			s.seq.store( pos + _slots, mo_release );
+			_head->head.store( pos + 1, mo_release );
+			if( intact )
+				return true;
+			_head->lost.fetch_add( 1, mo_relaxed );
+			continue;
+		}
+		if( seq != pos || _head->tail.load( mo_acquire ) <= pos )
+			return false;
+
+		// 已被认领, 还没发布: 等一会儿, 等不到就跳过
+		steady_clock::time_point now = steady_clock::now();
+		if( _stall_pos != pos ) {
+			_stall_pos = pos;
+			_stall_since = now;
+			return false;
+		}
+		// 认领者是在认领之后才记下 pid 的, 还没记下(为0)的可能只是刚认领就被抢占了, 当它活着
+		pid_t owner = s.owner.load( mo_relaxed );
+		bool dead = owner != 0 && IsDead( owner );
+		if( now - _stall_since < ( dead ? steady_clock::duration( RING_DEAD_WAIT ) : RING_STALL_WAIT ) )
+			return false;
+		s.owner.store( 0, mo_relaxed );
+		if( !s.seq.compare_exchange_strong( seq, pos + _slots, mo_acq_rel ) )
+			continue;	// 恰好发布了, 照读
+		_head->head.store( pos + 1, mo_release );
+		_head->lost.fetch_add( 1, mo_relaxed );
+	}
+};
+
+bool SharedRing_t::ready() const {
+	uint64_t pos = _head->head.load( mo_relaxed );
+	return slot( pos ).seq.load( mo_acquire ) == pos + 1;
+};
+
+EventCount_t& SharedRing_t::wake() {
+	return _head->wake;
+};
+
+uint64_t SharedRing_t::dropped() const {
+	return _head->dropped.load( mo_relaxed );
+};
+
+uint64_t SharedRing_t::lost() const {
+	return _head->lost.load( mo_relaxed );
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
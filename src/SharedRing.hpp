@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <sys/types.h>	// pid_t, ino_t
+
+#include "leonlog/LeonLog.hpp"
+#include "leonlog/SharedLog.hpp"
+#include "EventCount.hpp"
+
+namespace leon_log {
+
+// 槽位里"标签/线程名"的最大长度
+constexpr size_t RING_THREAD_MAX = 31;
+// 收集者等一个认领了却没写完的槽位: 认领者已死, 或久等不至, 就跳过它
+constexpr auto RING_DEAD_WAIT = std::chrono::milliseconds( 50 );
+constexpr auto RING_STALL_WAIT = std::chrono::seconds( 2 );
+
+// RingRec_t: 一条日志在环里的样子(槽位去掉序号、认领者、校验和)
+struct RingRec_t {
+	int64_t		stamp;		// 日志时戳(自纪元起的纳秒数)
+	uint16_t	size;		// 内容长度
+	uint16_t	kvs;		// 结构化字段个数(同 LogEntry_t::kvs)
+	uint8_t		level;
+	char		thread[RING_THREAD_MAX];	// "标签/线程名", 不足补0
+	char		body[RING_BODY_MAX];
+};
+
+/* SharedRing_t: 多个进程共用的共享内存日志环, 生产者任意多个, 消费者(收集者)唯一. 不用锁:
+   定长槽位各带序号, 序号==位置 为空闲. 生产者原子地推进"认领位置"得到一个槽位, 写好内容, 再把序号从
+   位置改为位置+1 发布; 收集者按位置顺序读, 读完置为位置+容量, 留给下一圈.
+   认领了却迟迟不发布的槽位(生产者死在半路, 或被停住), 收集者查其认领者, 已死的等 RING_DEAD_WAIT,
+   活着的(以及还没来得及记下 pid 的)等 RING_STALL_WAIT, 然后抢先把序号改掉跳过它. 晚到的生产者就发布不了; 它若与下一圈的
+   写入撞了车, 内容由校验和查出丢弃. 所以任何进程死在任何地方, 环本身都不会乱.
+   收集者死了, 环满后生产者丢弃日志(计数), 新收集者从原处接着读 */
+class SharedRing_t {
+public:
+	SharedRing_t() = default;
+	~SharedRing_t() { detach(); };
+
+	SharedRing_t( const SharedRing_t& ) = delete;
+	SharedRing_t& operator=( const SharedRing_t& ) = delete;
+
+	// 打开(没有就按 slots_ 个槽位创建)名为 name_ 的环. 失败抛 runtime_error
+	void attach( str_cr name_, size_t slots_ );
+	// 辞去收集者(若是), 解除映射
+	void detach();
+	bool attached() const { return _head != nullptr; };
+	// 映射着的环已被删掉(或删了又建了新的)
+	bool stale() const;
+	str_cr name() const { return _name; };
+	size_t slots() const { return _slots; };
+
+	// fork 出的子进程: 更新认领槽位时记下的 pid, 不再是收集者(收集者仍是父进程)
+	void after_fork();
+
+	//-------- 生产者 --------
+	// 写一条日志. 环满返回 false; 认领到了就返回 true(即使最终因被跳过而没能发布)
+	bool put( int64_t stamp_, LogLevel_e, std::string_view label_, std::string_view thread_,
+			  std::string_view body_, uint16_t kvs_ );
+	// 环满而丢弃了一条
+	void count_drop();
+
+	//-------- 收集者 --------
+	// 登记为本环唯一的收集者, 已有活着的收集者则抛 bad_usage
+	void collect();
+	// 辞去收集者, 映射留着(本进程别的线程可能还在叫醒它)
+	void resign();
+	bool collecting() const { return _collecting; };
+	// 取出下一条已发布的日志, 没有则返回 false. 顺带跳过认领者已死(或久等不至)的槽位
+	bool take( RingRec_t& );
+	// 下一条已发布(可以取了)
+	bool ready() const;
+	// 收集者睡在这里, 别的进程的生产者也叫得醒
+	EventCount_t& wake();
+	// 生产者因环满丢弃的, 收集者跳过(含校验不符)的日志累计条数
+	uint64_t dropped() const;
+	uint64_t lost() const;
+
+private:
+	struct Head_t;
+	struct Slot_t;
+
+	Slot_t& slot( uint64_t pos_ ) const;
+
+	str_t		_name;
+	Head_t*		_head = nullptr;
+	char*		_base = nullptr;
+	size_t		_size = 0;		// 映射的总长度
+	size_t		_slots = 0;
+	ino_t		_ino = 0;		// 共享内存文件的 inode, 用来识别删了又建的同名环
+	pid_t		_pid = 0;
+	bool		_collecting = false;
+	// 收集者: 正在等的槽位位置, 及从何时开始等
+	uint64_t	_stall_pos = UINT64_MAX;
+	std::chrono::steady_clock::time_point	_stall_since;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
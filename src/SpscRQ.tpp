@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace leon_log {
+
+/* SpscRQ_t: 单生产者/单消费者环形队列
+   接口与 leon_utl::CraflinRQ_t 保持一致(enque/deque/size/capa), 另加 front/pop 供消费者"窥视"队头.
+   每个生产线程独占一个本队列, 唯一的消费者是日志线程, 因此入队、出队都无需CAS,
+   生产者只写 _tail, 消费者只写 _head, 两者分处不同缓存行, 不会互相"乒乓". */
+template <typename T>
+class SpscRQ_t {
+public:
+	explicit SpscRQ_t( size_t capa_ );
+	~SpscRQ_t();
+
+	SpscRQ_t( const SpscRQ_t& ) = delete;
+	SpscRQ_t& operator=( const SpscRQ_t& ) = delete;
+
+	// 以下仅限生产者调用
+	template <typename U>
+	bool enque( U&& );
+
+	// 以下仅限消费者调用
+	bool deque( T& );
+	// 队头元素, 队空时返回 nullptr
+	T* front();
+	// 弹出队头元素(调用前须确认 front() 非空)
+	void pop();
+
+	// 以下任何线程均可调用(只是个近似值)
+	size_t size() const;
+	size_t capa() const { return _mask + 1; };
+
+private:
+	struct alignas( T ) Slot_t { std::byte raw[sizeof( T )]; };
+
+	T* at( size_t i ) {
+		return std::launder( reinterpret_cast<T*>( _slots[i & _mask].raw ) );
+	};
+
+	static constexpr size_t CACHE_LINE = 64;
+
+	// 消费者的地盘
+	alignas( CACHE_LINE ) std::atomic<size_t>	_head { 0 };
+	size_t										_tail_cache { 0 };
+
+	// 生产者的地盘
+	alignas( CACHE_LINE ) std::atomic<size_t>	_tail { 0 };
+	size_t										_head_cache { 0 };
+
+	// 只读部分
+	alignas( CACHE_LINE ) size_t				_mask;
+	std::unique_ptr<Slot_t[]>					_slots;
+};
+
+template <typename T>
+SpscRQ_t<T>::SpscRQ_t( size_t capa_ ) {
+	// 容量向上取整为2的幂, 以便用掩码代替取模
+	size_t capa = 2;
+	while( capa < capa_ )
+		capa <<= 1;
+	_mask = capa - 1;
+	_slots = std::make_unique<Slot_t[]>( capa );
+};
+
+template <typename T>
+SpscRQ_t<T>::~SpscRQ_t() {
+	size_t tail = _tail.load( std::memory_order_acquire );
+	for( size_t i = _head.load( std::memory_order_relaxed ); i != tail; ++i )
+		at( i )->~T();
+};
+
+template <typename T>
+template <typename U>
+bool SpscRQ_t<T>::enque( U&& item_ ) {
+	size_t tail = _tail.load( std::memory_order_relaxed );
+	if( tail - _head_cache > _mask ) {
+		// 缓存的队头已显示队满, 再去读一次真正的队头(这才会碰到消费者的缓存行)
+		_head_cache = _head.load( std::memory_order_acquire );
+		if( tail - _head_cache > _mask )
+			return false;
+	}
+
+	new( _slots[tail & _mask].raw ) T( std::forward<U>( item_ ) );
+	_tail.store( tail + 1, std::memory_order_release );
+	return true;
+};
+
+template <typename T>
+T* SpscRQ_t<T>::front() {
+	size_t head = _head.load( std::memory_order_relaxed );
+	if( head == _tail_cache ) {
+		_tail_cache = _tail.load( std::memory_order_acquire );
+		if( head == _tail_cache )
+			return nullptr;
+	}
+	return at( head );
+};
+
+template <typename T>
+void SpscRQ_t<T>::pop() {
+	size_t head = _head.load( std::memory_order_relaxed );
+	at( head )->~T();
+	_head.store( head + 1, std::memory_order_release );
+};
+
+template <typename T>
+bool SpscRQ_t<T>::deque( T& item_ ) {
+	T* p = front();
+	if( p == nullptr )
+		return false;
+
+	item_ = std::move( *p );
+	pop();
+	return true;
+};
+
+template <typename T>
+size_t SpscRQ_t<T>::size() const {
+	size_t head = _head.load( std::memory_order_acquire );
+	size_t tail = _tail.load( std::memory_order_acquire );
+	return tail - head;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
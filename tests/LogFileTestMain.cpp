@@ -0,0 +1,12 @@
+#include <gtest/gtest.h>
+
+// 链接真实日志库的各项测试(tests/test*.cpp)都编进 ut-logfile, 共用此 main
+
+GTEST_API_ int main( int argc, char** argv ) {
+
+	testing::InitGoogleTest( &argc, argv );
+
+	return RUN_ALL_TESTS();
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
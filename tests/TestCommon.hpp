@@ -0,0 +1,85 @@
+#pragma once
+// ut-logfile 各用例共用的小工具: 读日志文件、计数、等子进程, 及每个用例前后清理文件的基类
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <initializer_list>
+#include <leonlog/LeonLog.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <string>
+#include <sys/wait.h>
+#include <vector>
+
+namespace leon_log {
+
+inline str_t ReadAll( const std::filesystem::path& file_ ) {
+	std::ifstream in( file_, std::ios_base::binary );
+	return str_t( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+};
+
+inline std::vector<str_t> ReadLines( str_cr file_ ) {
+	std::ifstream in( file_ );
+	std::vector<str_t> lines;
+	for( str_t line; std::getline( in, line ); )
+		lines.push_back( line );
+	return lines;
+};
+
+// what_ 在 text_ 中出现的次数
+inline size_t CountOf( str_cr text_, str_cr what_ ) {
+	size_t n = 0;
+	for( auto pos = text_.find( what_ ); pos != str_t::npos; pos = text_.find( what_, pos + 1 ) )
+		++n;
+	return n;
+};
+
+// 含有 what_ 的行数
+inline size_t CountOf( const std::vector<str_t>& lines_, str_cr what_ ) {
+	size_t n = 0;
+	for( str_cr line : lines_ )
+		n += line.find( what_ ) != str_t::npos;
+	return n;
+};
+
+// 等子进程退出, 返回其退出码(异常退出为-1)
+inline int WaitChild( pid_t child_ ) {
+	int status = 0;
+	if( waitpid( child_, &status, 0 ) != child_ || !WIFEXITED( status ) )
+		return -1;
+	return WEXITSTATUS( status );
+};
+
+// 日志运行期间, set_ 所调的 Set*() 应该抛 bad_usage
+template <typename F>
+void AssertFixedWhileLogging( str_cr log_file_, F&& set_ ) {
+	StartLog( log_file_, LogLevel_e::Debug, 6, 1024, "", false, false );
+	ASSERT_THROW( set_(), leon_utl::bad_usage );
+	StopLog( false, false );
+};
+
+// 用例前后都删掉所列的文件(或目录), 用例结束时总会停掉日志.
+// 派生类复原自己改过的设定, 须在调过本类的 TearDown 之后(日志运行时 Set*() 会抛异常)
+class LogFileTest : public testing::Test {
+protected:
+	LogFileTest( std::initializer_list<str_t> paths_ ) : _paths( paths_ ) {};
+
+	void SetUp() override {
+		RemoveAll();
+	};
+	void TearDown() override {
+		StopLog( false, false );
+		RemoveAll();
+	};
+
+	void RemoveAll() {
+		for( str_cr p : _paths )
+			std::filesystem::remove_all( p );
+	};
+
+	std::vector<str_t> _paths;
+};
+
+}; // namespace leon_log
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -1,9 +1,13 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <iomanip>
 #include <iostream>
 #include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonlog/LogLimit.hpp>
 #include <leonlog/LogSet.hpp>
 #include <sstream>
+#include <thread>
 
 using namespace leon_log;
 using namespace std;
@@ -21,13 +25,37 @@ ost_t& operator<<( ost_t& os_, const Custom_t& cd_ ) {
 
 namespace leon_log {
 
-LogLevel_e	g_log_level = LogLevel_e::Debug;
-str_t		s_log_buf;
+std::atomic<LogLevel_e>	g_log_level { LogLevel_e::Debug };
+std::atomic<LogLevel_e>	g_base_level { LogLevel_e::Debug };
+str_t					s_log_buf;
+size_t					s_log_count = 0;
 
 // 这是 AppendLog 的 fake
 template <typename T>
 bool AppendLog( LogLevel_e, T&& body_ ) {
 	s_log_buf = body_;
+	++s_log_count;
+	return true;
+};
+
+// 这是 AppendLogKv 的 fake, 正文及字段按文本格式拼在一起
+bool AppendLogKv( LogLevel_e, str_t&& body_, uint16_t ) {
+	uint32_t text_len;
+	std::memcpy( &text_len, body_.data() + body_.size() - sizeof( text_len ), sizeof( text_len ) );
+	s_log_buf.assign( body_, 0, text_len );
+	FormatLogKvs( s_log_buf, stv_t( body_ ).substr( text_len, body_.size() - text_len - sizeof( text_len ) ),
+				  false );
+	++s_log_count;
+	return true;
+};
+
+// 这是 AppendLogArgs 的 fake, 直接在本线程格式化
+bool AppendLogArgs( LogLevel_e, const LogFmt_t* fmt_, const void* args_, size_t ) {
+	char buf[256];
+	size_t len = FormatLogArgs( buf, sizeof( buf ), fmt_->fmt, fmt_->types,
+								static_cast<const std::byte*>( args_ ) );
+	s_log_buf.assign( buf, len );
+	++s_log_count;
 	return true;
 };
 
@@ -132,6 +160,239 @@ TEST( TestLog, loggingSet ) {
 	ASSERT_EQ( s_log_buf, "{}" );
 };
 
+// 快速通道输出的数值应与 ostream 缺省格式完全相同
+TEST( TestLog, numbersLikeOstream ) {
+	const double dbls[] = { 0.0, -0.0, 12.5, 3.14159265358979, 1e-7, 123456789.0, 1.0 / 3 };
+	for( double d : dbls ) {
+		oss_t oss;
+		oss << d;
+		s_log_buf.clear();
+		lg_debg << d;
+		ASSERT_EQ( s_log_buf, oss.str() );
+	}
+
+	s_log_buf.clear();
+	lg_debg << int8_t( -5 ) << ',' << uint16_t( 65535 ) << ',' << -1234567890123LL
+			<< ',' << true << ',' << 2.5f;
+	ASSERT_EQ( s_log_buf, "\xfb,65535,-1234567890123,1,2.5" );
+};
+
+TEST( TestLog, manipulators ) {
+	s_log_buf.clear();
+	lg_debg << std::hex << 255 << ',' << std::setw( 4 ) << std::setfill( '0' ) << 7;
+	ASSERT_EQ( s_log_buf, "ff,0007" );
+
+	// 操纵符的效果不应带入下一条日志
+	s_log_buf.clear();
+	lg_debg << 255;
+	ASSERT_EQ( s_log_buf, "255" );
+
+	s_log_buf.clear();
+	lg_debg << "行" << endl;
+	ASSERT_EQ( s_log_buf, "行\n" );
+};
+
+// 输出日志内容的过程中又产生了日志
+struct Nested_t {};
+ost_t& operator<<( ost_t& os_, const Nested_t& ) {
+	lg_debg << "内层";
+	return os_ << "外层的一部分";
+};
+
+TEST( TestLog, nestedLogging ) {
+	str_t inner;
+	s_log_buf.clear();
+	{
+		Log_t lg { Debug };
+		lg << "外层:" << Nested_t {};
+		inner = s_log_buf;
+	}
+	ASSERT_EQ( inner, "内层" );
+	ASSERT_EQ( s_log_buf, "外层:外层的一部分" );
+};
+
+TEST( TestLog, deferredFormat ) {
+	s_log_buf.clear();
+	LOGF( LogLevel_e::Infor, "px={} qty={}", 12.5, 300 );
+	ASSERT_EQ( s_log_buf, "px=12.5 qty=300" );
+
+	s_log_buf.clear();
+	LOGF( LogLevel_e::Infor, "无参数" );
+	ASSERT_EQ( s_log_buf, "无参数" );
+
+	s_log_buf.clear();
+	LOGF( LogLevel_e::Notif, "{:.2},{:x},{},{},{{}}", 3.14159, 255u, 'c', true );
+	ASSERT_EQ( s_log_buf, "3.14,ff,c,true,{}" );
+
+	s_log_buf.clear();
+	LOGF( LogLevel_e::Warnn, "{} {}", LogLevel_e::Error, static_cast<void*>( nullptr ) );
+	ASSERT_EQ( s_log_buf, "4 {nullptr}" );
+
+	// 占位符多于参数, 多出的原样输出
+	s_log_buf.clear();
+	LOGF( LogLevel_e::Error, "{}-{}", int64_t( -7 ) );
+	ASSERT_EQ( s_log_buf, "-7-{}" );
+
+	// 低于日志级别的不应输出
+	s_log_buf.clear();
+	g_log_level = LogLevel_e::Error;
+	LOGF( LogLevel_e::Debug, "{}", 1 );
+	g_log_level = LogLevel_e::Debug;
+	ASSERT_TRUE( s_log_buf.empty() );
+};
+
+TEST( TestLog, structuredFields ) {
+	// 字段保留类型, 跟在正文之后
+	lg_info.kv( "order_id", 42 ).kv( "px", 1.25 ).kv( "side", "buy" ).kv( "ok", true ) << "成交";
+	ASSERT_EQ( s_log_buf, "成交 order_id=42 px=1.25 side=buy ok=true" );
+
+	// 正文与字段可交错, 含空白、引号的字符串值加引号转义, 其它类型借道 ostream
+	lg_warn.kv( "max", UINT64_MAX ) << "大";
+	ASSERT_EQ( s_log_buf, "大 max=18446744073709551615" );
+	lg_warn.kv( "why", "no \"money\"" ) << "拒单" << std::hex << 255;
+	ASSERT_EQ( s_log_buf, "拒单ff why=\"no \\\"money\\\"\"" );
+	lg_note.kv( "who", Custom_t { "张三" } ).kv( "empty", str_t() ).kv( "lvl", LogLevel_e::Error );
+	ASSERT_EQ( s_log_buf, " who=张三 empty=\"\" lvl=4" );
+
+	// 低于日志级别的不应输出
+	s_log_count = 0;
+	g_log_level = LogLevel_e::Error;
+	lg_info.kv( "x", 1 ) << "低";
+	g_log_level = LogLevel_e::Debug;
+	ASSERT_EQ( s_log_count, 0u );
+
+	// 字段不会漏到下一条日志里
+	lg_info << "无字段";
+	ASSERT_EQ( s_log_buf, "无字段" );
+};
+
+TEST( TestLog, jsonEscaping ) {
+	str_t out;
+	AppendJson( out, "a\"b\\c\n\t\x01中文" );
+	ASSERT_EQ( out, "a\\\"b\\\\c\\n\\t\\u0001中文" );
+
+	// 不截断半个转义序列
+	char buf[3];
+	ASSERT_EQ( EscapeJson( buf, sizeof( buf ), "ab\n" ), 2u );
+
+	// 打包的字段输出为 JSON 字段, 非有限的浮点数为 null
+	str_t fields;
+	auto head = [&fields]( char code_, stv_t key_ ) {
+		fields.push_back( code_ );
+		fields.push_back( static_cast<char>( key_.size() ) );
+		fields.append( key_ );
+	};
+	double px = 0.1, inf = 1.0 / 0.0;
+	int64_t qty = -3;
+	uint32_t len = 4;
+	head( 'd', "px" );
+	fields.append( reinterpret_cast<const char*>( &px ), sizeof( px ) );
+	head( 'l', "qty" );
+	fields.append( reinterpret_cast<const char*>( &qty ), sizeof( qty ) );
+	head( 'd', "bad" );
+	fields.append( reinterpret_cast<const char*>( &inf ), sizeof( inf ) );
+	head( 'z', "k\"" );
+	fields.append( reinterpret_cast<const char*>( &len ), sizeof( len ) ).append( "v\"\n " );
+	out.clear();
+	FormatLogKvs( out, fields, true );
+	ASSERT_EQ( out, ",\"px\":0.1,\"qty\":-3,\"bad\":null,\"k\\\"\":\"v\\\"\\n \"" );
+	out.clear();
+	FormatLogKvs( out, fields, false );
+	ASSERT_EQ( out, " px=0.1 qty=-3 bad=inf \"k\\\"\"=\"v\\\"\\n \"" );
+};
+
+TEST( TestLog, stampWithoutTimezone ) {
+	// 与 gmtime/strftime 比对, 覆盖闰年、世纪年、年末及1970年以前
+	const int64_t secs[] = { 0, 951782400, 951868799, 1735689599, 1735689600,
+							 4107542400, -86400, -1, 1700000000 };
+	char got[LOG_STAMP_MAX], want[LOG_STAMP_MAX];
+	for( int64_t sec : secs )
+		for( size_t prec : { 0, 3, 9 } ) {
+			int64_t ns = sec * 1000000000 + 123456789;
+			time_t t = sec;
+			tm tm_buf;
+			gmtime_r( &t, &tm_buf );
+			size_t len = strftime( want, sizeof( want ), "%y/%m/%d %H:%M:%S", &tm_buf );
+			if( prec > 0 )
+				len += snprintf( want + len, sizeof( want ) - len, ".%.*s", int( prec ), "123456789" );
+			ASSERT_EQ( str_t( got, FormatLogStampAt( got, ns, prec, 0 ) ), str_t( want, len ) );
+
+			len = strftime( want, sizeof( want ), "%Y-%m-%dT%H:%M:%S", &tm_buf );
+			if( prec > 0 )
+				len += snprintf( want + len, sizeof( want ) - len, ".%.*s", int( prec ), "123456789" );
+			len += snprintf( want + len, sizeof( want ) - len, "+00:00" );
+			ASSERT_EQ( str_t( got, FormatRfc3339StampAt( got, ns, prec, 0 ) ), str_t( want, len ) );
+		}
+
+	// 时区偏移只是平移, RFC 3339 的另注明偏移
+	ASSERT_EQ( str_t( got, FormatLogStampAt( got, 0, 0, 8 * 3600 ) ), "70/01/01 08:00:00" );
+	ASSERT_EQ( str_t( got, FormatRfc3339StampAt( got, 0, 0, 8 * 3600 ) ), "1970-01-01T08:00:00+08:00" );
+	ASSERT_EQ( str_t( got, FormatRfc3339StampAt( got, -1, 3, -( 5 * 3600 + 1800 ) ) ),
+			   "1969-12-31T18:29:59.999-05:30" );
+};
+
+TEST( TestLog, rateLimited ) {
+	// 每 N 次一条, 放行的注明此前略过的条数
+	s_log_count = 0;
+	for( int i = 0; i < 25; ++i )
+		LOG_EVERY_N( LogLevel_e::Warnn, 10 ) << "every=" << i;
+	ASSERT_EQ( s_log_count, 3u );
+	ASSERT_EQ( s_log_buf, "every=20 (此前略过9条)" );
+
+	s_log_count = 0;
+	for( int i = 0; i < 25; ++i )
+		LOGF_EVERY_N( LogLevel_e::Warnn, 10, "everyf={}", i );
+	ASSERT_EQ( s_log_count, 3u );
+	ASSERT_EQ( s_log_buf, "everyf=20 (此前略过9条)" );
+
+	// 只输出前 N 条, 被略过的连日志内容都不构造
+	s_log_count = 0;
+	int built = 0;
+	auto body = [&built] { return ++built; };
+	for( int i = 0; i < 25; ++i )
+		LOG_FIRST_N( LogLevel_e::Warnn, 3 ) << "first=" << body();
+	ASSERT_EQ( s_log_count, 3u );
+	ASSERT_EQ( built, 3 );
+	ASSERT_EQ( s_log_buf, "first=3" );
+
+	// 每秒最多 N 条(令牌桶): 一下子只放行 N 条, 此后每 1/N 秒补一条, 放行的报告此前略过的
+	s_log_count = 0;
+	auto per_sec = [] ( int i ) { LOGF_N_PER_SEC( LogLevel_e::Warnn, 5, "persec={}", i ); };
+	auto t0 = std::chrono::steady_clock::now();
+	int calls = 0;
+	for( ; calls < 1000; ++calls )
+		per_sec( calls );
+	if( std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds( 100 ) ) {	// 太慢的话就不比了
+		ASSERT_EQ( s_log_count, 5u );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+		per_sec( calls++ );
+		per_sec( calls++ );
+		ASSERT_EQ( s_log_count, 6u );
+		ASSERT_EQ( s_log_buf, "persec=1000 (此前略过995条)" );
+	}
+
+	// 放行完 N 条后过了 1/4 秒, 只补回了 N/4 条(按秒开窗口的话, 跨过整秒就又是 N 条)
+	s_log_count = 0;
+	auto per_sec10 = [] { LOG_N_PER_SEC( LogLevel_e::Warnn, 10 ) << "persec10"; };
+	t0 = std::chrono::steady_clock::now();
+	for( int i = 0; i < 1000; ++i )
+		per_sec10();
+	std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+	for( int i = 0; i < 1000; ++i )
+		per_sec10();
+	if( std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds( 290 ) ) {
+		ASSERT_EQ( s_log_count, 12u );
+	}
+
+	// 低于日志级别的, 连计数也不动
+	g_log_level = LogLevel_e::Error;
+	s_log_count = 0;
+	for( int i = 0; i < 25; ++i )
+		LOG_EVERY_N( LogLevel_e::Warnn, 1 ) << "low";
+	g_log_level = LogLevel_e::Debug;
+	ASSERT_EQ( s_log_count, 0u );
+};
+
 }; // namespace leon_log
 
 // 在命名空间之外,再试试
@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonutils/Chrono.hpp>
+#include <string>
+
+using namespace leon_utl;
+using namespace leon_log;
+using namespace std::chrono;
+using namespace std;
+
+// 日志线程"格式化"阶段的微基准: 把一条日志拼成 "时戳,级别,线程,内容\n" 的一行.
+// 旧法: 每条日志都 strftime 出秒以上部分, 再 fmt 出秒以下部分(即以前的 Write1Log)
+// 新法: 同一秒内复用缓存的前缀, 秒以下部分查表生成(FormatLogStamp)
+// 用法: bench-format [条数,缺省1000万] [时戳精度,缺省6] [相邻日志的时间间隔ns,缺省100]
+
+constexpr char_cp LOG_STAMP_FORMAT = "%y/%m/%d %H:%M:%S";
+
+const str_t s_level { "NOTIF" };
+const str_t s_thread { "MarketData07" };
+const str_t s_body { "IF2412 px=3921.4 qty=12 bid=3921.2 ask=3921.6" };
+
+size_t FormatOld( str_t& line_, LogStamp_t stamp_, size_t prec_, uint64_t time_unit_ ) {
+	LogStamp_t sec_part = time_point_cast<LogStamp_t::duration>( floor<seconds>( stamp_ ) );
+	line_ = fmt( sec_part, LOG_STAMP_FORMAT );
+	if( prec_ > 0 ) {
+		uint64_t sub_sec = duration_cast<nanoseconds>( stamp_ - sec_part ).count();
+		sub_sec /= time_unit_;
+		line_ += '.';
+		line_ += fmt( sub_sec, prec_, 0, 0, '0' );
+	}
+	line_.append( 1, ',' ).append( s_level ).append( 1, ',' ).append( s_thread )
+	.append( 1, ',' ).append( s_body ).append( 1, '\n' );
+	return line_.size();
+};
+
+size_t FormatNew( str_t& line_, LogStamp_t stamp_, size_t prec_ ) {
+	char stamp[LOG_STAMP_MAX];
+	size_t len = FormatLogStamp(
+		stamp, duration_cast<nanoseconds>( stamp_.time_since_epoch() ).count(), prec_ );
+	line_.clear();
+	line_.append( stamp, len ).append( 1, ',' ).append( s_level ).append( 1, ',' )
+	.append( s_thread ).append( 1, ',' ).append( s_body ).append( 1, '\n' );
+	return line_.size();
+};
+
+template <typename F>
+double Measure( char_cp name_, uint64_t count_, F&& format_ ) {
+	uint64_t checksum = 0;
+	auto start = steady_clock::now();
+	for( uint64_t i = 0; i < count_; ++i )
+		checksum += format_( i );
+	double secs = duration<double>( steady_clock::now() - start ).count();
+	double rate = count_ / secs;
+	cout << setw( 6 ) << name_ << ": " << fixed << setprecision( 0 ) << setw( 12 )
+		 << rate << " 条/秒, " << setprecision( 1 ) << secs * 1e9 / count_
+		 << " ns/条 (校验和" << checksum << ')' << endl;
+	return rate;
+};
+
+int main( int argc, char** argv ) {
+	uint64_t count = argc > 1 ? strtoull( argv[1], nullptr, 10 ) : 10000000;
+	size_t   prec  = argc > 2 ? strtoul( argv[2], nullptr, 10 ) : 6;
+	uint64_t gap   = argc > 3 ? strtoull( argv[3], nullptr, 10 ) : 100;
+	prec = min<size_t>( prec, 9 );
+	uint64_t time_unit = 1;
+	for( size_t i = prec; i < 9; ++i )
+		time_unit *= 10;
+
+	cout << "条数:" << count << ", 时戳精度:" << prec << ", 日志间隔:" << gap << "ns" << endl;
+
+	const LogStamp_t base = system_clock::now();
+	str_t line;
+	line.reserve( 256 );
+
+	// 先确认两种方法的输出完全一致
+	str_t line_old;
+	for( uint64_t i = 0; i < 100000; ++i ) {
+		LogStamp_t stamp = base + nanoseconds( i * 12345 );
+		FormatOld( line_old, stamp, prec, time_unit );
+		FormatNew( line, stamp, prec );
+		if( line != line_old ) {
+			cerr << "输出不一致!\n旧法:" << line_old << "新法:" << line;
+			return EXIT_FAILURE;
+		}
+	}
+
+	double old_rate = Measure( "旧法", count, [&]( uint64_t i ) {
+		return FormatOld( line, base + nanoseconds( i * gap ), prec, time_unit );
+	} );
+	double new_rate = Measure( "新法", count, [&]( uint64_t i ) {
+		return FormatNew( line, base + nanoseconds( i * gap ), prec );
+	} );
+
+	cout << "提速: " << setprecision( 2 ) << new_rate / old_rate << " 倍" << endl;
+	return EXIT_SUCCESS;
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
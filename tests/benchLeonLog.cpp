@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <leonlog/LeonLog.hpp>
+#include <leonutils/Converts.hpp>
+#include <sstream>
+#include <syslog.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace leon_utl;
+using namespace leon_log;
+using namespace std::chrono;
+using namespace std;
+
+/* 吞吐及延迟基准: 按 线程数 x 日志长度 x 队列容量 x 时戳精度 逐一组合, 每种组合分别写日志文件、
+   写 /dev/null(只看日志库本身, 不计磁盘), 再以 syslog 作为对照. 每轮报告:
+	生产者延迟(单次 lg_info 的耗时)的 p50/p99/p99.9/最大值,
+	持续吞吐(从开始写到 StopLog 写完为止, 每秒条数), 及因队列满而丢弃的条数.
+   每次计时本身约有几十ns开销, 各轮都一样, 不影响前后版本对比. 用 --csv 输出便于存档比较.
+   用法: bench-leonlog [-T 线程数,缺省"1,4"] [-M 日志长度,缺省"32,256"] [-Q 队列容量,缺省"256,8192"]
+					  [-P 时戳精度,缺省"6"] [-N 每线程条数,缺省200000] [-F 日志文件,缺省"bench-leonlog.log"]
+					  [-B 队满时阻塞而非丢弃] [--no-syslog] [--csv] */
+
+// 一轮的结果
+struct Result_t {
+	str_t		sink;
+	int			threads;
+	size_t		msg_size;
+	size_t		que_capa;
+	size_t		precision;
+	uint64_t	p50;
+	uint64_t	p99;
+	uint64_t	p999;
+	uint64_t	max;
+	double		rate;
+	uint64_t	dropped;
+};
+
+// 解析命令行参数
+void parseCmdLineOpts( int, const char* const* const );
+
+vector<size_t>	s_thread_counts { 1, 4 };
+vector<size_t>	s_msg_sizes { 32, 256 };
+vector<size_t>	s_que_sizes { 256, 8192 };
+vector<size_t>	s_precisions { 6 };
+uint64_t		s_count = 200000;
+str_t			s_log_file { "bench-leonlog.log" };
+bool			s_block = false;
+bool			s_syslog = true;
+bool			s_csv = false;
+
+// 跑一轮: sink_ 为日志文件路径, 或 "syslog"
+Result_t RunOne( str_cr sink_, size_t threads_, size_t msg_size_, size_t capa_, size_t prec_ ) {
+	bool to_syslog = sink_ == "syslog";
+	if( !to_syslog )
+		StartLog( sink_, LogLevel_e::Debug, prec_, capa_, "", false, false );
+
+	const str_t body( msg_size_, 'x' );
+	vector<vector<uint32_t>> lats( threads_ );
+	atomic<size_t> ready { 0 };
+	atomic_bool go { false };
+	vector<thread> runners;
+	for( size_t t = 0; t < threads_; ++t )
+		runners.emplace_back( [&, t] {
+			RegistThread( "bench" + fmt( t, 2, 0, 0, '0' ) );
+			vector<uint32_t>& lat = lats[t];
+			lat.resize( s_count );
+			++ready;
+			while( !go.load( memory_order_acquire ) )
+				;
+			for( uint64_t i = 0; i < s_count; ++i ) {
+				auto before = steady_clock::now();
+				if( to_syslog )
+					syslog( LOG_INFO, "%s", body.c_str() );
+				else
+					lg_info << body;
+				int64_t ns = duration_cast<nanoseconds>( steady_clock::now() - before ).count();
+				lat[i] = static_cast<uint32_t>( min<int64_t>( ns, UINT32_MAX ) );
+			}
+		} );
+	while( ready.load() < threads_ )
+		this_thread::yield();
+
+	auto start = steady_clock::now();
+	go.store( true, memory_order_release );
+	for( auto& r : runners )
+		r.join();
+	if( !to_syslog )
+		StopLog( false, false );
+	double secs = duration<double>( steady_clock::now() - start ).count();
+
+	vector<uint32_t> all;
+	all.reserve( threads_ * s_count );
+	for( auto& lat : lats )
+		all.insert( all.end(), lat.begin(), lat.end() );
+	auto pct = [&all]( double p_ ) {
+		size_t k = min( all.size() - 1, static_cast<size_t>( p_ * all.size() ) );
+		nth_element( all.begin(), all.begin() + k, all.end() );
+		return uint64_t( all[k] );
+	};
+
+	Result_t res { sink_, int( threads_ ), msg_size_, capa_, prec_ };
+	res.p50 = pct( 0.5 );
+	res.p99 = pct( 0.99 );
+	res.p999 = pct( 0.999 );
+	res.max = *max_element( all.begin(), all.end() );
+	res.rate = all.size() / secs;
+	res.dropped = to_syslog ? 0 : DroppedLogs( LogLevel_e::Infor );
+	if( to_syslog )
+		res.que_capa = res.precision = 0;
+	if( sink_ != "/dev/null" && !to_syslog )
+		unlink( sink_.c_str() );
+	return res;
+};
+
+void Report( const Result_t& r_ ) {
+	if( s_csv ) {
+		cout << r_.sink << ',' << r_.threads << ',' << r_.msg_size << ',' << r_.que_capa << ','
+			 << r_.precision << ',' << r_.p50 << ',' << r_.p99 << ',' << r_.p999 << ',' << r_.max << ','
+			 << fixed << setprecision( 0 ) << r_.rate << ',' << r_.dropped << endl;
+		return;
+	}
+	cout << setw( 20 ) << r_.sink << setw( 6 ) << r_.threads << setw( 7 ) << r_.msg_size
+		 << setw( 8 ) << r_.que_capa << setw( 5 ) << r_.precision
+		 << setw( 9 ) << r_.p50 << setw( 9 ) << r_.p99 << setw( 10 ) << r_.p999 << setw( 11 ) << r_.max
+		 << fixed << setprecision( 0 ) << setw( 13 ) << r_.rate << setw( 11 ) << r_.dropped << endl;
+};
+
+int main( int argc, char** argv ) {
+	parseCmdLineOpts( argc, argv );
+	if( s_block )
+		SetOverflowPolicy( LogLevel_e::Infor, Block, hours( 24 ) );
+	if( s_syslog )
+		openlog( "bench-leonlog", LOG_NDELAY | LOG_PID, LOG_USER );
+
+	if( s_csv )
+		cout << "sink,threads,msg_size,que_capa,precision,p50_ns,p99_ns,p999_ns,max_ns,entries_per_sec,dropped"
+			 << endl;
+	else
+		cout << "日志库版本:" << Version() << ", 每线程条数:" << s_count
+			 << ", 队满时:" << ( s_block ? "阻塞" : "丢弃" ) << '\n'
+			 << setw( 20 ) << "输出" << setw( 6 ) << "线程" << setw( 7 ) << "长度"
+			 << setw( 8 ) << "队列" << setw( 5 ) << "精度"
+			 << setw( 9 ) << "p50" << setw( 9 ) << "p99" << setw( 10 ) << "p99.9" << setw( 11 ) << "max(ns)"
+			 << setw( 13 ) << "条/秒" << setw( 11 ) << "丢弃" << endl;
+
+	for( size_t threads : s_thread_counts )
+		for( size_t msg_size : s_msg_sizes ) {
+			for( size_t capa : s_que_sizes )
+				for( size_t prec : s_precisions ) {
+					Report( RunOne( s_log_file, threads, msg_size, capa, prec ) );
+					Report( RunOne( "/dev/null", threads, msg_size, capa, prec ) );
+				}
+			if( s_syslog )
+				Report( RunOne( "syslog", threads, msg_size, 0, 0 ) );
+		}
+
+	if( s_syslog )
+		closelog();
+	return EXIT_SUCCESS;
+};
+
+void parseCmdLineOpts( int argc, const char* const* const args ) {
+	auto list = []( const char* arg_ ) {
+		vector<size_t> result;
+		istringstream iss( arg_ );
+		for( string one; getline( iss, one, ',' ); )
+			result.push_back( strtoul( one.c_str(), nullptr, 10 ) );
+		return result;
+	};
+
+	bool opt_err = false;
+	for( int i = 1; i < argc; ++i ) {
+		string argv = trim( args[i] );
+		if( argv == "-T" || argv == "--threads" ) {
+			if( !( opt_err = ++i >= argc ) )
+				s_thread_counts = list( args[i] );
+		} else if( argv == "-M" || argv == "--msg-sizes" ) {
+			if( !( opt_err = ++i >= argc ) )
+				s_msg_sizes = list( args[i] );
+		} else if( argv == "-Q" || argv == "--que-sizes" ) {
+			if( !( opt_err = ++i >= argc ) )
+				s_que_sizes = list( args[i] );
+		} else if( argv == "-P" || argv == "--precisions" ) {
+			if( !( opt_err = ++i >= argc ) )
+				s_precisions = list( args[i] );
+		} else if( argv == "-N" || argv == "--count" ) {
+			if( !( opt_err = ++i >= argc ) )
+				s_count = strtoull( args[i], nullptr, 10 );
+		} else if( argv == "-F" || argv == "--file" ) {
+			if( !( opt_err = ++i >= argc ) )
+				s_log_file = args[i];
+		} else if( argv == "-B" || argv == "--block" )
+			s_block = true;
+		else if( argv == "--no-syslog" )
+			s_syslog = false;
+		else if( argv == "--csv" )
+			s_csv = true;
+		else
+			ExitWithLog( '"' + argv + "\"是无法识别的选项,无法继续!" );
+	};
+
+	if( opt_err || s_count == 0 || s_thread_counts.empty() || s_msg_sizes.empty()
+			|| s_que_sizes.empty() || s_precisions.empty() )
+		ExitWithLog( "选项错误,无法继续!" );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
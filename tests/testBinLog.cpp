@@ -0,0 +1,143 @@
+#include <cstring>
+#include <fstream>
+#include <leonlog/BinLog.hpp>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+
+const str_t LOG_FILE { "/tmp/ut-binlog.log" };
+const str_t TEXT_FILE { "/tmp/ut-binlog.txt" };
+
+// 各种记录都有: 文本、各类型参数、结构化字段
+void WriteSome() {
+	lg_info << "文本 " << 1;
+	LOGF( LogLevel_e::Warnn, "i={} u={:x} d={:.2} b={} c={}", -7, 255u, 3.14159, true, 'z' );
+	lg_erro.kv( "k", 2 ) << "kv";
+	LOGF( LogLevel_e::Notif, "level={} big={}", LogLevel_e::Error, int64_t( 1 ) << 40 );
+};
+
+// 解码 bin_ 的内容, 返回各行; 报告的错误存入 err_
+vector<str_t> Decode( const str_t& bin_, str_t& err_ ) {
+	istringstream in( bin_ );
+	ostringstream out, err;
+	EXPECT_TRUE( DecodeBinLog( in, out, err ) );
+	err_ = err.str();
+	vector<str_t> lines;
+	istringstream text( out.str() );
+	for( str_t line; getline( text, line ); )
+		lines.push_back( line );
+	return lines;
+};
+
+// 去掉时戳, 只留 ",级别,线程,内容"
+vector<str_t> NoStamps( vector<str_t> lines_ ) {
+	for( auto& line : lines_ )
+		line.erase( 0, line.find( ',' ) );
+	return lines_;
+};
+
+// 拼出一条记录
+str_t Rec( char kind_, uint8_t level_, const str_t& payload_ ) {
+	BinRecHead_t head { static_cast<uint8_t>( kind_ ), level_, 0, static_cast<uint32_t>( payload_.size() ), 0 };
+	return str_t( reinterpret_cast<const char*>( &head ), sizeof( head ) ) + payload_;
+};
+
+template <typename T>
+str_t Raw( T v_ ) {
+	return str_t( reinterpret_cast<const char*>( &v_ ), sizeof( v_ ) );
+};
+
+class BinLogTest : public LogFileTest {
+protected:
+	BinLogTest() : LogFileTest( { LOG_FILE, TEXT_FILE } ) {};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetBinaryLog( false );
+	};
+};
+
+TEST_F( BinLogTest, decodesLikeTextLog ) {
+	StartLog( TEXT_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	WriteSome();
+	StopLog( false, false );
+
+	// 两个会话, 第二个追加在后, 字典重建
+	SetBinaryLog( true );
+	for( int i = 0; i < 2; ++i ) {
+		StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+		WriteSome();
+		StopLog( false, false );
+	}
+
+	str_t err;
+	vector<str_t> decoded = Decode( ReadAll( LOG_FILE ), err );
+	ASSERT_EQ( err, "" );
+	vector<str_t> text = NoStamps( ReadLines( TEXT_FILE ) );
+	ASSERT_EQ( text.size(), 4u );
+	ASSERT_EQ( text[1], ",WARNN,MainThread,i=-7 u=ff d=3.14 b=true c=z" );
+	vector<str_t> twice = text;
+	twice.insert( twice.end(), text.begin(), text.end() );
+	ASSERT_EQ( NoStamps( decoded ), twice );
+};
+
+TEST_F( BinLogTest, appendedAfterText ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	lg_info << "先写的文本";
+	StopLog( false, false );
+	size_t text_size = ReadAll( LOG_FILE ).size();
+
+	SetBinaryLog( true );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	lg_info << "后写的二进制";
+	StopLog( false, false );
+
+	// 追加处补写了文件头
+	str_t bin = ReadAll( LOG_FILE );
+	ASSERT_EQ( bin.compare( text_size, sizeof( BIN_LOG_MAGIC ), BIN_LOG_MAGIC, sizeof( BIN_LOG_MAGIC ) ), 0 );
+	str_t err;
+	vector<str_t> decoded = Decode( bin, err );
+	ASSERT_EQ( err, "跳过了开头 " + to_string( text_size ) + " 字节的非二进制内容\n" );
+	ASSERT_EQ( NoStamps( decoded ), vector<str_t> { ",INFOR,MainThread,后写的二进制" } );
+};
+
+TEST_F( BinLogTest, badRecordsAreSkipped ) {
+	BinFileHead_t fhead {};
+	memcpy( fhead.magic, BIN_LOG_MAGIC, sizeof( fhead.magic ) );
+	fhead.version = BIN_LOG_VERSION;
+
+	str_t bin = Raw( fhead );
+	bin += Rec( 'H', 6, "1.0" );
+	bin += Rec( 'L', LogLevel_e::Infor, "INFOR" );
+	bin += Rec( 'F', 0, Raw( uint32_t( 0 ) ) + "i" );							// 类型码串没有结尾
+	bin += Rec( 'F', 0, "ab" );												// 连编号都不全
+	bin += Rec( 'F', 0, Raw( uint32_t( 1 ) ) + "i" + '\0' + "v={}" );
+	bin += Rec( 'F', 0, Raw( uint32_t( 2 ) ) + "?" + '\0' + "{}" );			// 未知类型码
+	bin += Rec( 'A', LogLevel_e::Infor, "ab" );								// 连编号都不全
+	bin += Rec( 'A', LogLevel_e::Infor, Raw( uint32_t( 1 ) ) + "ab" );		// 参数不足
+	bin += Rec( 'A', LogLevel_e::Infor, Raw( uint32_t( 9 ) ) + "abcd" );	// 未定义的格式串
+	bin += Rec( 'Z', 0, "?" );												// 未知记录
+	bin += Rec( 'A', LogLevel_e::Infor, Raw( uint32_t( 1 ) ) + Raw( int32_t( 5 ) ) );
+	bin += Rec( 'S', LogLevel_e::Infor, "ok" );
+	bin += Rec( 'S', LogLevel_e::Infor, str_t( 100, 'x' ) ).substr( 0, 50 );	// 截断
+
+	str_t err;
+	vector<str_t> decoded = Decode( bin, err );
+	ASSERT_EQ( NoStamps( decoded ), ( vector<str_t> { ",INFOR,,v=5", ",INFOR,,ok" } ) );
+	ASSERT_EQ( CountOf( err, "已跳过" ), 7u ) << err;
+	ASSERT_EQ( CountOf( err, "第2条日志之后文件被截断" ), 1u ) << err;
+
+	// 没有文件头的不认
+	istringstream in( "不是二进制日志" );
+	ostringstream out, err2;
+	ASSERT_FALSE( DecodeBinLog( in, out, err2 ) );
+	ASSERT_EQ( out.str(), "" );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
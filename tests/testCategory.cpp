@@ -0,0 +1,109 @@
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+
+const str_t LOG_FILE { "/tmp/ut-category.log" };
+
+LogCategory_t s_net_cat { "net" };
+LogCategory_t s_db_cat { "db" };
+
+bool Has( str_cr text_, str_cr what_ ) {
+	return text_.find( what_ ) != str_t::npos;
+};
+
+class CategoryTest : public LogFileTest {
+protected:
+	CategoryTest() : LogFileTest( { LOG_FILE } ) {};
+	void SetUp() override {
+		LogFileTest::SetUp();
+		StartLog( LOG_FILE, LogLevel_e::Notif, 6, 1024, "", false, false );
+	};
+	void TearDown() override {
+		SetCategoryLevel( "net", LogLevel_e::VALUES_COUNT );
+		SetCategoryLevel( "db", LogLevel_e::VALUES_COUNT );
+		SetThreadLogLevel( LogLevel_e::VALUES_COUNT );
+		LogFileTest::TearDown();
+	};
+};
+
+TEST_F( CategoryTest, categoriesFollowGlobalUnlessSet ) {
+	ASSERT_EQ( s_net_cat.level.load(), LogLevel_e::Notif );
+	ASSERT_EQ( s_db_cat.gate.load(), LogLevel_e::Notif );
+
+	SetCategoryLevel( "net", LogLevel_e::Debug );
+	ASSERT_EQ( s_net_cat.gate.load(), LogLevel_e::Debug );
+	ASSERT_EQ( g_log_level.load(), LogLevel_e::Notif );
+
+	// 类别级别设定后就不再跟随全系统级别
+	SetLogLevel( LogLevel_e::Warnn );
+	ASSERT_EQ( s_net_cat.level.load(), LogLevel_e::Debug );
+	ASSERT_EQ( s_db_cat.level.load(), LogLevel_e::Warnn );
+	SetLogLevel( LogLevel_e::Notif );
+};
+
+TEST_F( CategoryTest, onlyThatCategoryIsDebug ) {
+	SetCategoryLevel( "net", LogLevel_e::Debug );
+	int built = 0;
+	auto body = [&built] { ++built; return "built"; };
+
+	lgc_debg( s_net_cat ) << "net-debug";
+	LOGCF( s_net_cat, LogLevel_e::Infor, "net-infor={}", 1 );
+	lgc_debg( s_db_cat ) << "db-debug" << body();
+	LOGCF( s_db_cat, LogLevel_e::Infor, "db-infor={}", 1 );
+	lg_debg << "plain-debug" << body();
+	lgc_note( s_db_cat ) << "db-notif";
+	StopLog( false, false );
+
+	// 关闭的类别连日志内容都不会构造
+	ASSERT_EQ( built, 0 );
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_TRUE( Has( text, "net-debug" ) );
+	ASSERT_TRUE( Has( text, "net-infor=1" ) );
+	ASSERT_FALSE( Has( text, "db-debug" ) );
+	ASSERT_FALSE( Has( text, "db-infor" ) );
+	ASSERT_FALSE( Has( text, "plain-debug" ) );
+	ASSERT_TRUE( Has( text, "db-notif" ) );
+};
+
+TEST_F( CategoryTest, threadOverride ) {
+	thread loud( [] {
+		SetThreadLogLevel( LogLevel_e::Debug );
+		lg_debg << "loud-plain";
+		lgc_debg( s_db_cat ) << "loud-db";
+		LOGF( LogLevel_e::Debug, "loud-fmt={}", 2 );
+	} );
+	loud.join();
+
+	// 覆盖只对那个线程有效, 线程退出即撤销
+	ASSERT_EQ( g_log_level.load(), LogLevel_e::Notif );
+	ASSERT_EQ( s_db_cat.gate.load(), LogLevel_e::Notif );
+
+	SetThreadLogLevel( LogLevel_e::Infor );
+	ASSERT_EQ( g_log_level.load(), LogLevel_e::Infor );
+	thread quiet( [] {
+		// 门槛降了, 但别的线程仍按原级别
+		lg_info << "quiet-infor";
+		LOGF( LogLevel_e::Infor, "quiet-fmt={}", 3 );
+	} );
+	quiet.join();
+	lg_info << "main-infor";
+	StopLog( false, false );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_TRUE( Has( text, "loud-plain" ) );
+	ASSERT_TRUE( Has( text, "loud-db" ) );
+	ASSERT_TRUE( Has( text, "loud-fmt=2" ) );
+	ASSERT_FALSE( Has( text, "quiet-infor" ) );
+	ASSERT_FALSE( Has( text, "quiet-fmt" ) );
+	ASSERT_TRUE( Has( text, "main-infor" ) );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,123 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <string>
+#include <thread>
+#include <zlib.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std::chrono;
+using namespace std;
+namespace fs = std::filesystem;
+
+const fs::path LOG_DIR { "/tmp/ut-compress" };
+const str_t LOG_FILE { ( LOG_DIR / "zip.log" ).string() };
+
+// 用 zlib 的 gz 接口解压(能读懂多成员的 gzip 文件)
+str_t Gunzip( const fs::path& file_ ) {
+	str_t text;
+	gzFile gz = gzopen( file_.c_str(), "rb" );
+	if( gz == nullptr )
+		return text;
+	char buf[4096];
+	for( int n; ( n = gzread( gz, buf, sizeof( buf ) ) ) > 0; )
+		text.append( buf, n );
+	gzclose( gz );
+	return text;
+};
+
+// 等待压缩线程处理完
+bool WaitFor( const fs::path& gz_, const fs::path& orig_ ) {
+	auto time_out = steady_clock::now() + 10s;
+	while( steady_clock::now() < time_out ) {
+		if( fs::exists( gz_ ) && !fs::exists( orig_ ) )
+			return true;
+		this_thread::sleep_for( 10ms );
+	}
+	return false;
+};
+
+class CompressTest : public LogFileTest {
+protected:
+	CompressTest() : LogFileTest( { LOG_DIR } ) {};
+	void SetUp() override {
+		LogFileTest::SetUp();
+		fs::create_directories( LOG_DIR );
+		SetCompressor( true );
+	};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetCompressor( false );
+	};
+};
+
+TEST_F( CompressTest, cannotChangeWhileLogging ) {
+	AssertFixedWhileLogging( LOG_FILE, [] { SetCompressor( false ); } );
+};
+
+TEST_F( CompressTest, rotatedFileIsCompressed ) {
+	// 队列要够大, 免得 Infor 级别的日志因队满被丢弃
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1 << 15, "", false, false );
+	// 足够多, 好跨越若干压缩块
+	for( int i = 0; i < 20000; ++i )
+		LOGF( LogLevel_e::Infor, "line={} 填充些内容, 好让它多占几个块", i );
+	// 轮转不等队列清空, 给日志线程一点时间, 好让多数日志进入被轮转的文件
+	this_thread::sleep_for( 200ms );
+	RotateLogFile( "r1" );
+
+	fs::path orig = LOG_DIR / "zip-r1.log";
+	fs::path gz = LOG_DIR / "zip-r1.log.gz";
+	ASSERT_TRUE( WaitFor( gz, orig ) );
+
+	str_t text = Gunzip( gz );
+	ASSERT_NE( text.find( "line=0 " ), str_t::npos );
+	ASSERT_GT( text.size(), 0xff00u * 2 );
+	ASSERT_EQ( text.back(), '\n' );
+
+	// 逐块检查 BGZF 头: 每块都是独立的 gzip 成员, 头里记着整块长度, 可据此跳跃(随机访问)
+	str_t raw = ReadAll( gz );
+	size_t pos = 0, blocks = 0, isize_sum = 0;
+	while( pos < raw.size() ) {
+		const auto* b = reinterpret_cast<const uint8_t*>( raw.data() + pos );
+		ASSERT_EQ( b[0], 0x1f );
+		ASSERT_EQ( b[1], 0x8b );
+		ASSERT_EQ( b[3], 4 );	// FEXTRA
+		ASSERT_EQ( b[12], 'B' );
+		ASSERT_EQ( b[13], 'C' );
+		size_t bsize = ( b[16] | b[17] << 8 ) + 1;
+		ASSERT_LE( pos + bsize, raw.size() );
+		const uint8_t* tail = b + bsize - 4;
+		isize_sum += tail[0] | tail[1] << 8 | tail[2] << 16 | uint32_t( tail[3] ) << 24;
+		pos += bsize;
+		++blocks;
+	}
+	ASSERT_EQ( pos, raw.size() );
+	ASSERT_GT( blocks, 2u );
+	ASSERT_EQ( isize_sum, text.size() );
+	// 最后是空的结束块
+	ASSERT_EQ( raw.substr( raw.size() - 28, 4 ), str_t( "\x1f\x8b\x08\x04", 4 ) );
+};
+
+TEST_F( CompressTest, leftoversAreCompressedAtStart ) {
+	// 上次轮转出来还没压缩的, 以及没压完的残片
+	fs::path orig = LOG_DIR / "zip-old.log";
+	fs::path part = LOG_DIR / "zip-old.log.gz.part";
+	ofstream( orig ) << "遗留的日志\n";
+	ofstream( part ) << "残片";
+	fs::path other = LOG_DIR / "other-old.log";
+	ofstream( other ) << "别人的\n";
+
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	fs::path gz = LOG_DIR / "zip-old.log.gz";
+	ASSERT_TRUE( WaitFor( gz, orig ) );
+	ASSERT_EQ( Gunzip( gz ), "遗留的日志\n" );
+	ASSERT_FALSE( fs::exists( part ) );
+	ASSERT_TRUE( fs::exists( other ) );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
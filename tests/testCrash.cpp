@@ -0,0 +1,103 @@
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <leonlog/BinLog.hpp>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+using namespace std::chrono;
+
+const str_t LOG_FILE { "/tmp/ut-crash.log" };
+constexpr int LOG_COUNT = 50000;
+
+// 子进程里写一大批日志后立即崩溃, 返回子进程的结束状态, 及从崩溃到结束的耗时
+int CrashChild( int sig_, bool binary_, milliseconds& took_ ) {
+	int fds[2];
+	if( pipe( fds ) != 0 )
+		return -1;
+
+	pid_t child = fork();
+	if( child == 0 ) {
+		SetBinaryLog( binary_ );
+		SetCrashHandler( true );
+		StartLog( LOG_FILE, LogLevel_e::Debug, 6, LOG_COUNT * 2, "", true, false );
+		for( int i = 0; i < LOG_COUNT; ++i ) {
+			LOGF( LogLevel_e::Infor, "seq={}", i );
+			if( i % 2 == 0 )
+				lg_info << "text=" << i;
+		}
+		char c = 'x';
+		write( fds[1], &c, 1 );
+		raise( sig_ );
+		_exit( EXIT_SUCCESS );
+	}
+
+	char c;
+	read( fds[0], &c, 1 );
+	auto start = steady_clock::now();
+	int status = 0;
+	waitpid( child, &status, 0 );
+	took_ = duration_cast<milliseconds>( steady_clock::now() - start );
+	close( fds[0] );
+	close( fds[1] );
+	return status;
+};
+
+class CrashTest : public LogFileTest {
+protected:
+	CrashTest() : LogFileTest( { LOG_FILE, LOG_FILE + ".crash" } ) {};
+};
+
+TEST_F( CrashTest, queuedLogsSurviveAbort ) {
+	milliseconds took;
+	int status = CrashChild( SIGABRT, false, took );
+	ASSERT_TRUE( WIFSIGNALED( status ) );
+	ASSERT_EQ( WTERMSIG( status ), SIGABRT );
+	ASSERT_LT( took, 1s );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( CountOf( text, "seq=" ), size_t( LOG_COUNT ) );
+	ASSERT_EQ( CountOf( text, "text=" ), size_t( LOG_COUNT / 2 ) );
+	ASSERT_EQ( CountOf( text, "致命信号 6(SIGABRT)" ), 1u );
+	// 崩溃标记是最后一行
+	ASSERT_NE( text.rfind( "SIGABRT" ), str_t::npos );
+	ASSERT_GT( text.rfind( "SIGABRT" ), text.rfind( "seq=" ) );
+};
+
+TEST_F( CrashTest, binaryLogSavesText ) {
+	milliseconds took;
+	int status = CrashChild( SIGSEGV, true, took );
+	ASSERT_TRUE( WIFSIGNALED( status ) );
+	ASSERT_EQ( WTERMSIG( status ), SIGSEGV );
+
+	// 写进二进制日志的加上另存为文本的, 一条不少
+	str_t crash_text = ReadAll( LOG_FILE + ".crash" );
+	ASSERT_EQ( CountOf( crash_text, "致命信号 11(SIGSEGV)" ), 1u );
+	std::ifstream bin( LOG_FILE, std::ios::binary );
+	std::ostringstream decoded, err;
+	ASSERT_TRUE( DecodeBinLog( bin, decoded, err ) ) << err.str();
+	ASSERT_EQ( CountOf( decoded.str(), "seq=" ) + CountOf( crash_text, "seq=" ), size_t( LOG_COUNT ) );
+	ASSERT_EQ( CountOf( decoded.str(), "text=" ) + CountOf( crash_text, "text=" ), size_t( LOG_COUNT / 2 ) );
+};
+
+TEST_F( CrashTest, handlerRemovedByStopLog ) {
+	SetCrashHandler( true );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	StopLog( false, false );
+	SetCrashHandler( false );
+
+	struct sigaction act;
+	sigaction( SIGSEGV, nullptr, &act );
+	ASSERT_EQ( act.sa_handler, SIG_DFL );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,75 @@
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std::chrono_literals;
+using namespace std;
+
+const str_t LOG_FILE { "/tmp/ut-dedup.log" };
+
+class DedupTest : public LogFileTest {
+protected:
+	DedupTest() : LogFileTest( { LOG_FILE } ) {};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetDedupWindow( 0s );
+	};
+};
+
+TEST_F( DedupTest, offByDefault ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	ASSERT_THROW( SetDedupWindow( 1s ), leon_utl::bad_usage );
+	for( int i = 0; i < 3; ++i )
+		lg_warn << "重连失败";
+	StopLog( false, false );
+	ASSERT_EQ( CountOf( ReadAll( LOG_FILE ), "重连失败" ), 3u );
+};
+
+TEST_F( DedupTest, repeatsCollapseIntoSummary ) {
+	SetDedupWindow( 10s );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	for( int i = 0; i < 1000; ++i ) {
+		lg_warn << "重连失败";
+		LOGF( LogLevel_e::Warnn, "端口={}", 8080 );
+		// 内容不同的照常写
+		LOGF( LogLevel_e::Warnn, "序号={}", i );
+	}
+	// 同样内容, 级别不同也不算重复
+	lg_erro << "重连失败";
+	StopLog( false, false );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( CountOf( text, "序号=" ), 1000u );
+	ASSERT_EQ( CountOf( text, ",重连失败" ), 2u );
+	ASSERT_EQ( CountOf( text, ",端口=8080" ), 1u );
+	ASSERT_EQ( CountOf( text, "此日志又重复了999次(" ), 2u );
+	ASSERT_EQ( CountOf( text, "):重连失败" ), 1u );
+	ASSERT_EQ( CountOf( text, "):端口=8080" ), 1u );
+};
+
+TEST_F( DedupTest, windowExpires ) {
+	SetDedupWindow( 50ms );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	for( int i = 0; i < 5; ++i )
+		lg_warn << "行情中断";
+	this_thread::sleep_for( 100ms );
+	// 窗口已过: 先补写汇总, 再照常写出
+	lg_warn << "行情中断";
+	lg_warn << "行情中断";
+	StopLog( false, false );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( CountOf( text, ",行情中断" ), 2u );
+	ASSERT_EQ( CountOf( text, "此日志又重复了4次(" ), 1u );
+	ASSERT_EQ( CountOf( text, "此日志又重复了1次(" ), 1u );
+	ASSERT_LT( text.find( "重复了4次" ), text.rfind( ",行情中断" ) );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,119 @@
+#include <csignal>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+
+const str_t LOG_FILE { "/tmp/ut-directlog.log" };
+const str_t ROTATED { "/tmp/ut-directlog-r1.log" };
+
+class DirectLogTest : public LogFileTest {
+protected:
+	DirectLogTest() : LogFileTest( { LOG_FILE, ROTATED } ) {};
+	void SetUp() override {
+		LogFileTest::SetUp();
+		SetDirectLog( true );
+	};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetDirectLog( false );
+	};
+};
+
+TEST_F( DirectLogTest, preallocatesAndTrims ) {
+	// 已有的文件长度不是整块, 接着写不能覆盖或错位
+	ofstream( LOG_FILE ) << "existing\n";
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	for( int i = 0; i < 1000; ++i )
+		LOGF( LogLevel_e::Infor, "line={}", i );
+	this_thread::sleep_for( 100ms );
+
+	// 运行期间预分配了一大段, 但文件长度只到已写出的整块
+	struct stat st {};
+	ASSERT_EQ( stat( LOG_FILE.c_str(), &st ), 0 );
+	ASSERT_GE( static_cast<uint64_t>( st.st_blocks ) * 512, 64u << 20 );
+	ASSERT_LT( static_cast<uint64_t>( st.st_size ), 1u << 20 );
+	ASSERT_EQ( st.st_size % 4096, 0 );
+	StopLog( false, false );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( text.find( '\0' ), str_t::npos );
+	ASSERT_EQ( text.rfind( "existing\n", 0 ), 0u );
+	ASSERT_EQ( CountOf( text, "line=" ), 1000u );
+	ASSERT_EQ( CountOf( text, "line=999\n" ), 1u );
+	ASSERT_EQ( text.back(), '\n' );
+};
+
+TEST_F( DirectLogTest, rotationTrims ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	for( int i = 0; i < 100; ++i )
+		LOGF( LogLevel_e::Infor, "before={}", i );
+	this_thread::sleep_for( 100ms );
+	RotateLogFile( "r1" );
+	for( int i = 0; i < 100; ++i )
+		LOGF( LogLevel_e::Infor, "after={}", i );
+	StopLog( false, false );
+
+	str_t old = ReadAll( ROTATED );
+	str_t cur = ReadAll( LOG_FILE );
+	ASSERT_EQ( old.find( '\0' ), str_t::npos );
+	ASSERT_EQ( cur.find( '\0' ), str_t::npos );
+	ASSERT_EQ( CountOf( old, "before=" ), 100u );
+	ASSERT_EQ( CountOf( cur, "after=" ), 100u );
+};
+
+TEST_F( DirectLogTest, survivesSigkill ) {
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+		for( int i = 0; i < 1000; ++i )
+			LOGF( LogLevel_e::Infor, "line={}", i );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+		raise( SIGKILL );
+	}
+	int status;
+	waitpid( child, &status, 0 );
+	ASSERT_TRUE( WIFSIGNALED( status ) );
+
+	// 被杀之后: 日志都在, 尾部是预分配的空白
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( CountOf( text, "line=" ), 1000u );
+	ASSERT_NE( text.find( '\0' ), str_t::npos );
+
+	// 再次启动即修复, 接着写
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	LOGF( LogLevel_e::Infor, "line={}", 1000 );
+	StopLog( false, false );
+
+	text = ReadAll( LOG_FILE );
+	ASSERT_EQ( text.find( '\0' ), str_t::npos );
+	ASSERT_EQ( CountOf( text, "line=" ), 1001u );
+	ASSERT_EQ( CountOf( text, "上次未能正常关闭" ), 1u );
+};
+
+TEST_F( DirectLogTest, largerThanStaging ) {
+	// 比暂存区还大的一条, 前后都夹着不足一块的
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	lg_erro << "head";
+	AppendLog( LogLevel_e::Error, str_t( 3 << 20, 'y' ) );
+	lg_erro << "tail";
+	StopLog( false, false );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( text.find( '\0' ), str_t::npos );
+	ASSERT_EQ( CountOf( text, str_t( 3 << 20, 'y' ) + '\n' ), 1u );
+	ASSERT_LT( text.find( "head\n" ), text.find( "tail\n" ) );
+	ASSERT_EQ( text.back(), '\n' );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogStats.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+using namespace std::chrono_literals;
+
+const str_t LOG_FILE { "/tmp/ut-durability.log" };
+constexpr int LOG_COUNT = 10000;
+
+class DurabilityTest : public LogFileTest {
+protected:
+	DurabilityTest() : LogFileTest( { LOG_FILE } ) {};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetDurability( LogLevel_e::VALUES_COUNT );
+		SetFlushIntrvl( 1s );
+	};
+};
+
+TEST_F( DurabilityTest, neverByDefault ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	for( int i = 0; i < 100; ++i )
+		lg_erro << "error " << i;
+	StopLog( false, false );
+	ASSERT_EQ( SnapLogStats().syncs_total, 0u );
+};
+
+TEST_F( DurabilityTest, groupCommit ) {
+	SetDurability( LogLevel_e::Error );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	ASSERT_THROW( SetDurability( LogLevel_e::Warnn ), leon_utl::bad_usage );
+
+	// 低于门槛的不落盘
+	for( int i = 0; i < LOG_COUNT; ++i )
+		lg_warn << "warn " << i;
+	this_thread::sleep_for( 100ms );
+	ASSERT_EQ( SnapLogStats().syncs_total, 0u );
+
+	// 几个线程一起写, 同一轮里的共用一次落盘
+	vector<thread> threads;
+	for( int t = 0; t < 4; ++t )
+		threads.emplace_back( [t] {
+			for( int i = 0; i < LOG_COUNT; ++i )
+				lg_erro << "error " << t << '-' << i << ';';
+		} );
+	for( auto& th : threads )
+		th.join();
+	StopLog( false, false );
+
+	uint64_t syncs = SnapLogStats().syncs_total;
+	ASSERT_GE( syncs, 1u );
+	ASSERT_LT( syncs, uint64_t( LOG_COUNT * 4 ) );
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( CountOf( text, "error " ), size_t( LOG_COUNT * 4 ) );
+};
+
+TEST_F( DurabilityTest, fatalWaits ) {
+	// 写盘间隔很长, 不等的话 Fatal 多半还没写出
+	SetFlushIntrvl( 10s );
+	SetDurability( LogLevel_e::VALUES_COUNT, true, 5s );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	for( int i = 0; i < 10; ++i ) {
+		lg_info << "info " << i;
+		lg_fatl << "fatal " << i << ';';
+		// 返回时已落盘, 文件里一定有了
+		ASSERT_EQ( CountOf( ReadAll( LOG_FILE ), "fatal " + to_string( i ) + ';' ), 1u ) << i;
+	}
+	StopLog( false, false );
+	ASSERT_GE( SnapLogStats().syncs_total, 10u );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
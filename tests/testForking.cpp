@@ -1,63 +1,186 @@
-#include <LeonLog>
-#include <filesystem>
-#include <iomanip>
-#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonutils/Exceptions.hpp>
 #include <string>
+#include <sys/wait.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
 
-#include "LeonLog.hpp"
-#include "misc/Converts.hpp"
+#include "TestCommon.hpp"
 
-using namespace leon_utl;
 using namespace leon_log;
-using namespace std::chrono;
 using namespace std;
+using namespace std::chrono_literals;
 
-int main( int argc, char** argv ) {
-	string app_name;
-	std::filesystem::path full_name { argv[0] };
-	app_name = full_name.stem();
+const str_t LOG_FILE { "/tmp/ut-forking.log" };
+const str_t ROTATED { "/tmp/ut-forking-r1.log" };
+constexpr int LOG_COUNT = 1000;
 
-	cout << "pid:" << getpid()
-		 << "\n日志库版本:" << leon_log::Version()
-		 << "\n日志级别:" << leon_log::LevelName( g_log_level )
-		 << endl;
+class ForkingTest : public LogFileTest {
+protected:
+	ForkingTest() : LogFileTest( { LOG_FILE, ROTATED } ) {};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetForkLog( ForkSameFile );
+		SetRotation( 0 );
+		SetFlushIntrvl( 1s );
+	};
+};
 
-	StartLogging( app_name + ".log", LogLevel_e::Debug, 9, 128, true, true, true );
-	lg_note << "主日志开始...";
-// 	std::this_thread::sleep_for( 1s );
-// 	lg_note << "主进程退出";
-// 	stopLogging();
-// 	return EXIT_SUCCESS;
+TEST_F( ForkingTest, childSharesFile ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	// fork 时队列里多半还有没写的, 它们只能由父进程写一次
+	for( int i = 0; i < LOG_COUNT; ++i )
+		lg_info << "parent-before " << i << ';';
 
-	stopLogging( false );
 	pid_t child = fork();
-	if( child < 0 ) {
-		cerr << "fork失败!" << endl;
-		exit( EXIT_FAILURE );
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		if( !IsLogging() )
+			_exit( 1 );
+		for( int i = 0; i < LOG_COUNT; ++i )
+			lg_info << "child " << i << ';';
+		StopLog( false, false );
+		_exit( 0 );
 	}
 
-	if( child > 0 ) {
-		StartLogging( app_name + ".log", LogLevel_e::Debug, 9, 128, false, true, true );
-// 		lg_note << "主日志重启...";
-		lg_info << child << "子进程forked";
-// 		std::this_thread::sleep_for( 5s );
-		lg_note << "父进程退出";
-		stopLogging( true );
-		std::cerr << "父进程已退出" << getpid() << endl;
-		return EXIT_SUCCESS;
-	};
+	// 父进程不必重启日志系统
+	for( int i = 0; i < LOG_COUNT; ++i )
+		lg_info << "parent-after " << i << ';';
+	ASSERT_EQ( WaitChild( child ), 0 );
+	StopLog( false, false );
+
+	vector<str_t> lines = ReadLines( LOG_FILE );
+	ASSERT_EQ( lines.size(), size_t( LOG_COUNT * 3 + 1 ) );
+	for( int i = 0; i < LOG_COUNT; ++i ) {
+		ASSERT_EQ( CountOf( lines, "parent-before " + to_string( i ) + ';' ), 1u ) << i;
+		ASSERT_EQ( CountOf( lines, "parent-after " + to_string( i ) + ';' ), 1u ) << i;
+		ASSERT_EQ( CountOf( lines, "child " + to_string( i ) + ';' ), 1u ) << i;
+	}
+	ASSERT_EQ( CountOf( lines, "pid=" + to_string( getpid() ) + ") fork 而来" ), 1u );
+};
+
+TEST_F( ForkingTest, childPerPidFile ) {
+	SetForkLog( ForkPerPid );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	lg_note << "parent-before";
 
-	std::this_thread::sleep_for( 5s );
-	std::cerr << "子进程将要退出:" << getpid();
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		for( int i = 0; i < LOG_COUNT; ++i )
+			lg_info << "child " << i << ';';
+		StopLog( false, false );
+		_exit( 0 );
+	}
+	ASSERT_EQ( WaitChild( child ), 0 );
+	lg_note << "parent-after";
+	StopLog( false, false );
+
+	const str_t child_file = "/tmp/ut-forking." + to_string( child ) + ".log";
+	vector<str_t> mine = ReadLines( LOG_FILE );
+	vector<str_t> its = ReadLines( child_file );
+	unlink( child_file.c_str() );
+	ASSERT_EQ( mine.size(), 2u );
+	ASSERT_EQ( CountOf( mine, "parent-before" ), 1u );
+	ASSERT_EQ( CountOf( mine, "parent-after" ), 1u );
+	ASSERT_EQ( its.size(), size_t( LOG_COUNT + 1 ) );
+	ASSERT_EQ( CountOf( its, "parent-before" ), 0u );
+	ASSERT_EQ( CountOf( its, "child " + to_string( LOG_COUNT - 1 ) + ';' ), 1u );
+};
 
+TEST_F( ForkingTest, childFollowsRotation ) {
+	SetFlushIntrvl( 20ms );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	int fds[2];
+	ASSERT_EQ( pipe( fds ), 0 );
+
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		lg_info << "child-before";
+		char c;
+		read( fds[0], &c, 1 );
+		// 过几个写盘间隔, 子进程就该发现文件已被轮转走了
+		this_thread::sleep_for( 200ms );
+		lg_info << "child-after";
+		StopLog( false, false );
+		_exit( 0 );
+	}
+	this_thread::sleep_for( 100ms );
+	RotateLogFile( "r1" );
+	write( fds[1], "x", 1 );
+	ASSERT_EQ( WaitChild( child ), 0 );
+	close( fds[0] );
+	close( fds[1] );
+	StopLog( false, false );
 
-// 		_stopLogging();
-// 		cerr << "==子进程:" << getpid();
-// 		cerr << "===子进程:" << getpid();
-// 		child = getpid();
-// 		startLogging( to_string( child ) + ".log", LogLevel_e::Debug, 3, 128 );
-// 		lg_note << child << "子进程将要退出";
-// 		exit( EXIT_SUCCESS );
+	vector<str_t> old_lines = ReadLines( ROTATED );
+	vector<str_t> new_lines = ReadLines( LOG_FILE );
+	ASSERT_EQ( CountOf( old_lines, "child-before" ), 1u );
+	ASSERT_EQ( CountOf( new_lines, "child-after" ), 1u );
+	ASSERT_EQ( CountOf( old_lines, "child-after" ), 0u );
+	// 轮转的提示只有父进程写
+	ASSERT_EQ( CountOf( old_lines, "日志文件将轮转" ), 1u );
+	ASSERT_EQ( CountOf( new_lines, "日志文件已轮转" ), 1u );
 };
+
+TEST_F( ForkingTest, perPidWhenParentRotates ) {
+	SetRotation( 1 << 20 );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		lg_info << "from-child";
+		StopLog( false, false );
+		_exit( 0 );
+	}
+	ASSERT_EQ( WaitChild( child ), 0 );
+	StopLog( false, false );
+
+	const str_t child_file = "/tmp/ut-forking." + to_string( child ) + ".log";
+	vector<str_t> its = ReadLines( child_file );
+	unlink( child_file.c_str() );
+	ASSERT_EQ( CountOf( its, "from-child" ), 1u );
+	ASSERT_EQ( CountOf( ReadLines( LOG_FILE ), "from-child" ), 0u );
+};
+
+TEST_F( ForkingTest, childKeepsThreadName ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	pid_t child = -1;
+	thread( [&child] {
+		RegistThread( "Forker" );
+		child = fork();
+		if( child == 0 ) {
+			lg_info << "from-child";
+			StopLog( false, false );
+			_exit( 0 );
+		}
+	} ).join();
+	ASSERT_GE( child, 0 );
+	ASSERT_EQ( WaitChild( child ), 0 );
+	lg_info << "from-parent";
+	StopLog( false, false );
+
+	vector<str_t> lines = ReadLines( LOG_FILE );
+	ASSERT_EQ( CountOf( lines, ",Forker,from-child" ), 1u );
+	ASSERT_EQ( CountOf( lines, ",MainThread,from-parent" ), 1u );
+};
+
+TEST_F( ForkingTest, childWithoutLog ) {
+	SetForkLog( ForkNoLog );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		// 没有日志线程, 也不该卡在满了的队列上
+		_exit( IsLogging() ? 1 : 0 );
+	}
+	ASSERT_EQ( WaitChild( child ), 0 );
+	ASSERT_TRUE( IsLogging() );
+	ASSERT_THROW( SetForkLog( ForkPerPid ), leon_utl::bad_usage );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,92 @@
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+
+const str_t LOG_FILE { "/tmp/ut-kvlog.log" };
+const str_t SINK_FILE { "/tmp/ut-kvlog-sink.log" };
+
+// 行尾(去掉时戳之后)是否为 tail_
+bool EndsWith( str_cr line_, str_cr tail_ ) {
+	return line_.size() >= tail_.size() && line_.compare( line_.size() - tail_.size(), tail_.size(), tail_ ) == 0;
+};
+
+class KvLogTest : public LogFileTest {
+protected:
+	KvLogTest() : LogFileTest( { LOG_FILE, SINK_FILE } ) {};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetJsonLog( false );
+		ClearLogSinks();
+	};
+};
+
+TEST_F( KvLogTest, textLayout ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	ASSERT_THROW( SetJsonLog( true ), leon_utl::bad_usage );
+	lg_info.kv( "order_id", 12345 ).kv( "px", 101.25 ).kv( "note", "部分 成交" ).kv( "a=b c", 1 ) << "filled";
+	lg_info << "plain";
+	StopLog( false, false );
+
+	vector<str_t> lines = ReadLines( LOG_FILE );
+	ASSERT_EQ( lines.size(), 2u );
+	ASSERT_TRUE( EndsWith( lines[0], ",filled order_id=12345 px=101.25 note=\"部分 成交\" \"a=b c\"=1" ) ) << lines[0];
+	ASSERT_TRUE( EndsWith( lines[1], ",plain" ) ) << lines[1];
+};
+
+TEST_F( KvLogTest, jsonLines ) {
+	SetJsonLog( true );
+	AddLogSink( SINK_FILE, LogLevel_e::Warnn, false );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", true, false );
+	lg_warn.kv( "order_id", 12345 ).kv( "px", 0.1 ).kv( "ok", false ).kv( "why", "\"满\"\n" ) << "拒单:" << 3;
+	LOGF( LogLevel_e::Infor, "px={} qty={}", 12.5, 300 );
+	lg_info << "tab\there";
+	StopLog( false, false );
+
+	// 每行(包括 header)都是一个 JSON 对象, 时戳为带UTC偏移的 RFC 3339
+	vector<str_t> lines = ReadLines( LOG_FILE );
+	ASSERT_EQ( lines.size(), 4u );
+	const regex ts_re( R"(\{"ts":"\d{4}-\d{2}-\d{2}T\d{2}:\d{2}:\d{2}\.\d{6}[+-]\d{2}:\d{2}",.*)" );
+	for( str_cr line : lines ) {
+		ASSERT_TRUE( regex_match( line, ts_re ) ) << line;
+		ASSERT_EQ( line.back(), '}' ) << line;
+	}
+	ASSERT_NE( lines[1].find( "\",\"level\":\"WARNN\",\"thread\":\"" ), str_t::npos ) << lines[1];
+	ASSERT_TRUE( EndsWith( lines[1], "\"msg\":\"拒单:3\","
+						   "\"order_id\":12345,\"px\":0.1,\"ok\":false,\"why\":\"\\\"满\\\"\\n\"}" ) ) << lines[1];
+	ASSERT_TRUE( EndsWith( lines[2], "\"msg\":\"px=12.5 qty=300\"}" ) ) << lines[2];
+	ASSERT_TRUE( EndsWith( lines[3], "\"msg\":\"tab\\there\"}" ) ) << lines[3];
+
+	// 其它输出拿到的是同样的行
+	vector<str_t> sunk = ReadLines( SINK_FILE );
+	ASSERT_EQ( sunk.size(), 1u );
+	ASSERT_EQ( sunk[0], lines[1] );
+};
+
+TEST_F( KvLogTest, binaryKeepsFieldsAsText ) {
+	SetBinaryLog( true );
+	AddLogSink( SINK_FILE, LogLevel_e::Debug, false );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	lg_note.kv( "k", 1 ) << "二进制";
+	StopLog( false, false );
+	SetBinaryLog( false );
+
+	ifstream in( LOG_FILE, ios_base::binary );
+	str_t bin( ( istreambuf_iterator<char>( in ) ), istreambuf_iterator<char>() );
+	ASSERT_NE( bin.find( "二进制 k=1" ), str_t::npos );
+	vector<str_t> sunk = ReadLines( SINK_FILE );
+	ASSERT_EQ( sunk.size(), 1u );
+	ASSERT_TRUE( EndsWith( sunk[0], "二进制 k=1" ) ) << sunk[0];
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
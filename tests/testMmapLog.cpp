@@ -0,0 +1,92 @@
+#include <csignal>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+
+const str_t LOG_FILE { "/tmp/ut-mmaplog.log" };
+const str_t HEAD_FILE { LOG_FILE + ".mmhd" };
+
+class MmapLogTest : public LogFileTest {
+protected:
+	MmapLogTest() : LogFileTest( { LOG_FILE, HEAD_FILE } ) {};
+	void SetUp() override {
+		LogFileTest::SetUp();
+		SetMmapLog( true );
+	};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetMmapLog( false );
+	};
+};
+
+TEST_F( MmapLogTest, cleanShutdownTrimsFile ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", true, false );
+	for( int i = 0; i < 1000; ++i )
+		LOGF( LogLevel_e::Infor, "line={}", i );
+	StopLog( true, false );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( text.find( '\0' ), str_t::npos );
+	ASSERT_EQ( CountOf( text, "line=" ), 1000u );
+	ASSERT_EQ( text.back(), '\n' );
+	ASSERT_EQ( access( HEAD_FILE.c_str(), F_OK ), -1 );
+};
+
+TEST_F( MmapLogTest, survivesSigkill ) {
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", true, false );
+		for( int i = 0; i < 1000; ++i )
+			LOGF( LogLevel_e::Infor, "line={}", i );
+		// 让日志线程写完, 但不给它 flush 的机会以外的任何收尾
+		std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+		raise( SIGKILL );
+	}
+	int status;
+	waitpid( child, &status, 0 );
+	ASSERT_TRUE( WIFSIGNALED( status ) );
+
+	// 被杀之后: 已提交的日志都在(队列里未取走的才会丢), 头文件还在, 尾部是预分配的空白
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( CountOf( text, "line=" ), 1000u );
+	ASSERT_EQ( access( HEAD_FILE.c_str(), F_OK ), 0 );
+	ASSERT_NE( text.find( '\0' ), str_t::npos );
+
+	// 再次启动即修复, 接着写
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", true, false );
+	LOGF( LogLevel_e::Infor, "line={}", 1000 );
+	StopLog( true, false );
+
+	text = ReadAll( LOG_FILE );
+	ASSERT_EQ( text.find( '\0' ), str_t::npos );
+	ASSERT_EQ( CountOf( text, "line=" ), 1001u );
+	ASSERT_EQ( CountOf( text, "上次未能正常关闭" ), 1u );
+	ASSERT_EQ( access( HEAD_FILE.c_str(), F_OK ), -1 );
+};
+
+TEST_F( MmapLogTest, crossesWindows ) {
+	// 比一个映射窗口还多的内容, 含一条比窗口还大的
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	const str_t chunk( 1000, 'x' );
+	for( int i = 0; i < 20000; ++i )
+		lg_erro << "line=" << i << chunk;
+	AppendLog( LogLevel_e::Error, str_t( 17 << 20, 'y' ) );
+	StopLog( false, false );
+
+	str_t text = ReadAll( LOG_FILE );
+	ASSERT_EQ( text.find( '\0' ), str_t::npos );
+	ASSERT_EQ( CountOf( text, "line=" ), 20000u );
+	ASSERT_GT( text.size(), size_t( 37 << 20 ) );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,143 @@
+#include <cstdlib>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <new>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace leon_log;
+using namespace std;
+
+// 计数分配器: 替换全局 operator new, 只统计本线程(生产者)的分配次数, 日志线程的不算
+thread_local size_t tl_allocs = 0;
+
+void* operator new( size_t size_ ) {
+	++tl_allocs;
+	if( void* p = std::malloc( size_ ) )
+		return p;
+	throw std::bad_alloc();
+};
+void operator delete( void* p_ ) noexcept { std::free( p_ ); };
+void operator delete( void* p_, size_t ) noexcept { std::free( p_ ); };
+
+class NoAllocTest : public testing::Test {
+protected:
+	static void SetUpTestSuite() {
+		StartLog( "/dev/null", LogLevel_e::Debug, 6, 1024, "", false, false );
+		// 首条日志会登记线程名、创建本线程的队列, 这些只发生一次, 不计入
+		AppendLog( LogLevel_e::Debug, str_t( "预热" ) );
+	};
+	static void TearDownTestSuite() {
+		StopLog( false, false );
+	};
+};
+
+TEST_F( NoAllocTest, shortBodies ) {
+	const str_t body { "一条不太长的日志, 应该放得进日志条目的内部缓冲区" };
+	str_t moved { "右值也一样" };
+
+	size_t before = tl_allocs;
+	for( int i = 0; i < 100; ++i ) {
+		AppendLog( LogLevel_e::Infor, body );
+		AppendLog( LogLevel_e::Infor, std::move( moved ) );
+	}
+	ASSERT_EQ( tl_allocs - before, 0u );
+};
+
+TEST_F( NoAllocTest, deferredFormat ) {
+	size_t before = tl_allocs;
+	for( int i = 0; i < 100; ++i )
+		LOGF( LogLevel_e::Notif, "px={} qty={} i={}", 12.5, 300u, i );
+	ASSERT_EQ( tl_allocs - before, 0u );
+};
+
+TEST_F( NoAllocTest, streamLogging ) {
+	const str_t name { "合约" };
+	// 本线程的格式化缓冲区首次使用时才创建, 之后按需增长但不再释放, 预热一下
+	lg_info << str_t( 100, '-' );
+
+	size_t before = tl_allocs;
+	for( int i = 0; i < 100; ++i )
+		lg_info << name << ": px=" << 12.5 << " qty=" << 300u << " i=" << i;
+	ASSERT_EQ( tl_allocs - before, 0u );
+};
+
+TEST_F( NoAllocTest, longBodyIsMovedNotCopied ) {
+	str_t long_body( 1000, 'x' );
+
+	// 左值长日志只能拷贝一份
+	size_t before = tl_allocs;
+	AppendLog( LogLevel_e::Infor, long_body );
+	ASSERT_EQ( tl_allocs - before, 1u );
+
+	// 右值长日志直接被接管, 不再分配
+	before = tl_allocs;
+	AppendLog( LogLevel_e::Infor, std::move( long_body ) );
+	ASSERT_EQ( tl_allocs - before, 0u );
+};
+
+TEST( ThreadNames, tableFull ) {
+	// 名字表只增不改: 填满之后再登记的线程共用预留的编号, 先登记的线程名不受影响.
+	// 在子进程里做, 免得名字表满了影响别的测试
+	const str_t log_file { "/tmp/ut-tnames.log" };
+	const int NAMES = 5000;
+	unlink( log_file.c_str() );
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		StartLog( log_file, LogLevel_e::Debug, 6, 1024, "", false, false );
+		for( int pass = 0; pass < 2; ++pass )
+			for( int i = 0; i < NAMES; ++i ) {
+				RegistThread( "n" + std::to_string( i ) );
+				lg_erro << "i=" << i;
+			}
+		StopLog( false, false );
+		_exit( 0 );
+	}
+	int status;
+	waitpid( child, &status, 0 );
+	ASSERT_TRUE( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 );
+
+	// 每行形如"时戳,ERROR,线程名,i=序号", 两遍里同一序号的线程名一致, 是本名的在前, 共用的在后
+	ifstream in( log_file );
+	str_t line;
+	vector<str_t> names[2];
+	while( getline( in, line ) ) {
+		auto at = line.find( ",ERROR," );
+		auto eq = line.rfind( ",i=" );
+		if( at == str_t::npos || eq == str_t::npos )
+			continue;
+		int i = std::stoi( line.substr( eq + 3 ) );
+		str_t name = line.substr( at + 7, eq - at - 7 );
+		auto& pass = names[names[0].size() < NAMES ? 0 : 1];
+		ASSERT_EQ( static_cast<int>( pass.size() ), i );
+		pass.push_back( name );
+	}
+	ASSERT_EQ( names[0].size(), size_t( NAMES ) );
+	ASSERT_EQ( names[1].size(), size_t( NAMES ) );
+	int real = 0;
+	while( real < NAMES && names[0][real] == "n" + std::to_string( real ) )
+		++real;
+	ASSERT_GT( real, 4000 );
+	ASSERT_LT( real, NAMES );
+	for( int i = 0; i < NAMES; ++i ) {
+		ASSERT_EQ( names[1][i], names[0][i] ) << i;
+		if( i >= real ) {
+			ASSERT_EQ( names[0][i], "(线程太多)" ) << i;
+		}
+	}
+	unlink( log_file.c_str() );
+};
+
+GTEST_API_ int main( int argc, char** argv ) {
+
+	testing::InitGoogleTest( &argc, argv );
+
+	return RUN_ALL_TESTS();
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,174 @@
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+// 队列很小, 日志又产生得飞快, 必然有大量日志遇上队满
+constexpr size_t	TINY_QUE = 4;
+constexpr int		LOG_COUNT = 20000;
+const str_t			LOG_FILE { "/tmp/ut-overflow.log" };
+
+// 统计日志文件中各序号出现的情况
+set<int> SeqsInLog( str_cr level_ ) {
+	set<int> seqs;
+	ifstream in( LOG_FILE );
+	str_t line;
+	while( getline( in, line ) ) {
+		auto pos = line.find( ',' + level_ + ',' );
+		auto seq = line.find( "seq=" );
+		if( pos != str_t::npos && seq != str_t::npos )
+			seqs.insert( stoi( line.substr( seq + 4 ) ) );
+	}
+	return seqs;
+};
+
+class OverflowTest : public LogFileTest {
+protected:
+	OverflowTest() : LogFileTest( { LOG_FILE, LOG_FILE + ".spill" } ) {};
+	// 复原为缺省策略, 免得影响别的用例
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetOverflowPolicy( LogLevel_e::Debug, DropNewest );
+		SetOverflowPolicy( LogLevel_e::Infor, DropNewest );
+		SetOverflowPolicy( LogLevel_e::Notif, EvictLower );
+		SetOverflowPolicy( LogLevel_e::Warnn, EvictLower );
+		SetOverflowPolicy( LogLevel_e::Error, Block );
+		SetOverflowPolicy( LogLevel_e::Fatal, Spill );
+		ClearLogSinks();
+	};
+};
+
+TEST_F( OverflowTest, droppedAreCounted ) {
+	SetOverflowPolicy( LogLevel_e::Debug, DropNewest );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, TINY_QUE, "", false, false );
+	for( int i = 0; i < LOG_COUNT; ++i )
+		LOGF( LogLevel_e::Debug, "seq={}", i );
+	StopLog( false, false );
+
+	// 写出的加上丢弃的, 一条不少
+	ASSERT_EQ( SeqsInLog( "DEBUG" ).size() + DroppedLogs( LogLevel_e::Debug ), size_t( LOG_COUNT ) );
+};
+
+TEST_F( OverflowTest, spilledAreReplayed ) {
+	SetOverflowPolicy( LogLevel_e::Fatal, Spill );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, TINY_QUE, "", false, false );
+	for( int i = 0; i < LOG_COUNT; ++i ) {
+		LOGF( LogLevel_e::Fatal, "seq={}", i );
+		lg_fatl << "seq=" << i + LOG_COUNT;
+	}
+	StopLog( false, false );
+
+	ASSERT_EQ( DroppedLogs( LogLevel_e::Fatal ), 0u );
+	set<int> seqs = SeqsInLog( "FATAL" );
+	ASSERT_EQ( seqs.size(), size_t( LOG_COUNT * 2 ) );
+	ASSERT_EQ( *seqs.rbegin(), LOG_COUNT * 2 - 1 );
+	ASSERT_EQ( access( ( LOG_FILE + ".spill" ).c_str(), F_OK ), -1 );
+};
+
+TEST_F( OverflowTest, blockedAreNotLost ) {
+	SetOverflowPolicy( LogLevel_e::Error, Block, std::chrono::seconds( 10 ) );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, TINY_QUE, "", false, false );
+	for( int i = 0; i < LOG_COUNT; ++i )
+		LOGF( LogLevel_e::Error, "seq={}", i );
+	StopLog( false, false );
+
+	ASSERT_EQ( DroppedLogs( LogLevel_e::Error ), 0u );
+	ASSERT_EQ( SeqsInLog( "ERROR" ).size(), size_t( LOG_COUNT ) );
+};
+
+TEST_F( OverflowTest, lowerAreEvicted ) {
+	SetOverflowPolicy( LogLevel_e::Warnn, EvictLower, std::chrono::seconds( 10 ) );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, TINY_QUE, "", false, false );
+	for( int i = 0; i < LOG_COUNT; ++i ) {
+		LOGF( LogLevel_e::Debug, "seq={}", i );
+		LOGF( LogLevel_e::Warnn, "seq={}", i );
+	}
+	StopLog( false, false );
+
+	// 被挤掉的只能是低级别的
+	ASSERT_EQ( DroppedLogs( LogLevel_e::Warnn ), 0u );
+	ASSERT_EQ( SeqsInLog( "WARNN" ).size(), size_t( LOG_COUNT ) );
+	ASSERT_EQ( SeqsInLog( "DEBUG" ).size() + DroppedLogs( LogLevel_e::Debug ), size_t( LOG_COUNT ) );
+};
+
+TEST_F( OverflowTest, evictionFreesRoomAtOnce ) {
+	// 日志线程卡在一个慢输出上: 管道只有一页, 先没人读, 之后也读得很慢
+	int fds[2];
+	ASSERT_EQ( pipe( fds ), 0 );
+	fcntl( fds[1], F_SETPIPE_SZ, 4096 );
+	atomic<int> pace { -1 };	// 读管道的节奏: -1 不读, 0 尽快读, 其余为每读一页后睡多少微秒
+	thread reader( [&] {
+		char buf[4096];
+		for( ;; ) {
+			int p = pace.load();
+			if( p < 0 ) {
+				this_thread::sleep_for( 1ms );
+				continue;
+			}
+			if( read( fds[0], buf, sizeof( buf ) ) <= 0 )
+				break;
+			if( p > 0 )
+				this_thread::sleep_for( microseconds( p ) );
+		}
+	} );
+
+	constexpr size_t QUE = 8192;
+	SetOverflowPolicy( LogLevel_e::Warnn, EvictLower, 300ms );
+	AddLogSink( "/proc/self/fd/" + to_string( fds[1] ), LogLevel_e::Debug, false );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, QUE, "", false, false );
+	close( fds[1] );
+	const str_t big( 2000, 'x' );
+	for( int i = 0; i < 10; ++i )
+		lg_debg << big;
+	this_thread::sleep_for( 50ms );
+
+	// 另一线程积压了一大批更早的低级别日志, 照常归并的话要先写完它们(约4M, 慢慢读要400ms)
+	thread( [&] {
+		for( int i = 0; i < 2000; ++i )
+			lg_debg << big;
+	} ).join();
+	// 本线程的队列也满了, 再来一条 Warnn
+	steady_clock::duration waited {};
+	thread producer( [&] {
+		for( size_t i = 0; i < QUE + 16; ++i )
+			LOGF( LogLevel_e::Debug, "seq={}", i );
+		steady_clock::time_point start = steady_clock::now();
+		LOGF( LogLevel_e::Warnn, "seq={}", 0 );
+		waited = steady_clock::now() - start;
+	} );
+	this_thread::sleep_for( 100ms );
+	pace = 400;
+	producer.join();
+	pace = 0;
+	StopLog( false, false );
+	reader.join();
+	close( fds[0] );
+
+	// 下一轮一开始就挤出了空位, 不必等那一大批写完
+	ASSERT_EQ( DroppedLogs( LogLevel_e::Warnn ), 0u );
+	ASSERT_GT( DroppedLogs( LogLevel_e::Debug ), 0u );
+	ASSERT_LT( waited, 300ms );
+	ASSERT_EQ( SeqsInLog( "WARNN" ).size(), 1u );
+};
+
+TEST_F( OverflowTest, policyFixedWhileRunning ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, TINY_QUE, "", false, false );
+	ASSERT_THROW( SetOverflowPolicy( LogLevel_e::Debug, Block ), leon_utl::bad_usage );
+	StopLog( false, false );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -1,88 +1,114 @@
+#include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <forward_list>
 #include <iomanip>
 #include <iostream>
+#include <leonlog/LeonLog.hpp>
+#include <leonutils/Converts.hpp>
+#include <sstream>
 #include <thread>
 #include <unistd.h>
-
-#include "LeonLog.hpp"
-#include "misc/Converts.hpp"
+#include <vector>
 
 using namespace leon_utl;
 using namespace leon_log;
 using namespace std::chrono;
 using namespace std;
 
+// 压力测试: 若干线程同时狂写日志, 统计生产者一侧(即 AppendLog 本身)的耗时.
+// 线程数可以是逗号分隔的一组, 依次各跑一轮, 便于对比不同并发度下的开销
+// 用法: testPressure [-TC 线程数,缺省"1,2,4,8"] [-L 日志级别] [-R 每轮秒数] [-S 每条间隔ns]
+
 void threadBody( int thread_id );
 
 // 解析命令行参数
 void parseCmdLineOpts( int, const char* const* const );
 
-int				s_thread_count = 1;
+vector<int>		s_thread_counts { 1, 2, 4, 8 };
 LogLevel_e		s_log_level = LogLevel_e::Debug;
 int				s_run_seconds = 3;
 int				s_sleep_nanos = 1;
 nanoseconds					s_sleep_ns = nanoseconds( s_sleep_nanos );
 steady_clock::time_point	s_end_time;
 
-forward_list<thread> runners;
+// 各线程累计的日志条数, 及花在 AppendLog 里的时间
+atomic<uint64_t>	s_total_logs;
+atomic<uint64_t>	s_total_ns;
 
 int main( int argc, char** argv ) {
 	string app_name;
 	std::filesystem::path full_name { argv[0] };
 	app_name = full_name.stem();
 	parseCmdLineOpts( argc, argv );
-	s_end_time = steady_clock::now() + seconds( s_run_seconds );
 	s_sleep_ns = nanoseconds( s_sleep_nanos );
 
 	cout << "pid:" << getpid()
 		 << "\n日志库版本:" << leon_log::Version()
-		 << "\n日志级别:" << leon_log::LevelName( s_log_level )
+		 << "\n日志级别:" << leon_log::NameOf( s_log_level )
 		 << endl;
 
-	StartLogging( app_name + ".log", LogLevel_e::Debug, 9, 1024 * 1024, true, false );
-	lg_note << "主日志开始...";
-
-	for( int i = 0; i < s_thread_count; ++i )
-		runners.emplace_front( threadBody, i );
-	for( auto& rnr : runners )
-		rnr.join();
+	for( int thread_count : s_thread_counts ) {
+		s_total_logs = 0;
+		s_total_ns = 0;
+		StartLog( app_name + ".log", s_log_level, 9, 1 << 16, "", true, false );
+		lg_note << "主日志开始, 线程数:" << thread_count;
+
+		s_end_time = steady_clock::now() + seconds( s_run_seconds );
+		forward_list<thread> runners;
+		for( int i = 0; i < thread_count; ++i )
+			runners.emplace_front( threadBody, i );
+		for( auto& rnr : runners )
+			rnr.join();
+
+		lg_note << "主进程退出";
+		StopLog( true, false );
+
+		uint64_t dropped = 0;
+		for( int l = LogLevel_e::Debug; l < LogLevel_e::VALUES_COUNT; ++l )
+			dropped += DroppedLogs( static_cast<LogLevel_e>( l ) );
+		cout << "线程数:" << setw( 3 ) << thread_count
+			 << ", 日志:" << setw( 12 ) << s_total_logs.load()
+			 << ", 每条 AppendLog 耗时:" << fixed << setprecision( 1 ) << setw( 8 )
+			 << double( s_total_ns.load() ) / max<uint64_t>( s_total_logs.load(), 1 ) << "ns"
+			 << ", 丢弃:" << dropped << endl;
+	}
 
-	lg_note << "主进程退出";
-	StopLogging();
 	return EXIT_SUCCESS;
 };
 
 void threadBody( int my_id ) {
 	RegistThread( "runner" + fmt( my_id, 2, 0, 0, '0' ) );
 
-	int count = 0;
-	auto start_time = steady_clock::now();
+	uint64_t count = 0;
+	nanoseconds in_append { 0 };
 	while( steady_clock::now() < s_end_time ) {
-		if( ! AppendLog( LogLevel_e::Debug, std::to_string( count ) ) )
+		// 计时本身约有几十ns的开销, 各线程数下都一样, 不影响对比
+		auto before = steady_clock::now();
+		bool ok = AppendLog( LogLevel_e::Debug, std::to_string( count ) );
+		in_append += steady_clock::now() - before;
+		if( ! ok )
 			break;
 
 		++count;
 		this_thread::sleep_for( s_sleep_ns );
 	}
 
-	auto lasted = steady_clock::now() - start_time;
-	double write_rate = count * 1000000000.0 / lasted.count();
-	this_thread::sleep_for( milliseconds( my_id * 10 ) );
-	cerr << my_id << "我已退出:"
-		 << fmt( write_rate, 0, 3, 4, ' ', '\'' )
-		 << endl;
+	s_total_logs += count;
+	s_total_ns += in_append.count();
 };
 
 void parseCmdLineOpts( int argc, const char* const* const args ) {
 	bool opt_err = false;
-
 	for( int i = 1; i < argc; ++i ) {
 		string argv = trim( args[i] );
 		if( argv == "-TC" || argv == "--thread-count" ) {
-			if( !( opt_err = ++i >= argc ) )
-				s_thread_count = atoi( args[i] );
+			if( !( opt_err = ++i >= argc ) ) {
+				s_thread_counts.clear();
+				istringstream iss( args[i] );
+				for( string one; getline( iss, one, ',' ); )
+					s_thread_counts.push_back( atoi( one.c_str() ) );
+			}
 		} else if( argv == "-L" || argv == "--log-level" ) {
 			if( !( opt_err = ++i >= argc ) )
 				s_log_level = static_cast<LogLevel_e>( atoi( args[i] ) );
@@ -99,3 +125,5 @@ void parseCmdLineOpts( int argc, const char* const* const args ) {
 	if( opt_err )
 		ExitWithLog( "选项错误,无法继续!" );
 };
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,103 @@
+#include <filesystem>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <regex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+namespace fs = std::filesystem;
+
+const fs::path LOG_DIR { "/tmp/ut-rotation" };
+const str_t LOG_FILE { ( LOG_DIR / "rot.log" ).string() };
+
+// 目录里除当前日志文件外的(即轮转出的)文件
+set<str_t> RotatedFiles() {
+	set<str_t> names;
+	for( const auto& ent : fs::directory_iterator( LOG_DIR ) )
+		if( ent.path() != LOG_FILE )
+			names.insert( ent.path().filename().string() );
+	return names;
+};
+
+class RotationTest : public LogFileTest {
+protected:
+	RotationTest() : LogFileTest( { LOG_DIR } ) {};
+	void SetUp() override {
+		LogFileTest::SetUp();
+		fs::create_directories( LOG_DIR );
+	};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetRotation( 0 );
+	};
+};
+
+TEST_F( RotationTest, cannotChangeWhileLogging ) {
+	AssertFixedWhileLogging( LOG_FILE, [] { SetRotation( 1 << 20 ); } );
+};
+
+TEST_F( RotationTest, rotatesBySizeAndKeepsNewest ) {
+	constexpr uint64_t MAX_BYTES = 64 << 10;
+	// 不是自动轮转出的不删; 中缀更早的, 哪怕是刚改过的, 也先删
+	const str_t NOTES { "rot-notes.log" };
+	const str_t STALE { "rot-20000101-000000.log" };
+	{ std::ofstream( LOG_DIR / NOTES ) << "手记\n"; }
+	{ std::ofstream( LOG_DIR / STALE ) << "旧的\n"; }
+	SetRotation( MAX_BYTES, NoRotate, 3 );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1 << 15, "", false, false );
+	for( int i = 0; i < 20000; ++i ) {
+		LOGF( LogLevel_e::Infor, "line={} 填充些内容, 好让文件快点长大", i );
+		if( i % 1000 == 0 )
+			this_thread::sleep_for( 1ms );
+	}
+	StopLog( false, false );
+
+	// 文件名中缀是开始写的时刻, 同一秒内的再加序号
+	set<str_t> rotated = RotatedFiles();
+	ASSERT_EQ( rotated.erase( NOTES ), 1u );
+	ASSERT_EQ( rotated.count( STALE ), 0u );
+	ASSERT_EQ( rotated.size(), 3u );
+	const regex name_re( R"(rot-\d{8}-\d{6}(-\d+)?\.log)" );
+	for( const auto& name : rotated ) {
+		ASSERT_TRUE( regex_match( name, name_re ) ) << name;
+		// 一轮写出的量加一条轮转提示, 不会超出上限太多
+		auto size = fs::file_size( LOG_DIR / name );
+		ASSERT_GE( size, MAX_BYTES );
+		ASSERT_LT( size, MAX_BYTES * 4 );
+	}
+};
+
+TEST_F( RotationTest, namesNeverRunOut ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	// 旧实现只有 a~z 可加, 第28次就失败了
+	for( int i = 0; i < 40; ++i ) {
+		LOGF( LogLevel_e::Infor, "round={}", i );
+		RotateLogFile( "same" );
+	}
+	StopLog( false, false );
+
+	set<str_t> rotated = RotatedFiles();
+	ASSERT_EQ( rotated.size(), 40u );
+	ASSERT_TRUE( rotated.count( "rot-same.log" ) );
+	ASSERT_TRUE( rotated.count( "rot-same-39.log" ) );
+};
+
+TEST_F( RotationTest, rotatedKey ) {
+	ASSERT_EQ( RotatedKey( LOG_FILE, "/x/rot-20260102-030405.log" ), "20260102-030405-0000000000" );
+	ASSERT_EQ( RotatedKey( LOG_FILE, "rot-20260102-030405-12.log.gz" ), "20260102-030405-0000000012" );
+	ASSERT_LT( RotatedKey( LOG_FILE, "rot-20260102-030405-2.log" ),
+			   RotatedKey( LOG_FILE, "rot-20260102-030405-10.log" ) );
+	for( const char* name : { "rot.log", "rot-same.log", "rot-20260102-030405.log.gz.part", "rot-20260102-030405-.log",
+							  "rot-2026010-030405.log", "rot-20260102-030405-1x.log", "rot-20260102-030405.txt",
+							  "other-20260102-030405.log" } )
+		ASSERT_EQ( RotatedKey( LOG_FILE, name ), "" ) << name;
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
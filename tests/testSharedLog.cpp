@@ -0,0 +1,148 @@
+#include <csignal>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonlog/SharedLog.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+
+const str_t LOG_FILE { "/tmp/ut-sharedlog.log" };
+const str_t RING { "ut-sharedlog" };
+constexpr int PRODUCERS = 4;
+constexpr int LOG_COUNT = 1000;
+// 故意很小, 让生产者绕好几圈
+constexpr size_t RING_SLOTS = 64;
+
+// 子进程作为生产者写 count_ 条日志(count_<0 则写到被杀为止), 然后退出
+pid_t Produce( str_cr label_, int count_ ) {
+	pid_t child = fork();
+	if( child != 0 )
+		return child;
+	SetOverflowPolicy( LogLevel_e::Infor, Block, chrono::seconds( 10 ) );
+	StartSharedLog( RING, LogLevel_e::Infor, label_ );
+	for( int i = 0; count_ < 0 || i < count_; ++i ) {
+		if( i % 10 == 0 )
+			lg_info.kv( "seq", i ) << label_ << '-' << i << ';';
+		else if( i % 10 == 1 && label_.front() == 'p' )	// LOGF 不收字符串参数
+			LOGF( LogLevel_e::Infor, "p{}-{};", label_[1] - '0', i );
+		else
+			lg_info << label_ << '-' << i << ';';
+	}
+	lg_debg << "filtered-out";
+	StopLog();
+	_exit( IsLogging() ? 1 : 0 );
+};
+
+class SharedLogTest : public LogFileTest {
+protected:
+	SharedLogTest() : LogFileTest( { LOG_FILE } ) {};
+	void SetUp() override {
+		LogFileTest::SetUp();
+		shm_unlink( ( "/leonlog-" + RING ).c_str() );
+	};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetLogCollector( "" );
+		SetForkLog( ForkSameFile );
+		shm_unlink( ( "/leonlog-" + RING ).c_str() );
+	};
+};
+
+TEST_F( SharedLogTest, manyProducers ) {
+	SetForkLog( ForkNoLog );
+	SetLogCollector( RING, RING_SLOTS );
+	StartLog( LOG_FILE, LogLevel_e::Infor, 6, 1024, "", false, false );
+	lg_info << "collector-before";
+
+	vector<pid_t> children;
+	for( int p = 0; p < PRODUCERS; ++p )
+		children.push_back( Produce( "p" + to_string( p ), LOG_COUNT ) );
+	for( pid_t child : children )
+		ASSERT_EQ( WaitChild( child ), 0 );
+	// 子进程都退出了, 它们的日志不一定都已写出
+	this_thread::sleep_for( 100ms );
+	lg_info << "collector-after";
+	StopLog( false, false );
+
+	vector<str_t> lines = ReadLines( LOG_FILE );
+	ASSERT_EQ( lines.size(), size_t( PRODUCERS * LOG_COUNT + 2 ) );
+	for( int p = 0; p < PRODUCERS; ++p ) {
+		str_t label = "p" + to_string( p );
+		ASSERT_EQ( CountOf( lines, label + "/MainThread" ), size_t( LOG_COUNT ) ) << label;
+		for( int i = 0; i < LOG_COUNT; ++i )
+			ASSERT_EQ( CountOf( lines, label + '-' + to_string( i ) + ';' ), 1u ) << label << ' ' << i;
+		ASSERT_EQ( CountOf( lines, label + "-0; seq=0" ), 1u ) << label;
+	}
+	ASSERT_EQ( CountOf( lines, "filtered-out" ), 0u );
+	ASSERT_EQ( CountOf( lines, "collector-" ), 2u );
+};
+
+TEST_F( SharedLogTest, deadProducer ) {
+	SetForkLog( ForkNoLog );
+	SetLogCollector( RING, RING_SLOTS );
+	StartLog( LOG_FILE, LogLevel_e::Infor, 6, 1024, "", false, false );
+
+	// 写个不停的生产者被杀在半路, 不该影响后来者
+	pid_t victim = Produce( "victim", -1 );
+	this_thread::sleep_for( 50ms );
+	kill( victim, SIGKILL );
+	ASSERT_EQ( WaitChild( victim ), -1 );
+
+	pid_t child = Produce( "late", LOG_COUNT );
+	ASSERT_EQ( WaitChild( child ), 0 );
+	this_thread::sleep_for( 200ms );
+	StopLog( false, false );
+
+	vector<str_t> lines = ReadLines( LOG_FILE );
+	ASSERT_GT( CountOf( lines, "victim/MainThread" ), 0u );
+	ASSERT_EQ( CountOf( lines, "late/MainThread" ), size_t( LOG_COUNT ) );
+	ASSERT_EQ( CountOf( lines, "late-" + to_string( LOG_COUNT - 1 ) + ';' ), 1u );
+};
+
+TEST_F( SharedLogTest, singleCollector ) {
+	SetForkLog( ForkNoLog );
+	SetLogCollector( RING, RING_SLOTS );
+	StartLog( LOG_FILE, LogLevel_e::Infor, 6, 1024, "", false, false );
+	ASSERT_THROW( SetLogCollector( "" ), leon_utl::bad_usage );
+	ASSERT_THROW( StartSharedLog( RING, LogLevel_e::Infor ), leon_utl::bad_usage );
+
+	// 别的进程再来收集同一个环, 不行
+	pid_t child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		SetLogCollector( RING );
+		try {
+			StartLog( "/tmp/ut-sharedlog-2.log", LogLevel_e::Infor, 6, 1024, "", false, false );
+		} catch( const leon_utl::bad_usage& ) {
+			_exit( 0 );
+		}
+		_exit( 1 );
+	}
+	ASSERT_EQ( WaitChild( child ), 0 );
+	unlink( "/tmp/ut-sharedlog-2.log" );
+
+	// 辞去之后, 别人就可以接手了
+	StopLog( false, false );
+	child = fork();
+	ASSERT_GE( child, 0 );
+	if( child == 0 ) {
+		SetLogCollector( RING );
+		StartLog( "/tmp/ut-sharedlog-2.log", LogLevel_e::Infor, 6, 1024, "", false, false );
+		StopLog( false, false );
+		_exit( 0 );
+	}
+	ASSERT_EQ( WaitChild( child ), 0 );
+	unlink( "/tmp/ut-sharedlog-2.log" );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
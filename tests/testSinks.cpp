@@ -0,0 +1,112 @@
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std::chrono_literals;
+using namespace std;
+namespace fs = std::filesystem;
+
+const fs::path LOG_DIR { "/tmp/ut-sinks" };
+const str_t LOG_FILE { ( LOG_DIR / "main.log" ).string() };
+const str_t ALERT_FILE { ( LOG_DIR / "alert.log" ).string() };
+const str_t ERROR_FILE { ( LOG_DIR / "error.log" ).string() };
+
+class SinkTest : public LogFileTest {
+protected:
+	SinkTest() : LogFileTest( { LOG_DIR } ) {};
+	void SetUp() override {
+		LogFileTest::SetUp();
+		fs::create_directories( LOG_DIR );
+	};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		ClearLogSinks();
+	};
+};
+
+TEST_F( SinkTest, cannotChangeWhileLogging ) {
+	AssertFixedWhileLogging( LOG_FILE, [] { AddLogSink( ALERT_FILE, LogLevel_e::Warnn ); } );
+	AssertFixedWhileLogging( LOG_FILE, [] { ClearLogSinks(); } );
+};
+
+TEST_F( SinkTest, eachSinkGetsItsLevels ) {
+	AddLogSink( ALERT_FILE, LogLevel_e::Warnn );
+	AddLogSink( ERROR_FILE, LogLevel_e::Error, false );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	for( int i = 0; i < 100; ++i ) {
+		LOGF( LogLevel_e::Infor, "infor={}", i );
+		LOGF( LogLevel_e::Warnn, "warnn={}", i );
+		LOGF( LogLevel_e::Error, "error={}", i );
+	}
+	StopLog( false, false );
+
+	str_t main_text = ReadAll( LOG_FILE );
+	str_t alert_text = ReadAll( ALERT_FILE );
+	str_t error_text = ReadAll( ERROR_FILE );
+	ASSERT_EQ( CountOf( main_text, "infor=" ), 100u );
+	ASSERT_EQ( CountOf( main_text, "warnn=" ), 100u );
+	ASSERT_EQ( CountOf( main_text, "error=" ), 100u );
+	ASSERT_EQ( CountOf( alert_text, "infor=" ), 0u );
+	ASSERT_EQ( CountOf( alert_text, "warnn=" ), 100u );
+	ASSERT_EQ( CountOf( alert_text, "error=" ), 100u );
+	ASSERT_EQ( CountOf( error_text, "warnn=" ), 0u );
+	ASSERT_EQ( CountOf( error_text, "error=" ), 100u );
+
+	// 同一条日志只格式化一次, 各输出里的行完全相同
+	auto line_of = []( str_cr text_, str_cr what_ ) {
+		auto pos = text_.find( what_ );
+		auto bol = text_.rfind( '\n', pos ) + 1;
+		return text_.substr( bol, text_.find( '\n', pos ) - bol );
+	};
+	ASSERT_EQ( line_of( main_text, "error=42\n" ), line_of( error_text, "error=42\n" ) );
+	ASSERT_EQ( line_of( main_text, "error=42\n" ), line_of( alert_text, "error=42\n" ) );
+};
+
+TEST_F( SinkTest, stalledSinkDoesNotStallMainFile ) {
+	// 没人读的管道: 写满内核缓冲区后, 该输出线程就卡住了
+	const str_t fifo = ( LOG_DIR / "stalled" ).string();
+	ASSERT_EQ( mkfifo( fifo.c_str(), 0644 ), 0 );
+	int rd = open( fifo.c_str(), O_RDONLY | O_NONBLOCK );
+	ASSERT_GE( rd, 0 );
+
+	AddLogSink( fifo, LogLevel_e::Debug );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1 << 15, "", false, false );
+	constexpr int LOG_COUNT = 200000;
+	for( int i = 0; i < LOG_COUNT; ++i ) {
+		LOGF( LogLevel_e::Infor, "seq={} 填充些内容, 好让管道快点被写满", i );
+		if( i % 1000 == 0 )
+			this_thread::sleep_for( 1ms );
+	}
+
+	// 主日志文件照常写完, 而卡住的输出丢弃了放不下的
+	str_t main_text;
+	for( int i = 0; i < 500 && CountOf( main_text, "seq=" ) + DroppedLogs( LogLevel_e::Infor ) < LOG_COUNT; ++i ) {
+		this_thread::sleep_for( 10ms );
+		main_text = ReadAll( LOG_FILE );
+	}
+	ASSERT_EQ( CountOf( main_text, "seq=" ) + DroppedLogs( LogLevel_e::Infor ), size_t( LOG_COUNT ) );
+
+	// 让管道通畅, StopLog 才能等到输出线程写完
+	fcntl( rd, F_SETFL, 0 );
+	thread reader( [rd] {
+		char buf[4096];
+		while( read( rd, buf, sizeof( buf ) ) > 0 )
+			;
+	} );
+	StopLog( false, false );
+	reader.join();
+	close( rd );
+	ASSERT_NE( ReadAll( LOG_FILE ).find( "输出太慢" ), str_t::npos );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonlog/LogStats.hpp>
+#include <leonlog/StatusFile.hpp>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+using namespace std::chrono_literals;
+
+const str_t LOG_FILE { "/tmp/ut-stats.log" };
+const str_t STATUS_FILE { "/tmp/ut-stats.status" };
+constexpr int LOG_COUNT = 20000;
+
+uint64_t Sum( const uint64_t ( &v_ )[LogLevel_e::VALUES_COUNT] ) {
+	uint64_t n = 0;
+	for( uint64_t x : v_ )
+		n += x;
+	return n;
+};
+
+class StatsTest : public LogFileTest {
+protected:
+	StatsTest() : LogFileTest( { LOG_FILE, STATUS_FILE } ) {};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetFlushIntrvl( 1s );
+	};
+};
+
+TEST_F( StatsTest, countsAddUp ) {
+	SetOverflowPolicy( LogLevel_e::Debug, DropNewest );
+	SetFlushIntrvl( 50ms );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4, "", false, false );
+
+	// 已退出线程的计数也要算上
+	vector<thread> threads;
+	for( int t = 0; t < 4; ++t )
+		threads.emplace_back( [] {
+			for( int i = 0; i < LOG_COUNT; ++i )
+				LOGF( LogLevel_e::Debug, "seq={}", i );
+		} );
+	for( auto& t : threads )
+		t.join();
+	for( int i = 0; i < 100; ++i )
+		lg_note << "note=" << i;
+	this_thread::sleep_for( 200ms );
+
+	LogStats_t st = SnapLogStats();
+	ASSERT_EQ( st.enqueued[LogLevel_e::Debug] + st.dropped[LogLevel_e::Debug], uint64_t( LOG_COUNT * 4 ) );
+	ASSERT_EQ( st.enqueued[LogLevel_e::Notif], 100u );
+	ASSERT_GT( st.dropped[LogLevel_e::Debug], 0u );
+	ASSERT_EQ( st.que_capa, 4u );
+	ASSERT_LE( st.que_high, 4u );
+	ASSERT_GT( st.lines_total, 0u );
+	ASSERT_GT( st.bytes_total, st.lines_total );
+
+	// 入队耗时是抽样的
+	uint64_t samples = 0;
+	for( uint64_t n : st.enque_ns )
+		samples += n;
+	ASSERT_GT( samples, 0u );
+	ASSERT_LE( samples, ( LOG_COUNT * 4 + 100 ) / LogStats_t::LATENCY_SAMPLE + 4 );
+	ASSERT_LE( st.enque_percentile( 0.5 ), st.enque_percentile( 0.999 ) );
+
+	// 停下之后, 写出的都算进去了(另有几行是日志线程报告丢弃数的)
+	StopLog( false, false );
+	st = SnapLogStats();
+	ASSERT_GE( st.lines_total, Sum( st.enqueued ) );
+	ASSERT_LT( st.lines_total - Sum( st.enqueued ), 10u );
+	ASSERT_EQ( st.queued, 0u );
+};
+
+TEST_F( StatsTest, restartResetsCounts ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	for( int i = 0; i < 10; ++i )
+		lg_info << i;
+	StopLog( false, false );
+	ASSERT_EQ( SnapLogStats().enqueued[LogLevel_e::Infor], 10u );
+
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	lg_info << "again";
+	StopLog( false, false );
+	LogStats_t st = SnapLogStats();
+	ASSERT_EQ( st.enqueued[LogLevel_e::Infor], 1u );
+	ASSERT_EQ( st.lines_total, 1u );
+};
+
+TEST_F( StatsTest, writtenToStatusFile ) {
+	SetFlushIntrvl( 100ms );
+	SetStatus( STATUS_FILE, WriteLogStats, 1 );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 1024, "", false, false );
+	for( int i = 0; i < 10; ++i )
+		lg_warn << i;
+	this_thread::sleep_for( 1500ms );
+	StopLog( false, false );
+	SetStatus( "", nullptr, 1 );
+
+	str_t text = ReadAll( STATUS_FILE );
+	ASSERT_NE( text.find( "enqueued.WARNN=10\n" ), str_t::npos ) << text;
+	ASSERT_NE( text.find( "lines_total=10\n" ), str_t::npos ) << text;
+	ASSERT_NE( text.find( "enque_p99_ns=" ), str_t::npos ) << text;
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <fstream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogFmt.hpp>
+#include <leonlog/LogIndex.hpp>
+#include <leonutils/Exceptions.hpp>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "TestCommon.hpp"
+
+using namespace leon_log;
+using namespace std;
+using namespace std::chrono_literals;
+
+const str_t LOG_FILE { "/tmp/ut-timeindex.log" };
+const str_t ROTATED { "/tmp/ut-timeindex-r1.log" };
+
+// 读出索引的各段, 格式不对则返回空
+vector<LogIdxRec_t> ReadIndex( str_cr log_file_ ) {
+	str_t raw = ReadAll( log_file_ + ".idx" );
+	vector<LogIdxRec_t> recs;
+	LogIdxHead_t head;
+	if( raw.size() < sizeof( head ) )
+		return recs;
+	memcpy( &head, raw.data(), sizeof( head ) );
+	if( memcmp( head.magic, LOG_IDX_MAGIC, sizeof( head.magic ) ) != 0 || head.version != LOG_IDX_VERSION
+			|| head.rec_size != sizeof( LogIdxRec_t ) )
+		return recs;
+	recs.resize( ( raw.size() - sizeof( head ) ) / sizeof( LogIdxRec_t ) );
+	memcpy( recs.data(), raw.data() + sizeof( head ), recs.size() * sizeof( LogIdxRec_t ) );
+	return recs;
+};
+
+// 各段首尾相接、止于文件末尾, 段内每行的时戳都在所记的范围内
+void CheckIndex( str_cr log_file_ ) {
+	str_t text = ReadAll( log_file_ );
+	vector<LogIdxRec_t> recs = ReadIndex( log_file_ );
+	ASSERT_FALSE( recs.empty() ) << log_file_;
+	ASSERT_EQ( recs.back().end, text.size() ) << log_file_;
+
+	char lo[LOG_STAMP_MAX], hi[LOG_STAMP_MAX];
+	for( size_t i = 0; i < recs.size(); ++i ) {
+		const auto& r = recs[i];
+		if( i > 0 ) {
+			ASSERT_EQ( r.begin, recs[i - 1].end );
+		}
+		ASSERT_LT( r.begin, r.end );
+		ASSERT_LE( r.min_ns, r.max_ns );
+		ASSERT_TRUE( r.begin == 0 || text[r.begin - 1] == '\n' );
+		ASSERT_EQ( text[r.end - 1], '\n' );
+
+		// 索引里是本地时间, 按UTC格式化即得日志里的样子
+		size_t len = FormatLogStampAt( lo, r.min_ns, 6, 0 );
+		FormatLogStampAt( hi, r.max_ns, 6, 0 );
+		for( size_t pos = r.begin; pos < r.end; pos = text.find( '\n', pos ) + 1 ) {
+			str_t stamp = text.substr( pos, len );
+			ASSERT_GE( stamp, str_t( lo, len ) );
+			ASSERT_LE( stamp, str_t( hi, len ) );
+		}
+	}
+};
+
+class TimeIndexTest : public LogFileTest {
+protected:
+	TimeIndexTest() : LogFileTest( { LOG_FILE, LOG_FILE + ".idx", ROTATED, ROTATED + ".idx" } ) {};
+	void TearDown() override {
+		LogFileTest::TearDown();
+		SetTimeIndex( 0 );
+	};
+};
+
+TEST_F( TimeIndexTest, offByDefault ) {
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	lg_info << "hello";
+	StopLog( false, false );
+	ASSERT_NE( access( ( LOG_FILE + ".idx" ).c_str(), F_OK ), 0 );
+};
+
+TEST_F( TimeIndexTest, everyLines ) {
+	SetTimeIndex( 100, 1h );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	ASSERT_THROW( SetTimeIndex( 10 ), leon_utl::bad_usage );
+	for( int i = 0; i < 1000; ++i )
+		LOGF( LogLevel_e::Infor, "line={}", i );
+	StopLog( false, false );
+
+	CheckIndex( LOG_FILE );
+	ASSERT_GE( ReadIndex( LOG_FILE ).size(), 10u );
+};
+
+TEST_F( TimeIndexTest, everyInterval ) {
+	SetTimeIndex( 1000000, 50ms );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	for( int i = 0; i < 5; ++i ) {
+		LOGF( LogLevel_e::Infor, "batch={}", i );
+		this_thread::sleep_for( 60ms );
+	}
+	StopLog( false, false );
+
+	CheckIndex( LOG_FILE );
+	ASSERT_EQ( ReadIndex( LOG_FILE ).size(), 5u );
+};
+
+TEST_F( TimeIndexTest, reopenAppends ) {
+	SetTimeIndex( 10 );
+	for( int round = 0; round < 2; ++round ) {
+		StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+		for( int i = 0; i < 100; ++i )
+			LOGF( LogLevel_e::Infor, "line={}", i );
+		StopLog( false, false );
+	}
+	CheckIndex( LOG_FILE );
+};
+
+TEST_F( TimeIndexTest, followsRotation ) {
+	SetTimeIndex( 10 );
+	StartLog( LOG_FILE, LogLevel_e::Debug, 6, 4096, "", false, false );
+	for( int i = 0; i < 100; ++i )
+		LOGF( LogLevel_e::Infor, "before={}", i );
+	this_thread::sleep_for( 100ms );
+	RotateLogFile( "r1" );
+	for( int i = 0; i < 100; ++i )
+		LOGF( LogLevel_e::Infor, "after={}", i );
+	StopLog( false, false );
+
+	CheckIndex( ROTATED );
+	CheckIndex( LOG_FILE );
+	ASSERT_EQ( ReadAll( LOG_FILE ).find( "before=" ), str_t::npos );
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,91 @@
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/SharedLog.hpp>
+#include <string>
+#include <sys/mman.h>	// shm_unlink
+
+using namespace leon_log;
+using namespace std;
+
+// 多进程共享内存日志(见 leonlog/SharedLog.hpp)的独立收集者: 把各生产者写进共享内存环的日志写进一个文件.
+// 收到 SIGHUP 时轮转日志文件, 收到 SIGINT/SIGTERM 时收完环里现有的日志后退出.
+// 用法: leonlog-collectd -r <环名> -f <日志文件> [-n 新建环的槽位数,缺省8192] [-p 时戳精度,缺省6]
+//						  [-c 日志线程CPU] [-R 轮转字节数] [-k 保留个数] [-z 压缩轮转出的文件] [-j JSON lines]
+//						  [--unlink 退出时删除共享内存环]
+
+[[noreturn]] void Usage( const char* self_ ) {
+	cerr << "用法: " << self_ << " -r <环名> -f <日志文件> [-n 槽位数] [-p 时戳精度] [-c 日志线程CPU]"
+		 " [-R 轮转字节数] [-k 保留个数] [-z] [-j] [--unlink]" << endl;
+	exit( EXIT_FAILURE );
+};
+
+int main( int argc, char** argv ) {
+	string	ring, file, cpus;
+	size_t	slots = DEFAULT_RING_SLOTS, prec = 6, keep = 0;
+	uint64_t rot_bytes = 0;
+	bool	zip = false, json = false, unlink_ring = false;
+	for( int i = 1; i < argc; ++i ) {
+		string arg = argv[i];
+		bool has_val = i + 1 < argc;
+		if( arg == "-r" && has_val )
+			ring = argv[++i];
+		else if( arg == "-f" && has_val )
+			file = argv[++i];
+		else if( arg == "-n" && has_val )
+			slots = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "-p" && has_val )
+			prec = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "-c" && has_val )
+			cpus = argv[++i];
+		else if( arg == "-R" && has_val )
+			rot_bytes = strtoull( argv[++i], nullptr, 10 );
+		else if( arg == "-k" && has_val )
+			keep = strtoul( argv[++i], nullptr, 10 );
+		else if( arg == "-z" )
+			zip = true;
+		else if( arg == "-j" )
+			json = true;
+		else if( arg == "--unlink" )
+			unlink_ring = true;
+		else
+			Usage( argv[0] );
+	}
+	if( ring.empty() || file.empty() )
+		Usage( argv[0] );
+
+	// 信号都由主线程同步地等, 日志线程(及压缩线程)继承这个屏蔽
+	sigset_t sigs;
+	sigemptyset( &sigs );
+	sigaddset( &sigs, SIGINT );
+	sigaddset( &sigs, SIGTERM );
+	sigaddset( &sigs, SIGHUP );
+	pthread_sigmask( SIG_BLOCK, &sigs, nullptr );
+
+	try {
+		SetLogCollector( ring, slots );
+		SetJsonLog( json );
+		SetRotation( rot_bytes, NoRotate, keep );
+		SetCompressor( zip );
+		StartLog( file, LogLevel_e::Infor, prec, DEFAULT_LOG_QUE_SIZE, cpus, true, false );
+	} catch( const exception& e ) {
+		cerr << "启动失败:" << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+	lg_note << "开始收集共享内存环(" << ring << ")里的日志";
+
+	for( int sig = 0; sigwait( &sigs, &sig ) == 0; ) {
+		if( sig != SIGHUP )
+			break;
+		RotateLogFile( "" );
+	}
+
+	lg_note << "收集者退出";
+	StopLog( true, false );
+	if( unlink_ring )
+		shm_unlink( ( "/leonlog-" + ring ).c_str() );
+	return EXIT_SUCCESS;
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,37 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <leonlog/BinLog.hpp>
+
+using namespace leon_log;
+using namespace std;
+
+// 把 SetBinaryLog( true ) 产生的二进制日志还原为与文本日志相同的格式
+// 用法: leonlog-decode <二进制日志文件> [输出文件,缺省为stdout]
+
+int main( int argc, char** argv ) {
+	if( argc < 2 || argc > 3 ) {
+		cerr << "用法: " << argv[0] << " <二进制日志文件> [输出文件,缺省为stdout]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	ifstream in( argv[1], ios_base::in | ios_base::binary );
+	if( !in ) {
+		cerr << "无法打开日志文件: " << argv[1] << endl;
+		return EXIT_FAILURE;
+	}
+
+	ofstream out_file;
+	if( argc == 3 ) {
+		out_file.open( argv[2], ios_base::out | ios_base::trunc );
+		if( !out_file ) {
+			cerr << "无法创建输出文件: " << argv[2] << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	ostream& out = argc == 3 ? out_file : cout;
+
+	return DecodeBinLog( in, out, cerr ) ? EXIT_SUCCESS : EXIT_FAILURE;
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <leonlog/LeonLog.hpp>
+#include <leonlog/LogIndex.hpp>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+using namespace leon_log;
+using namespace std;
+using namespace std::chrono;
+using namespace std::filesystem;
+
+// 按时间范围查文本日志: 借助 SetTimeIndex 生成的".idx"索引, 只读与之相交的部分.
+// 查的是整条轮转链: 当前日志文件, 及由它自动轮转出来(含已压缩)的"主名-YYYYMMDD-HHMMSS[-n].扩展名[.gz]",
+// 按中缀先后输出.
+// 用法: leonlog-query <日志文件> --from <时刻> [--to <时刻>] [-v]
+//   时刻形如"yy/mm/dd HH:MM[:SS[.fff]]"(与日志里的一样)或"yyyy-mm-dd[ HH:MM[:SS[.fff]]]", 均为本地时间;
+//   含 --from, 不含 --to; -v 则在 stderr 报告读了多少
+
+struct Range_t {
+	uint64_t	begin;
+	uint64_t	end;
+};
+
+struct BgzfBlk_t {
+	uint64_t	raw_off;	// 本块原文在整个文件原文中的位置
+	uint64_t	gz_off;		// 本块在压缩文件中的位置
+	uint32_t	gz_len;
+};
+
+// 只读映射一个文件
+class Mapped_t {
+public:
+	explicit Mapped_t( const path& file_ ) {
+		int fd = ::open( file_.c_str(), O_RDONLY | O_CLOEXEC );
+		if( fd < 0 )
+			return;
+		struct stat st;
+		if( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+			void* p = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( p != MAP_FAILED ) {
+				_data = static_cast<const char*>( p );
+				_size = st.st_size;
+			}
+		}
+		::close( fd );
+	};
+	~Mapped_t() {
+		if( _data != nullptr )
+			munmap( const_cast<char*>( _data ), _size );
+	};
+	Mapped_t( const Mapped_t& ) = delete;
+	Mapped_t& operator=( const Mapped_t& ) = delete;
+
+	const char*	data() const { return _data; };
+	size_t		size() const { return _size; };
+
+private:
+	const char*	_data = nullptr;
+	size_t		_size = 0;
+};
+
+int64_t		s_from = INT64_MIN;
+int64_t		s_to = INT64_MAX;
+uint64_t	s_total = 0;	// 各文件原文共多少字节
+uint64_t	s_read = 0;		// 实际读了多少字节
+
+// 从 p_ 读 n_ 位数字
+bool Digits( const char*& p_, const char* end_, int n_, int& v_ ) {
+	if( end_ - p_ < n_ )
+		return false;
+	v_ = 0;
+	for( int i = 0; i < n_; ++i, ++p_ ) {
+		if( *p_ < '0' || *p_ > '9' )
+			return false;
+		v_ = v_ * 10 + ( *p_ - '0' );
+	}
+	return true;
+};
+
+// 解析"yy/mm/dd HH:MM:SS.fff"或"yyyy-mm-dd HH:MM..."(日期与时刻之间也可以是'T', 即 JSON 日志的 RFC 3339 时戳,
+// 其后的UTC偏移不看; 时分秒、小数都可省), 得到本地时间的纳秒数.
+// p_ 移至解析完的位置
+bool ParseTime( const char*& p_, const char* end_, int64_t& ns_ ) {
+	int y, m, d, hh = 0, mm = 0, ss = 0;
+	bool long_year = end_ - p_ >= 4 && isdigit( p_[2] ) && isdigit( p_[3] );
+	if( !Digits( p_, end_, long_year ? 4 : 2, y ) )
+		return false;
+	if( !long_year )
+		y += 2000;
+	if( p_ == end_ || ( *p_ != '/' && *p_ != '-' ) || !Digits( ++p_, end_, 2, m ) )
+		return false;
+	if( p_ == end_ || ( *p_ != '/' && *p_ != '-' ) || !Digits( ++p_, end_, 2, d ) )
+		return false;
+
+	int64_t sub_ns = 0;
+	if( p_ != end_ && ( *p_ == ' ' || *p_ == 'T' ) ) {
+		if( !Digits( ++p_, end_, 2, hh ) || p_ == end_ || *p_ != ':' || !Digits( ++p_, end_, 2, mm ) )
+			return false;
+		if( p_ != end_ && *p_ == ':' && !Digits( ++p_, end_, 2, ss ) )
+			return false;
+		if( p_ != end_ && *p_ == '.' ) {
+			int64_t scale = 100000000;
+			for( ++p_; p_ != end_ && *p_ >= '0' && *p_ <= '9'; ++p_, scale /= 10 )
+				sub_ns += ( *p_ - '0' ) * scale;
+		}
+	}
+
+	year_month_day ymd { year( y ), month( m ), day( d ) };
+	if( !ymd.ok() || hh > 23 || mm > 59 || ss > 60 )
+		return false;
+	int64_t secs = sys_days( ymd ).time_since_epoch().count() * 86400LL + hh * 3600 + mm * 60 + ss;
+	ns_ = secs * 1000000000 + sub_ns;
+	return true;
+};
+
+// 输出 [p_, end_) 中时戳落在查询范围内的行. 不带时戳的行(一条日志的续行)随其前一行
+void ScanLines( const char* p_, const char* end_ ) {
+	s_read += end_ - p_;
+	bool hit = false;
+	const char* run = nullptr;	// 连续命中的若干行, 一次输出
+	while( p_ < end_ ) {
+		const char* eol = static_cast<const char*>( memchr( p_, '\n', end_ - p_ ) );
+		eol = eol == nullptr ? end_ : eol + 1;
+
+		const char* s = p_;
+		if( *s == '{' && eol - s > 7 && memcmp( s, "{\"ts\":\"", 7 ) == 0 )
+			s += 7;
+		int64_t ns;
+		if( ParseTime( s, eol, ns ) )
+			hit = ns >= s_from && ns < s_to;
+
+		if( hit && run == nullptr )
+			run = p_;
+		else if( !hit && run != nullptr ) {
+			fwrite( run, 1, p_ - run, stdout );
+			run = nullptr;
+		}
+		p_ = eol;
+	}
+	if( run != nullptr )
+		fwrite( run, 1, end_ - run, stdout );
+};
+
+// 索引里与查询范围相交的段, 及没被任何段覆盖的部分(均限于原文长度 size_ 之内)
+vector<Range_t> Candidates( const path& idx_file_, uint64_t size_ ) {
+	vector<Range_t> out;
+	auto add = [&out]( uint64_t b_, uint64_t e_ ) {
+		if( b_ >= e_ )
+			return;
+		if( !out.empty() && out.back().end == b_ )
+			out.back().end = e_;
+		else
+			out.push_back( Range_t { b_, e_ } );
+	};
+
+	Mapped_t idx( idx_file_ );
+	const auto* head = reinterpret_cast<const LogIdxHead_t*>( idx.data() );
+	if( idx.size() < sizeof( LogIdxHead_t )
+			|| memcmp( head->magic, LOG_IDX_MAGIC, sizeof( head->magic ) ) != 0
+			|| head->version != LOG_IDX_VERSION || head->rec_size != sizeof( LogIdxRec_t ) ) {
+		// 没有索引(或认不得), 只好全读
+		add( 0, size_ );
+		return out;
+	}
+
+	const auto* rec = reinterpret_cast<const LogIdxRec_t*>( idx.data() + sizeof( LogIdxHead_t ) );
+	size_t count = ( idx.size() - sizeof( LogIdxHead_t ) ) / sizeof( LogIdxRec_t );
+	uint64_t pos = 0;
+	for( size_t i = 0; i < count && rec[i].begin < size_; ++i ) {
+		uint64_t end = min( rec[i].end, size_ );
+		add( pos, rec[i].begin );
+		if( rec[i].max_ns >= s_from && rec[i].min_ns < s_to )
+			add( rec[i].begin, end );
+		pos = max( pos, end );
+	}
+	add( pos, size_ );
+	return out;
+};
+
+// 遍历 BGZF 各块的头, 得到块表. 不是 BGZF 则返回 false
+bool BgzfBlocks( const Mapped_t& gz_, vector<BgzfBlk_t>& blks_, uint64_t& raw_size_ ) {
+	const auto* p = reinterpret_cast<const uint8_t*>( gz_.data() );
+	uint64_t off = 0, raw = 0;
+	while( off < gz_.size() ) {
+		// 固定头: 1f 8b 08 04 ... XLEN=6, 'B' 'C' 2 0 BSIZE(块长-1)
+		if( gz_.size() - off < 26 || p[off] != 0x1f || p[off + 1] != 0x8b || p[off + 3] != 4
+				|| p[off + 12] != 'B' || p[off + 13] != 'C' )
+			return false;
+		uint32_t len = ( p[off + 16] | p[off + 17] << 8 ) + 1;
+		if( off + len > gz_.size() )
+			return false;
+		const uint8_t* isz = p + off + len - 4;
+		uint32_t raw_len = isz[0] | isz[1] << 8 | isz[2] << 16 | uint32_t( isz[3] ) << 24;
+		if( raw_len > 0 )
+			blks_.push_back( BgzfBlk_t { raw, off, len } );
+		raw += raw_len;
+		off += len;
+	}
+	raw_size_ = raw;
+	return true;
+};
+
+// 解压 BGZF 原文的 [r_.begin, r_.end) 部分
+bool BgzfRead( const Mapped_t& gz_, const vector<BgzfBlk_t>& blks_, const Range_t& r_, string& out_ ) {
+	auto it = upper_bound( blks_.begin(), blks_.end(), r_.begin,
+						   []( uint64_t off_, const BgzfBlk_t& b_ ) { return off_ < b_.raw_off; } );
+	if( it == blks_.begin() )
+		return false;
+	--it;
+
+	out_.clear();
+	uint64_t first = it->raw_off;
+	for( ; it != blks_.end() && it->raw_off < r_.end; ++it ) {
+		z_stream zs {};
+		if( inflateInit2( &zs, -15 ) != Z_OK )
+			return false;
+		size_t old = out_.size();
+		out_.resize( old + 0x10000 );
+		zs.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( gz_.data() ) + it->gz_off + 18 );
+		zs.avail_in = it->gz_len - 18 - 8;
+		zs.next_out = reinterpret_cast<Bytef*>( out_.data() + old );
+		zs.avail_out = 0x10000;
+		int rc = inflate( &zs, Z_FINISH );
+		out_.resize( old + zs.total_out );
+		inflateEnd( &zs );
+		if( rc != Z_STREAM_END )
+			return false;
+	}
+	// 掐头去尾, 就地留下所要的部分
+	uint64_t skip = min<uint64_t>( r_.begin - first, out_.size() );
+	out_.resize( min<uint64_t>( out_.size(), skip + ( r_.end - r_.begin ) ) );
+	out_.erase( 0, skip );
+	return true;
+};
+
+void QueryPlain( const path& file_, const path& idx_file_ ) {
+	Mapped_t log( file_ );
+	s_total += log.size();
+	for( const auto& r : Candidates( idx_file_, log.size() ) )
+		ScanLines( log.data() + r.begin, log.data() + r.end );
+};
+
+void QueryGz( const path& file_, const path& idx_file_ ) {
+	Mapped_t gz( file_ );
+	vector<BgzfBlk_t> blks;
+	uint64_t raw_size = 0;
+	string buf;
+	if( BgzfBlocks( gz, blks, raw_size ) ) {
+		s_total += raw_size;
+		for( const auto& r : Candidates( idx_file_, raw_size ) ) {
+			if( !BgzfRead( gz, blks, r, buf ) ) {
+				cerr << file_.string() << " 解压失败, 已跳过" << endl;
+				return;
+			}
+			ScanLines( buf.data(), buf.data() + buf.size() );
+		}
+		return;
+	}
+
+	// 不是 BGZF(比如被人另行压缩过), 只能从头解压到尾
+	gzFile in = gzopen( file_.c_str(), "rb" );
+	if( in == nullptr ) {
+		cerr << "无法打开日志文件: " << file_.string() << endl;
+		return;
+	}
+	buf.resize( 1 << 20 );
+	string line;
+	for( int n; ( n = gzread( in, buf.data(), buf.size() ) ) > 0; ) {
+		s_total += n;
+		line.append( buf.data(), n );
+		size_t whole = line.rfind( '\n' );
+		if( whole == string::npos )
+			continue;
+		ScanLines( line.data(), line.data() + whole + 1 );
+		line.erase( 0, whole + 1 );
+	}
+	if( !line.empty() )
+		ScanLines( line.data(), line.data() + line.size() );
+	gzclose( in );
+};
+
+// 当前日志文件及由它(以时刻为中缀)轮转出来的各文件, 按中缀旧的在前
+vector<path> RotationChain( const path& live_ ) {
+	path	dir = live_.parent_path().empty() ? path( "." ) : live_.parent_path();
+	vector<pair<string, path>> rotated;
+	error_code ec;
+	for( const auto& ent : directory_iterator( dir, ec ) ) {
+		string key = RotatedKey( live_.string(), ent.path().string() );
+		if( !key.empty() )
+			rotated.emplace_back( move( key ), ent.path() );
+	}
+	sort( rotated.begin(), rotated.end() );
+
+	vector<path> out;
+	for( auto& r : rotated )
+		out.push_back( r.second );
+	if( exists( live_, ec ) )
+		out.push_back( live_ );
+	return out;
+};
+
+int main( int argc, char** argv ) {
+	const char*	file = nullptr;
+	bool		has_from = false;
+	bool		verbose = false;
+	for( int i = 1; i < argc; ++i ) {
+		string arg = argv[i];
+		if( ( arg == "--from" || arg == "--to" ) && i + 1 < argc ) {
+			const char* p = argv[++i];
+			const char* end = p + strlen( p );
+			if( !ParseTime( p, end, arg == "--from" ? s_from : s_to ) || p != end ) {
+				cerr << "无法识别的时刻: " << argv[i] << endl;
+				return EXIT_FAILURE;
+			}
+			has_from |= arg == "--from";
+		} else if( arg == "-v" )
+			verbose = true;
+		else if( file == nullptr && arg[0] != '-' )
+			file = argv[i];
+		else {
+			file = nullptr;
+			break;
+		}
+	}
+	if( file == nullptr || !has_from ) {
+		cerr << "用法: " << argv[0] << " <日志文件> --from <时刻> [--to <时刻>] [-v]\n"
+			 << "  时刻形如\"yy/mm/dd HH:MM[:SS[.fff]]\"或\"yyyy-mm-dd[ HH:MM[:SS[.fff]]]\"(本地时间),"
+			 << " 含 --from, 不含 --to" << endl;
+		return EXIT_FAILURE;
+	}
+
+	auto t0 = steady_clock::now();
+	vector<path> chain = RotationChain( file );
+	if( chain.empty() ) {
+		cerr << "找不到日志文件: " << file << endl;
+		return EXIT_FAILURE;
+	}
+	for( const auto& f : chain ) {
+		// "x.log.gz"的索引是"x.log.idx"
+		path idx = f;
+		bool gz = f.extension() == ".gz";
+		if( gz )
+			idx.replace_extension();
+		idx += ".idx";
+		if( gz )
+			QueryGz( f, idx );
+		else
+			QueryPlain( f, idx );
+	}
+	fflush( stdout );
+
+	if( verbose )
+		cerr << chain.size() << " 个文件, 原文共 " << s_total << " 字节, 读了 " << s_read << " 字节, 用时 "
+			 << duration_cast<microseconds>( steady_clock::now() - t0 ).count() / 1000.0 << "ms" << endl;
+	return EXIT_SUCCESS;
+};
+
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;